@@ -0,0 +1,661 @@
+/* Cycle counts for the ventilator firmware, built for the Mega and run on
+   simavr.
+
+   The firmware ELF is run one instruction at a time, and every call to one
+   of the functions below is timed from its first instruction to the return
+   that pops its frame, so the count includes everything it calls and any
+   interrupt taken while it runs. Every pass through loop() is timed the
+   same way, for the percentiles. Cycle counts are exact for the code the
+   compiler produced, and repeat from run to run.
+
+   The peers are only as detailed as the firmware needs to keep breathing:
+   - A RoboClaw on USART2 acknowledges every write, answers every read with
+     a valid CRC, and is wherever it was last sent.
+   - The pressure sensor on the TWI bus reads PEEP plus a pressure that rises
+     with the paddle.
+   - Push buttons and switches are held at their pull-up (released) level.
+   Serial output goes nowhere.
+
+   Function addresses come from avr-nm, which the bench target in the
+   sketch's Makefile runs. A function the compiler inlined everywhere has no
+   address and is reported as not found.
+
+   Usage:
+       bench_avr FIRMWARE.elf SYMBOLS.txt [--seconds N] [--commit ID] [--out FILE]
+
+   The results are written as JSON to FILE (default stdout).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "avr_ioport.h"
+#include "avr_twi.h"
+#include "avr_uart.h"
+
+
+const unsigned long F_CPU_HZ = 16000000;
+const unsigned long DEFAULT_SECONDS = 30;
+
+// Functions to time, by name as avr-nm -C prints it up to the argument list.
+static const char *const FUNCTIONS[] = {
+    "taskStateMachine",
+    "motor_zeroing_step",
+    "ac_mode_step",
+    "vc_mode_step",
+    "failure_mode",
+    "update_motor_settings",
+    "taskAlarms",
+    "handle_alarms",
+    "updateStateUserParameters",
+    "taskDisplays",
+    "displayUserParameters",
+    "displayAlarms",
+    "LCDBuffer::flush",
+    "update_state",
+    "samplePressureSensor",   // Timer3, every read
+    "pressureReadComplete",   // TWI, every read
+    "pressureCountsToCmH2O",
+    "pressure_decimate",
+    "safety_lane_sample",
+    "patient_trigger_sample",
+    "pressure_filter_step",
+    "breath_metrics_sample",
+    "breath_metrics_step",
+    "MotorLink::poll",
+    "MotorLink::send",
+    "MotorLink::receive",
+    "RoboClawCodec::finish",
+    "RoboClawCodec::crc",
+};
+static const size_t NUM_FUNCTIONS = sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]);
+
+// Timed the same way, but every sample is kept for the percentiles.
+static const char *const LOOP_FUNCTION = "loop";
+
+// From the firmware: Motor.h, pressure.h and RoboClaw.h.
+const uint8_t MOTOR_ADDRESS = 0x80;
+const double QP_AT_FULL_STROKE = 500;
+const uint8_t PRESSURE_SENSOR_ADDRESS = 40;
+const double PSI_TO_CMH2O = 70.307;
+const double MIN_DIGITAL_OUTPUT = 1638;
+const double MAX_DIGITAL_OUTPUT = 14745;
+const double MIN_SENSOR_PRESSURE = -1.0; // PSI
+const double MAX_SENSOR_PRESSURE = 1.0;  // PSI
+
+enum {
+    SETM1ENCCOUNT = 22,
+    M1SPEED = 35,
+    M1SPEEDDIST = 41,
+    M1SPEEDACCELDECCELPOS = 65,
+    SETCONFIG = 98,
+};
+
+const double PEEP = 5.0;            // cmH2O
+const double FULL_STROKE_PRESSURE = 20.0; // cmH2O above PEEP
+
+
+/* Timing for one function.
+ */
+struct Timed {
+    std::string name;
+    std::string symbol;
+    uint32_t address; // Byte address, 0 if not found.
+    unsigned long calls;
+    avr_cycle_count_t total;
+    avr_cycle_count_t min;
+    avr_cycle_count_t max;
+    std::vector<uint32_t> samples; // Only kept for loop().
+    bool keep_samples;
+};
+
+/* A call in progress.
+ */
+struct Frame {
+    size_t timed;
+    uint16_t sp;
+    avr_cycle_count_t start;
+};
+
+
+//Symbols----------------------------------------------------------------------------------------------------------------
+
+static std::string baseName(const std::string &symbol) {
+    return symbol.substr(0, symbol.find('('));
+}
+
+
+static bool loadSymbols(const char *path, std::vector<Timed> &timed) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long address;
+        char type;
+        int name_start = 0;
+
+        if (sscanf(line, "%lx %c %n", &address, &type, &name_start) < 2 || !name_start) {
+            continue;
+        }
+        if ('T' != type && 't' != type) {
+            continue;
+        }
+
+        std::string symbol(line + name_start);
+        symbol.erase(symbol.find_last_not_of("\r\n") + 1);
+
+        for (size_t i = 0; i < timed.size(); i++) {
+            if (!timed[i].address && baseName(symbol) == timed[i].name) {
+                timed[i].address = address;
+                timed[i].symbol = symbol;
+            }
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+//RoboClaw on USART2-----------------------------------------------------------------------------------------------------
+
+struct RoboClawPeer {
+    avr_irq_t *input;
+    uint8_t packet[32];
+    uint8_t received;
+    int32_t position;
+    uint16_t config;
+};
+
+
+static uint16_t crcUpdate(uint16_t crc, uint8_t data) {
+    crc ^= (uint16_t)data << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+
+static int32_t get32(const uint8_t *data) {
+    return (int32_t)(((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3]);
+}
+
+
+// Payload bytes of a write command, -1 for reads.
+static int writeLength(uint8_t cmd) {
+    switch (cmd) {
+        case SETM1ENCCOUNT:         return 4;
+        case M1SPEED:               return 4;
+        case M1SPEEDDIST:           return 9;
+        case M1SPEEDACCELDECCELPOS: return 17;
+        case SETCONFIG:             return 2;
+        default:                    return -1;
+    }
+}
+
+
+static void roboClawSend(RoboClawPeer *peer, const uint8_t *data, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++) {
+        avr_raise_irq(peer->input, data[i]);
+    }
+}
+
+
+// Every read gets a reply of the longest length the firmware asks for, the
+// position in the first four bytes, and config where it asks for config.
+static void roboClawRead(RoboClawPeer *peer, uint8_t cmd) {
+    uint8_t reply[10] = {0};
+    uint8_t length;
+    uint16_t crc = crcUpdate(crcUpdate(0, peer->packet[0]), cmd);
+
+    switch (cmd) {
+        case 16: // GETM1ENC
+            length = 5;
+            break;
+        case 78: // GETENCODERS
+        case 79: // GETISPEEDS
+            length = 8;
+            break;
+        case 49: // GETCURRENTS
+        case 90: // GETERROR
+            length = 4;
+            break;
+        case 82: // GETTEMP, 30.0 C
+            length = 2;
+            reply[0] = 300 >> 8;
+            reply[1] = 300 & 0xFF;
+            break;
+        case 99: // GETCONFIG
+            length = 2;
+            reply[0] = peer->config >> 8;
+            reply[1] = peer->config & 0xFF;
+            break;
+        default:
+            return;
+    }
+
+    if (16 == cmd || 78 == cmd) {
+        reply[0] = peer->position >> 24;
+        reply[1] = peer->position >> 16;
+        reply[2] = peer->position >> 8;
+        reply[3] = peer->position;
+    }
+
+    for (uint8_t i = 0; i < length; i++) {
+        crc = crcUpdate(crc, reply[i]);
+    }
+    reply[length] = crc >> 8;
+    reply[length + 1] = crc & 0xFF;
+
+    roboClawSend(peer, reply, length + 2);
+}
+
+
+static void roboClawWrite(RoboClawPeer *peer, uint8_t cmd, const uint8_t *payload) {
+    static const uint8_t ack = 0xFF;
+
+    switch (cmd) {
+        case SETM1ENCCOUNT:
+            peer->position = get32(payload);
+            break;
+        case M1SPEEDACCELDECCELPOS:
+            peer->position = get32(payload + 12);
+            break;
+        case SETCONFIG:
+            peer->config = ((uint16_t)payload[0] << 8) | payload[1];
+            break;
+        default:
+            break;
+    }
+
+    roboClawSend(peer, &ack, 1);
+}
+
+
+static void roboClawReceive(avr_irq_t *irq, uint32_t value, void *param) {
+    RoboClawPeer *peer = (RoboClawPeer *)param;
+
+    if (peer->received >= sizeof(peer->packet)) {
+        peer->received = 0;
+    }
+    peer->packet[peer->received++] = value;
+
+    if (peer->received < 2) {
+        return;
+    }
+    if (MOTOR_ADDRESS != peer->packet[0]) {
+        peer->received = 0;
+        return;
+    }
+
+    int length = writeLength(peer->packet[1]);
+    if (length < 0) {
+        peer->received = 0;
+        roboClawRead(peer, peer->packet[1]);
+        return;
+    }
+    if (peer->received < length + 4) {
+        return;
+    }
+
+    peer->received = 0;
+
+    uint16_t crc = 0;
+    for (int i = 0; i < length + 2; i++) {
+        crc = crcUpdate(crc, peer->packet[i]);
+    }
+    if (crc != (((uint16_t)peer->packet[length + 2] << 8) | peer->packet[length + 3])) {
+        return;
+    }
+
+    roboClawWrite(peer, peer->packet[1], &peer->packet[2]);
+}
+
+
+static void attachRoboClaw(avr_t *avr, RoboClawPeer *peer) {
+    uint32_t flags = 0;
+
+    memset(peer, 0, sizeof(*peer));
+    peer->input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('2'), UART_IRQ_INPUT);
+
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('2'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('2'), &flags);
+
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('2'), UART_IRQ_OUTPUT),
+                            roboClawReceive, peer);
+}
+
+
+//Pressure sensor on TWI-------------------------------------------------------------------------------------------------
+
+struct PressureSensorPeer {
+    avr_irq_t *input;
+    const RoboClawPeer *motor;
+    uint8_t selected; // Address byte the master sent, 0 when not selected.
+    uint8_t index;    // Next byte of the reading.
+    uint8_t reading[2];
+};
+
+
+static void pressureSensorMessage(avr_irq_t *irq, uint32_t value, void *param) {
+    PressureSensorPeer *peer = (PressureSensorPeer *)param;
+    avr_twi_msg_irq_t message;
+    message.u.v = value;
+
+    if (message.u.twi.msg & TWI_COND_STOP) {
+        peer->selected = 0;
+    }
+
+    if (message.u.twi.msg & TWI_COND_START) {
+        peer->selected = 0;
+        if ((message.u.twi.addr >> 1) == PRESSURE_SENSOR_ADDRESS) {
+            peer->selected = message.u.twi.addr;
+            peer->index = 0;
+
+            double pressure = PEEP + FULL_STROKE_PRESSURE * peer->motor->position / QP_AT_FULL_STROKE;
+            double counts = (pressure / PSI_TO_CMH2O - MIN_SENSOR_PRESSURE) * (MAX_DIGITAL_OUTPUT - MIN_DIGITAL_OUTPUT)
+                            / (MAX_SENSOR_PRESSURE - MIN_SENSOR_PRESSURE) + MIN_DIGITAL_OUTPUT;
+            uint16_t raw = (uint16_t)lround(std::min(std::max(counts, 0.0), 16383.0));
+            peer->reading[0] = raw >> 8;
+            peer->reading[1] = raw & 0xFF;
+
+            avr_raise_irq(peer->input, avr_twi_irq_msg(TWI_COND_ACK, peer->selected, 1));
+        }
+    }
+
+    if (!peer->selected) {
+        return;
+    }
+
+    if (message.u.twi.msg & TWI_COND_WRITE) {
+        avr_raise_irq(peer->input, avr_twi_irq_msg(TWI_COND_ACK, peer->selected, 1));
+    }
+
+    if (message.u.twi.msg & TWI_COND_READ) {
+        uint8_t data = (peer->index < sizeof(peer->reading)) ? peer->reading[peer->index] : 0;
+        peer->index++;
+        avr_raise_irq(peer->input, avr_twi_irq_msg(TWI_COND_READ, peer->selected, data));
+    }
+}
+
+
+static void attachPressureSensor(avr_t *avr, PressureSensorPeer *peer, const RoboClawPeer *motor) {
+    memset(peer, 0, sizeof(*peer));
+    peer->motor = motor;
+    peer->input = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT);
+
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT),
+                            pressureSensorMessage, peer);
+}
+
+
+//Inputs and other serial ports------------------------------------------------------------------------------------------
+
+struct PullUp {
+    char port;
+    uint8_t bit;
+};
+
+// Mega pins of the switches and buttons in PinAssignments.h, all active low.
+static const PullUp PULL_UPS[] = {
+    {'D', 3}, // 18 ALARM_SWITCH_PIN
+    {'D', 7}, // 38 MODE_SWITCH_PIN
+    {'B', 4}, // 10 LIMIT_SWITCH_PIN
+    {'G', 5}, //  4 TIDAL_VOLUME_SELECT_PIN
+    {'E', 3}, //  5 INSPIRATION_TIME_SELECT_PIN
+    {'H', 3}, //  6 BPM_SELECT_PIN
+    {'H', 4}, //  7 THRESHOLD_PRESSURE_SELECT_PIN
+    {'H', 5}, //  8 PLATEAU_PAUSE_TIME_SELECT_PIN
+    {'A', 2}, // 24 HIGH_PIP_ALARM_SELECT_PIN
+    {'A', 0}, // 22 LOW_PIP_ALARM_SELECT_PIN
+    {'A', 6}, // 28 HIGH_PEEP_ALARM_SELECT_PIN
+    {'A', 4}, // 26 LOW_PEEP_ALARM_SELECT_PIN
+    {'C', 7}, // 30 LOW_PLATEAU_PRESSURE_ALARM_SELECT_PIN
+    {'E', 4}, //  2 PARAMETER_ENCODER_PIN_2
+    {'E', 5}, //  3 PARAMETER_ENCODER_PIN_1
+    {'D', 2}, // 19 PARAMETER_ENCODER_PUSH_BUTTON_PIN
+};
+
+
+static void releaseInputs(avr_t *avr) {
+    for (size_t i = 0; i < sizeof(PULL_UPS) / sizeof(PULL_UPS[0]); i++) {
+        avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(PULL_UPS[i].port), PULL_UPS[i].bit), 1);
+    }
+}
+
+
+static void silenceSerial(avr_t *avr, char uart) {
+    uint32_t flags = 0;
+
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS(uart), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS(uart), &flags);
+}
+
+
+//Timing-----------------------------------------------------------------------------------------------------------------
+
+static uint16_t stackPointer(const avr_t *avr) {
+    return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+
+static void record(Timed &timed, avr_cycle_count_t cycles) {
+    if (!timed.calls || cycles < timed.min) {
+        timed.min = cycles;
+    }
+    if (cycles > timed.max) {
+        timed.max = cycles;
+    }
+    timed.calls++;
+    timed.total += cycles;
+
+    if (timed.keep_samples) {
+        timed.samples.push_back(cycles);
+    }
+}
+
+
+static void run(avr_t *avr, std::vector<Timed> &timed, avr_cycle_count_t cycles) {
+    // Index into timed by word address, -1 for none.
+    std::vector<int16_t> entries((avr->flashend + 1) / 2, -1);
+    for (size_t i = 0; i < timed.size(); i++) {
+        if (timed[i].address && timed[i].address / 2 < entries.size()) {
+            entries[timed[i].address / 2] = i;
+        }
+    }
+
+    std::vector<Frame> frames;
+    avr_cycle_count_t end = avr->cycle + cycles;
+
+    while (avr->cycle < end) {
+        int16_t entry = (avr->pc / 2 < entries.size()) ? entries[avr->pc / 2] : -1;
+
+        if (entry >= 0) {
+            uint16_t sp = stackPointer(avr);
+
+            // A function without a prologue can branch back to its first instruction.
+            if (frames.empty() || frames.back().timed != (size_t)entry || frames.back().sp != sp) {
+                Frame frame = {(size_t)entry, sp, avr->cycle};
+                frames.push_back(frame);
+            }
+        }
+
+        int state = avr_run(avr);
+        if (cpu_Done == state || cpu_Crashed == state) {
+            fprintf(stderr, "firmware stopped after %llu cycles\n", (unsigned long long)avr->cycle);
+            break;
+        }
+
+        // Only the return from the call pops above the frame it was called with,
+        // interrupts taken inside it come back down to it.
+        uint16_t sp = stackPointer(avr);
+        while (!frames.empty() && sp > frames.back().sp) {
+            record(timed[frames.back().timed], avr->cycle - frames.back().start);
+            frames.pop_back();
+        }
+    }
+}
+
+
+//Output-----------------------------------------------------------------------------------------------------------------
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(fraction * sorted.size());
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+
+static void writeResults(FILE *out, const char *commit, unsigned long seconds, avr_cycle_count_t cycles,
+                         std::vector<Timed> &timed) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"commit\": \"%s\",\n", commit);
+    fprintf(out, "  \"mcu\": \"atmega2560\",\n");
+    fprintf(out, "  \"f_cpu\": %lu,\n", F_CPU_HZ);
+    fprintf(out, "  \"seconds\": %lu,\n", seconds);
+    fprintf(out, "  \"cycles\": %llu,\n", (unsigned long long)cycles);
+    fprintf(out, "  \"functions\": {\n");
+
+    bool first = true;
+    for (size_t i = 0; i < timed.size(); i++) {
+        const Timed &t = timed[i];
+        if (t.keep_samples) {
+            continue;
+        }
+
+        fprintf(out, "%s    \"%s\": {\"found\": %s, \"calls\": %lu, \"min\": %llu, \"mean\": %.1f, \"max\": %llu, \"total\": %llu}",
+                first ? "" : ",\n", t.name.c_str(), t.address ? "true" : "false", t.calls,
+                (unsigned long long)t.min, t.calls ? (double)t.total / t.calls : 0.0,
+                (unsigned long long)t.max, (unsigned long long)t.total);
+        first = false;
+    }
+    fprintf(out, "\n  },\n");
+
+    for (size_t i = 0; i < timed.size(); i++) {
+        Timed &t = timed[i];
+        if (!t.keep_samples) {
+            continue;
+        }
+
+        std::sort(t.samples.begin(), t.samples.end());
+        fprintf(out, "  \"loop\": {\"found\": %s, \"iterations\": %lu, \"min\": %llu, \"mean\": %.1f, "
+                "\"p50\": %u, \"p90\": %u, \"p99\": %u, \"p99_9\": %u, \"max\": %llu}\n",
+                t.address ? "true" : "false", t.calls, (unsigned long long)t.min,
+                t.calls ? (double)t.total / t.calls : 0.0,
+                percentile(t.samples, 0.50), percentile(t.samples, 0.90), percentile(t.samples, 0.99),
+                percentile(t.samples, 0.999), (unsigned long long)t.max);
+    }
+
+    fprintf(out, "}\n");
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s FIRMWARE.elf SYMBOLS.txt [--seconds N] [--commit ID] [--out FILE]\n", name);
+    exit(2);
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *firmware_path = NULL;
+    const char *symbols_path = NULL;
+    const char *out_path = NULL;
+    const char *commit = "";
+    unsigned long seconds = DEFAULT_SECONDS;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--commit") && i + 1 < argc) {
+            commit = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out_path = argv[++i];
+        }
+        else if (!firmware_path) {
+            firmware_path = argv[i];
+        }
+        else if (!symbols_path) {
+            symbols_path = argv[i];
+        }
+        else {
+            usage(argv[0]);
+        }
+    }
+    if (!firmware_path || !symbols_path) {
+        usage(argv[0]);
+    }
+
+    std::vector<Timed> timed(NUM_FUNCTIONS + 1);
+    for (size_t i = 0; i < NUM_FUNCTIONS; i++) {
+        timed[i].name = FUNCTIONS[i];
+    }
+    timed[NUM_FUNCTIONS].name = LOOP_FUNCTION;
+    timed[NUM_FUNCTIONS].keep_samples = true;
+
+    if (!loadSymbols(symbols_path, timed)) {
+        return 1;
+    }
+    for (size_t i = 0; i < timed.size(); i++) {
+        if (!timed[i].address) {
+            fprintf(stderr, "%s not found, inlined?\n", timed[i].name.c_str());
+        }
+    }
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(firmware_path, &firmware)) {
+        fprintf(stderr, "%s: could not read firmware\n", firmware_path);
+        return 1;
+    }
+
+    avr_t *avr = avr_make_mcu_by_name("atmega2560");
+    if (!avr) {
+        fprintf(stderr, "simavr has no atmega2560\n");
+        return 1;
+    }
+    avr_init(avr);
+    avr->frequency = F_CPU_HZ;
+    avr_load_firmware(avr, &firmware);
+
+    RoboClawPeer roboclaw;
+    PressureSensorPeer sensor;
+    attachRoboClaw(avr, &roboclaw);
+    attachPressureSensor(avr, &sensor, &roboclaw);
+    silenceSerial(avr, '0');
+    releaseInputs(avr);
+
+    avr_cycle_count_t start = avr->cycle;
+    run(avr, timed, (avr_cycle_count_t)seconds * F_CPU_HZ);
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    writeResults(out, commit, seconds, avr->cycle - start, timed);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,267 @@
+/* RoboClaw framing on the host: RoboClawCodec against the varargs write_n
+   and the bit at a time CRC16 it replaced.
+
+   Every frame the ventilator sends goes through one of three framers:
+   - varargs: write_n as it was, every byte a variadic argument, the CRC
+     updated a bit at a time, and one write() per byte.
+   - varargs, table CRC: the same, with the CRC from the table.
+   - codec: RoboClawCodec into a buffer, then a single write().
+
+   The sink is a Print, so every write() is a virtual call as it is into
+   HardwareSerial. The CRC16 on its own is timed over the same bytes, a bit
+   and a byte at a time. All three framers must produce the same bytes, or
+   the run fails.
+
+   Host cycles come from the time stamp counter where there is one, and
+   are only good for comparing the framers with each other, not for what
+   the Mega takes; make bench counts AVR cycles. Most of the gain on the
+   host is the table CRC. An out of order core overlaps the per byte calls
+   of write_n with the CRC, so with the table CRC it can match or beat the
+   codec here, which the Mega, one instruction at a time and with a
+   HardwareSerial::write that disables interrupts for every byte, does not.
+
+   Usage:
+       bench_codec [--frames N]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "Arduino.h"
+#include "RoboClaw.h"
+#include "RoboClawCodec.h"
+
+#define SetDWORDval(arg) (uint8_t)(((uint32_t)arg)>>24),(uint8_t)(((uint32_t)arg)>>16),(uint8_t)(((uint32_t)arg)>>8),(uint8_t)arg
+
+const unsigned long DEFAULT_FRAMES = 2000000;
+const uint8_t ADDRESS = 0x80;
+
+
+/* Keeps the last frame, and a running sum so that nothing is optimised away.
+ */
+class FrameSink : public Print {
+public:
+    FrameSink() : length(0), sum(0) {}
+
+    virtual size_t write(uint8_t data) {
+        frame[length++ % sizeof(frame)] = data;
+        sum += data;
+        return 1;
+    }
+
+    virtual size_t write(const uint8_t *data, size_t size) {
+        memcpy(frame, data, size);
+        length = size;
+        for (size_t i = 0; i < size; i++) {
+            sum += data[i];
+        }
+        return size;
+    }
+
+    void start() {
+        length = 0;
+    }
+
+    uint8_t frame[64];
+    size_t length;
+    uint32_t sum;
+};
+
+
+// RoboClaw::crc_update before the table.
+static uint16_t crc_update_bitwise(uint16_t crc, uint8_t data) {
+    crc = crc ^ ((uint16_t)data << 8);
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 0x8000)
+            crc = (crc << 1) ^ 0x1021;
+        else
+            crc <<= 1;
+    }
+    return crc;
+}
+
+
+typedef uint16_t (*CrcUpdate)(uint16_t crc, uint8_t data);
+
+// RoboClaw::write_n before the codec, without the wait for the acknowledgement.
+static void __attribute__((noinline)) write_n(Print &out, CrcUpdate update, uint8_t cnt, ...) {
+    uint16_t crc = 0;
+    va_list marker;
+    va_start(marker, cnt);
+    for (uint8_t index = 0; index < cnt; index++) {
+        uint8_t data = va_arg(marker, int);
+        crc = update(crc, data);
+        out.write(data);
+    }
+    va_end(marker);
+    out.write(crc >> 8);
+    out.write(crc);
+}
+
+
+static void varargsBitwise(FrameSink &out, uint32_t i) {
+    write_n(out, crc_update_bitwise, 19, ADDRESS, RoboClaw::M1SPEEDACCELDECCELPOS,
+            SetDWORDval(i), SetDWORDval(i + 1), SetDWORDval(i + 2), SetDWORDval(i + 3), 1);
+}
+
+
+static void varargsTable(FrameSink &out, uint32_t i) {
+    write_n(out, roboclaw_crc_update, 19, ADDRESS, RoboClaw::M1SPEEDACCELDECCELPOS,
+            SetDWORDval(i), SetDWORDval(i + 1), SetDWORDval(i + 2), SetDWORDval(i + 3), 1);
+}
+
+
+static void codec(FrameSink &out, uint32_t i) {
+    uint8_t frame[ROBOCLAW_MAX_FRAME];
+    uint8_t length = RoboClawCodec::SpeedAccelDeccelPositionM1(frame, ADDRESS, i, i + 1, i + 2, i + 3, 1);
+    out.write(frame, length);
+}
+
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+
+static uint64_t cycles() {
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+struct Result {
+    double ns_per_frame;
+    double cycles_per_frame;
+    double bytes_per_second;
+};
+
+
+typedef void (*Framer)(FrameSink &out, uint32_t i);
+
+static Result time_framer(Framer framer, unsigned long frames, FrameSink &out) {
+    double start = now();
+    uint64_t start_cycles = cycles();
+
+    for (unsigned long i = 0; i < frames; i++) {
+        out.start();
+        framer(out, i);
+    }
+
+    uint64_t elapsed_cycles = cycles() - start_cycles;
+    double elapsed = now() - start;
+
+    Result result;
+    result.ns_per_frame = elapsed * 1e9 / frames;
+    result.cycles_per_frame = (double)elapsed_cycles / frames;
+    result.bytes_per_second = out.length * (double)frames / elapsed;
+    return result;
+}
+
+
+typedef uint16_t (*Crc)(const uint8_t *data, uint8_t length);
+
+static uint16_t __attribute__((noinline)) crc_bitwise(const uint8_t *data, uint8_t length) {
+    uint16_t crc = 0;
+    while (length--) {
+        crc = crc_update_bitwise(crc, *data++);
+    }
+    return crc;
+}
+
+static uint16_t __attribute__((noinline)) crc_table(const uint8_t *data, uint8_t length) {
+    return RoboClawCodec::crc(data, length);
+}
+
+
+static Result time_crc(Crc crc, unsigned long frames, const uint8_t *frame, uint8_t length, uint32_t &sum) {
+    uint8_t data[ROBOCLAW_MAX_FRAME];
+    memcpy(data, frame, length);
+
+    double start = now();
+    uint64_t start_cycles = cycles();
+
+    for (unsigned long i = 0; i < frames; i++) {
+        data[2] = i;
+        sum += crc(data, length);
+    }
+
+    uint64_t elapsed_cycles = cycles() - start_cycles;
+    double elapsed = now() - start;
+
+    Result result;
+    result.ns_per_frame = elapsed * 1e9 / frames;
+    result.cycles_per_frame = (double)elapsed_cycles / frames;
+    result.bytes_per_second = length * (double)frames / elapsed;
+    return result;
+}
+
+
+static void print(const char *name, const Result &result, const Result &baseline) {
+    printf("%-28s %8.1f ns %8.1f cycles %8.1f MB/s  %5.1fx\n", name, result.ns_per_frame,
+           result.cycles_per_frame, result.bytes_per_second / 1e6, baseline.ns_per_frame / result.ns_per_frame);
+}
+
+
+int main(int argc, char **argv) {
+    unsigned long frames = DEFAULT_FRAMES;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = strtoul(argv[++i], NULL, 10);
+        }
+        else {
+            fprintf(stderr, "usage: %s [--frames N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // Same bytes out of all three.
+    FrameSink reference, check;
+    codec(reference, 12345);
+    Framer framers[] = {varargsBitwise, varargsTable};
+    for (uint8_t i = 0; i < sizeof(framers) / sizeof(framers[0]); i++) {
+        check.start();
+        framers[i](check, 12345);
+        if (check.length != reference.length || memcmp(check.frame, reference.frame, reference.length)) {
+            fprintf(stderr, "framer %u does not match the codec\n", i);
+            return 1;
+        }
+    }
+
+    printf("SpeedAccelDeccelPositionM1, %u byte frames, %lu frames each%s\n", (unsigned)reference.length, frames,
+           HAVE_TSC ? "" : " (no cycle counter)");
+
+    FrameSink out;
+    Result bitwise = time_framer(varargsBitwise, frames, out);
+    Result table = time_framer(varargsTable, frames, out);
+    Result encoded = time_framer(codec, frames, out);
+
+    print("varargs write_n, bitwise CRC", bitwise, bitwise);
+    print("varargs write_n, table CRC", table, bitwise);
+    print("codec", encoded, bitwise);
+
+    uint32_t sum = out.sum;
+    Result crc_bits = time_crc(crc_bitwise, frames, reference.frame, reference.length - 2, sum);
+    Result crc_bytes = time_crc(crc_table, frames, reference.frame, reference.length - 2, sum);
+
+    print("CRC16 bitwise", crc_bits, crc_bits);
+    print("CRC16 table", crc_bytes, crc_bits);
+
+    // Keeps the sums live.
+    return sum == 0x5A5A5A5A ? 3 : 0;
+}
@@ -8,22 +8,26 @@
 
 #include "elapsedMillis.h"
 #include "MachineStates.h"
-#define SERIAL_DEBUG
+#include "MotorLink.h"
 
 // ----------------------------------------------------------------------
 // Functions for handling the AC state machine.
 //
-// Each state is given its own function to hopefully make testing easier.
+// The states are a table run by BreathEngine. AC breathes like VC, except
+// that the patient can start the next breath early from the exhale, once
+// the trigger refractory window is over, and ACInhaleWait waits for the
+// patient to start each breath.
 // ----------------------------------------------------------------------
 
 
-/* Step the AC state machine.
+/* Step the AC state machine and issue the motor command of the state it
+   ends in.
 
    Output:
-   - returns new state.
+   - updates state in place.
  */
 
-VentilatorState ac_mode_step(VentilatorState state);
+void ac_mode_step(MotorLink &controller_name, VentilatorState &state);
 
 /* Get a debug code for the current acModeState.
 
@@ -37,32 +41,28 @@ int acCodeAssignment(acModeStates acState);
 
 
 // ----------------------------------------------------------------------
-// Functions for handling particular states. These should NOT be called
-// in the main loop, but should be documented and available for testing.
+// How a breath is triggered. These should NOT be called in the main loop,
+// but are available for testing.
 // ----------------------------------------------------------------------
 
+/* Longest time to wait for the patient before starting a breath anyway.
+ */
+unsigned long acTriggerWait(const VentilatorState &state);
 
-// TODO: THESE MUST BE DOCUMENTED!
-
-VentilatorState acStart(VentilatorState state);
-
-VentilatorState acInhaleWait(VentilatorState state);
-
-
-
-VentilatorState acInhaleCommand(VentilatorState state);
-
-VentilatorState acInhale(VentilatorState state);
-
-// Unused parameter warning for expirationTime due to SERIAL_DEBUG
-// TODO: should this be inspiration time?
-VentilatorState acInhaleAbort(VentilatorState state);
-
-VentilatorState acPeak(VentilatorState state);
+/* True once the pressure sampler has latched a trigger, pressure falling
+   ac_threshold_pressure below the baseline, the patient trying to breathe
+   in. See PatientTrigger.h.
+ */
+bool acTrigger(const VentilatorState &state);
 
-VentilatorState acExhaleCommand(VentilatorState state);
+/* Arm the patient trigger for the exhale.
+ */
+void acExhaleCommand(VentilatorState &state);
 
-VentilatorState acExhale(VentilatorState state);
+/* Take the trigger and move the start of the breath to when it was
+   triggered: now if the patient triggered it, the end of the wait if it
+   timed out.
+ */
+void acTriggered(VentilatorState &state);
 
-VentilatorState acReset(VentilatorState state);
 #endif
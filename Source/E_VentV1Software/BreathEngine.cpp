@@ -0,0 +1,95 @@
+#include "BreathEngine.h"
+
+#include "Motor.h"
+#include "SafetyLane.h"
+
+// No globals here. Want these components to be testable in isolation.
+
+void breathStart(VentilatorState &state) {
+    //TODO: Reset alarms as outlined on state machine
+
+    // Carry on from the end of the last breath rather than from whenever
+    // this step ran, so that being late does not add up breath to breath.
+    unsigned long last_end = state.breath_time_start + state.schedule.breath_end;
+    if (state.current_time - last_end <= BREATH_RESYNC_MS) {
+        state.breath_time_start = last_end;
+    }
+    else {
+        reset_timer(state);
+    }
+
+    state.schedule.breath_end = breath_period(state.settings);
+}
+
+
+void breathInhaleMove(MotorLink &controller, VentilatorState &state) {
+    commandInhale(controller, state);
+
+    // Until the inhale is over, a high pressure stops the motor from the
+    // sampling interrupt. Armed once the move is queued, so that a stop
+    // drops it rather than going out ahead of it.
+    arm_pressure_stop();
+}
+
+
+void breathInhaleCommand(VentilatorState &state) {
+    const VentilatorSettings &settings = state.settings;
+    BreathSchedule &schedule = state.schedule;
+
+    // The motor was told to go on the step before, give it the whole
+    // inspiration time from there.
+    schedule.inhale_end = elapsed_time(state) + settings.inspiration_time + INERTIA_BUFFER_MS;
+    schedule.plateau_end = schedule.inhale_end + settings.plateau_pause_time;
+
+    // Settings that do not fit in the period still get to stop the motor.
+    if (schedule.breath_end < schedule.plateau_end + INERTIA_BUFFER_MS) {
+        schedule.breath_end = schedule.plateau_end + INERTIA_BUFFER_MS;
+    }
+}
+
+
+void breathInhale(VentilatorState &state) {
+    // Basically anytime the motor is moving we want to know if the pressue is too high
+    state.errors |= check_high_pressure(state.pressure);
+
+    // The safety lane may have seen it first, and stopped the motor.
+    if (pressure_stopped()) {
+        state.errors |= HIGH_PRESSURE_ALARM;
+    }
+}
+
+
+void breathInhaleDone(VentilatorState &state) {
+    disarm_pressure_stop();
+}
+
+
+void breathInhaleAbort(VentilatorState &state) {
+    disarm_pressure_stop();
+    state.errors |= check_high_pressure(state.pressure);
+}
+
+
+void breathPeak(VentilatorState &state) {
+    state.errors |= check_high_pressure(state.pressure);
+}
+
+
+void breathReset(VentilatorState &state) {
+    state.machine_state = BreathLoopStart;
+}
+
+
+unsigned long inspirationWait(const VentilatorState &state) {
+    return state.schedule.inhale_end;
+}
+
+
+unsigned long plateauWait(const VentilatorState &state) {
+    return state.schedule.plateau_end;
+}
+
+
+unsigned long expirationWait(const VentilatorState &state) {
+    return state.schedule.breath_end;
+}
@@ -0,0 +1,202 @@
+/* Table driven state machines for breathing and motor zeroing.
+
+   AC and VC breathe the same way and only differ in how a breath starts, so
+   rather than a switch per mode, and another per mode to pick the motor
+   command, each mode is a table with one StateEntry per state. An entry
+   says, for a state:
+
+   - event:    logged on every step, with the time in the state and, for a
+               state that waits, how long it waits for.
+   - action:   run on every step in the state.
+   - wait:     when to leave, in ms since the timer was last reset. No
+               wait leaves after one step.
+   - trigger:  leave before the wait is up when true.
+   - leave:    run when leaving for next.
+   - on_alarm: where to go instead while a high pressure alarm is raised.
+               The state itself for no change.
+   - motor:    the motor command, issued on every step that ends in the
+               state, including the one that enters it, unless the step
+               left the machine state.
+
+   step_states runs one step of a table and then issues the motor command
+   of the state it ends in, so a step looks up the table twice at most and
+   never switches on the state.
+
+   Tables are constexpr and kept in flash. check_states makes sure at
+   compile time that each entry sits at the index of its state.
+
+   The breath tables never reset the timer inside a breath. breathStart
+   sets breath_time_start once, to where the last breath was due to end,
+   and the end of the breath from it. breathInhaleCommand sets the end of
+   the inhale and the pause from when the motor was told to go, so the
+   motor always gets its full inspiration time. Whatever the steps between
+   breaths cost comes out of the exhale, and the breath period stays
+   60000 / BPM to within a step instead of growing by a step for every
+   phase. The waits are compared against elapsed_time, which handles
+   millis() wrapping.
+
+   The actions, waits and triggers shared by the breath tables are declared
+   here so that they can be tested on their own against a local
+   VentilatorState.
+ */
+
+#ifndef BreathEngine_h
+#define BreathEngine_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <avr/pgmspace.h>
+
+#include "MachineStates.h"
+#include "MotorLink.h"
+#include "alarms.h"
+#include "Log.h"
+
+typedef void (*StateAction)(VentilatorState &state);
+typedef unsigned long (*StateWait)(const VentilatorState &state);
+typedef bool (*StateTrigger)(const VentilatorState &state);
+typedef void (*StateMotor)(MotorLink &controller, VentilatorState &state);
+
+const unsigned long WAIT_FOREVER = 0xFFFFFFFF; // ms; only a trigger leaves
+
+// A breath that starts later than this after the last one was due to end,
+// after zeroing or the first time round, starts a new schedule from now.
+const unsigned long BREATH_RESYNC_MS = 100;
+
+
+template <typename S>
+struct StateEntry {
+    S state;
+    LogEvent event;
+    StateAction action;
+    StateWait wait;
+    StateTrigger trigger;
+    StateAction leave;
+    S next;
+    S on_alarm;
+    StateMotor motor;
+};
+
+
+/* True if every entry of table sits at the index of its state. For
+   static_assert.
+ */
+template <typename S, uint8_t N>
+constexpr bool check_states(const StateEntry<S> (&table)[N], const uint8_t i = 0) {
+    return (i >= N) || ((uint8_t)table[i].state == i && check_states(table, i + 1));
+}
+
+
+/* Step the state machine in table, whose state is current, and issue the
+   motor command of the state it ends up in. table must be in PROGMEM.
+   invalid is logged if current is not in the table.
+ */
+template <typename S, uint8_t N>
+void step_states(const StateEntry<S> (&table)[N], const LogEvent invalid, S &current,
+                 MotorLink &controller, VentilatorState &state) {
+    StateEntry<S> entry;
+
+    if ((uint8_t)current >= N) {
+        // Should not happen
+        LOG1(invalid, current);
+        return;
+    }
+
+    memcpy_P(&entry, &table[current], sizeof(entry));
+
+    machineStates machine_state = state.machine_state;
+    unsigned long elapsed = elapsed_time(state);
+    unsigned long wait = entry.wait ? entry.wait(state) : 0;
+
+    if (entry.wait) {
+        LOG2(entry.event, elapsed, wait);
+    }
+    else {
+        LOG1(entry.event, elapsed);
+    }
+
+    if (entry.action) {
+        entry.action(state);
+    }
+
+    if (!entry.wait || elapsed >= wait || (entry.trigger && entry.trigger(state))) {
+        if (entry.leave) {
+            entry.leave(state);
+        }
+        current = entry.next;
+    }
+
+    if (entry.on_alarm != entry.state && (state.errors & HIGH_PRESSURE_ALARM)) {
+        current = entry.on_alarm;
+    }
+
+    // Done with this machine state, whatever state the table is left in
+    // is where the next run starts from.
+    if (state.machine_state != machine_state) {
+        return;
+    }
+
+    if (current != entry.state) {
+        memcpy_P(&entry, &table[current], sizeof(entry));
+    }
+
+    if (entry.motor) {
+        entry.motor(controller, state);
+    }
+}
+
+
+// ----------------------------------------------------------------------
+// Shared by the AC and VC tables.
+// ----------------------------------------------------------------------
+
+/* Start a new breath where the last one was due to end, or now if that
+   was more than BREATH_RESYNC_MS ago, and set when it ends.
+ */
+void breathStart(VentilatorState &state);
+
+/* Queue the inhale move and arm the safety lane pressure stop, which is
+   disarmed again as the inhale ends. Not armed before, so a pressure seen
+   while waiting for a trigger or at the end of a cut short exhale does not
+   stop a motor that is not inhaling.
+ */
+void breathInhaleMove(MotorLink &controller, VentilatorState &state);
+
+/* Set when the inhale and the pause end, from now.
+ */
+void breathInhaleCommand(VentilatorState &state);
+
+/* Check for high pressure, here or by the safety lane.
+ */
+void breathInhale(VentilatorState &state);
+
+/* Disarm the pressure stop.
+ */
+void breathInhaleDone(VentilatorState &state);
+
+/* Disarm the pressure stop, which has most likely stopped the motor
+   already, and check for high pressure. The exhale that follows still ends
+   with the breath.
+ */
+void breathInhaleAbort(VentilatorState &state);
+
+/* Check for high pressure.
+ */
+void breathPeak(VentilatorState &state);
+
+/* Go back to BreathLoopStart. PIP, plateau and PEEP are measured, and
+   PEEP checked, from the samples of the whole breath, see BreathMetrics.h.
+ */
+void breathReset(VentilatorState &state);
+
+unsigned long inspirationWait(const VentilatorState &state);
+
+unsigned long plateauWait(const VentilatorState &state);
+
+unsigned long expirationWait(const VentilatorState &state);
+
+#endif
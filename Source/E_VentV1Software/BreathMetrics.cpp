@@ -0,0 +1,204 @@
+#include "BreathMetrics.h"
+
+#include "breathing.h"
+#include "pressure.h"
+#include "Log.h"
+
+const uint8_t PLATEAU_SAMPLES = BREATH_METRICS_PLATEAU_MS * PRESSURE_SAMPLE_RATE / 1000;
+const uint8_t PEEP_SAMPLES = BREATH_METRICS_PEEP_MS * PRESSURE_SAMPLE_RATE / 1000;
+const uint8_t TAIL_SAMPLES = (PLATEAU_SAMPLES > PEEP_SAMPLES) ? PLATEAU_SAMPLES : PEEP_SAMPLES;
+static_assert(PLATEAU_SAMPLES > 0 && PEEP_SAMPLES > 0, "metrics windows shorter than a sample");
+
+const uint16_t BAG_VOLUME = BAG_FULL_STROKE_VOLUME + 0.5f; // mL
+
+static BreathMetrics last;
+static uint16_t breaths = 0;
+
+// Breath in progress.
+static BreathPhase phase = PHASE_NONE; // breath_timing_phase() as of the last step
+static uint16_t volume = 0;            // mL, set
+static uint16_t inspiration_time = 0;  // ms, set
+static bool aborted = false;
+static Pressure pip;
+static Pressure plateau;
+static bool has_plateau = false;
+static int32_t breath_sum = 0;         // Pressure raw
+static uint16_t breath_samples = 0;
+
+// The last samples of the plateau, or of the exhale.
+static int16_t tail[TAIL_SAMPLES];
+static uint8_t tail_size = 0;
+static uint8_t tail_next = 0;
+static uint8_t tail_count = 0;
+static int32_t tail_sum = 0;
+
+
+// Rounded to the nearest, either side of 0.
+static Pressure mean(const int32_t sum, const uint16_t count) {
+    if (!count) {
+        return Pressure::from_raw(0);
+    }
+    int32_t half = (sum < 0) ? -(int32_t)(count/2) : count/2;
+    return Pressure::from_raw((sum + half) / (int32_t)count);
+}
+
+
+static uint16_t clamp_u16(const uint32_t value) {
+    return (value > 0xFFFF) ? 0xFFFF : value;
+}
+
+
+static int16_t clamp_i16(const uint32_t value) {
+    return (value > 0x7FFF) ? 0x7FFF : value;
+}
+
+
+static void tail_start(const uint8_t size) {
+    tail_size = size;
+    tail_next = 0;
+    tail_count = 0;
+    tail_sum = 0;
+}
+
+
+static void tail_add(const Pressure pressure) {
+    if (tail_count == tail_size) {
+        tail_sum -= tail[tail_next];
+    }
+    else {
+        tail_count++;
+    }
+
+    tail[tail_next] = pressure.raw;
+    tail_sum += pressure.raw;
+    tail_next = (tail_next + 1 < tail_size) ? tail_next + 1 : 0;
+}
+
+
+// The breath BreathTiming has just recorded.
+static void publish() {
+    const BreathTiming &timing = last_breath_timing();
+    BreathMetrics metrics;
+    uint32_t inspiratory = (timing.inspiratory + 500) / 1000;                 // ms
+    uint32_t expiratory = (timing.period - timing.inspiratory + 500) / 1000; // ms
+    uint32_t period = inspiratory + expiratory;
+
+    metrics.pip = pip;
+    metrics.plateau = has_plateau ? plateau : Pressure::from_raw(0);
+    metrics.peep = mean(tail_sum, tail_count);
+    metrics.mean = mean(breath_sum, breath_samples);
+    metrics.rate = BreathRate::from_raw(period ? clamp_i16(((uint32_t)MS_PER_MINUTE << 8) / period) : 0);
+    metrics.ie = Ratio::from_raw(expiratory ? clamp_i16((inspiratory << 8) / expiratory) : 0);
+    metrics.inspiratory = clamp_u16(inspiratory);
+    metrics.expiratory = clamp_u16(expiratory);
+    metrics.aborted = aborted;
+
+    // Driven from the PEEP the breath started at.
+    Pressure baseline = breaths ? last.peep : metrics.peep;
+    bool plateau_known = !aborted && has_plateau && volume;
+
+    metrics.compliance = 0;
+    if (plateau_known && metrics.plateau > baseline) {
+        metrics.compliance = clamp_u16(((uint32_t)volume*10 << 8) / (metrics.plateau - baseline).raw);
+    }
+
+    metrics.resistance = 0;
+    if (plateau_known && metrics.pip > metrics.plateau) {
+        uint32_t drop = (metrics.pip - metrics.plateau).raw;
+        metrics.resistance = clamp_u16(drop*inspiration_time*10 / ((uint32_t)volume << 8));
+    }
+
+    last = metrics;
+    if (breaths < UINT16_MAX) {
+        breaths++;
+    }
+
+    LOG3(LOG_BREATH_PRESSURES, metrics.pip.to_float(), metrics.plateau.to_float(), metrics.peep.to_float());
+    LOG3(LOG_BREATH_RATIOS, metrics.mean.to_float(), metrics.rate.to_float(), metrics.ie.to_float());
+    LOG2(LOG_BREATH_MECHANICS, metrics.compliance / 10.0f, metrics.resistance / 10.0f);
+}
+
+
+// BreathTiming has already checked the phases come in order.
+static void start_phase(const BreathPhase next, const VentilatorState &state) {
+    switch (next) {
+    case PHASE_INHALE:
+        // A breath is only complete once the next one starts, as BreathTiming records it.
+        if (PHASE_EXHALE == phase || PHASE_END == phase) {
+            publish();
+        }
+
+        volume = (uint32_t)state.settings.tidal_volume.raw*BAG_VOLUME / (100L << 8);
+        inspiration_time = state.settings.inspiration_time;
+        aborted = false;
+        has_plateau = false;
+        pip = Pressure::from_raw(0);
+        breath_sum = 0;
+        breath_samples = 0;
+        break;
+
+    case PHASE_PLATEAU:
+        tail_start(PLATEAU_SAMPLES);
+        break;
+
+    case PHASE_EXHALE:
+        if (PHASE_PLATEAU == phase) {
+            plateau = mean(tail_sum, tail_count);
+            has_plateau = tail_count > 0;
+        }
+        else {
+            aborted = true;
+        }
+        tail_start(PEEP_SAMPLES);
+        break;
+
+    default:
+        // The exhale runs on through the end to the next inhale, for PEEP.
+        break;
+    }
+}
+
+
+void breath_metrics_sample(const FilteredPressure &sample) {
+    switch (phase) {
+    case PHASE_INHALE:
+        pip = (sample.pressure > pip) ? sample.pressure : pip;
+        break;
+
+    case PHASE_PLATEAU:
+        pip = (sample.pressure > pip) ? sample.pressure : pip;
+        tail_add(sample.pressure);
+        break;
+
+    case PHASE_EXHALE:
+    case PHASE_END:
+        tail_add(sample.pressure);
+        break;
+
+    default:
+        return;
+    }
+
+    breath_sum += sample.pressure.raw;
+    breath_samples++;
+}
+
+
+void breath_metrics_step(const BreathPhase started, const VentilatorState &state) {
+    if (PHASE_NONE != started) {
+        start_phase(started, state);
+    }
+
+    // Also picks up a breath BreathTiming has given up on.
+    phase = breath_timing_phase();
+}
+
+
+uint16_t breath_metrics_count() {
+    return breaths;
+}
+
+
+const BreathMetrics &last_breath_metrics() {
+    return last;
+}
@@ -0,0 +1,88 @@
+/* Breath by breath metrics, from every pressure sample.
+
+   PIP used to be the highest of the pressures the state machine happened
+   to see once per step, and plateau and PEEP a single sample each, taken
+   as the exhale was commanded and as the breath ended. Instead every
+   filtered sample goes to breath_metrics_sample, from update_state, and
+   is added to the phase of the breath it was taken in. The phases, and
+   the times they started, are BreathTiming's: breath_metrics_step is
+   handed each phase breath_timing_step starts, see BreathTiming.h. The
+   pressure task runs before the state task, so the samples a step has not
+   seen yet always belong to the phase before it.
+
+   Once the next breath starts, the breath is published as a BreathMetrics
+   record, logged as LOG_BREATH_PRESSURES, LOG_BREATH_RATIOS and
+   LOG_BREATH_MECHANICS:
+
+   - pip:         highest pressure over the inhale and the pause.
+   - plateau:     mean over the last BREATH_METRICS_PLATEAU_MS of the pause.
+   - peep:        mean over the last BREATH_METRICS_PEEP_MS before the
+                  next inhale.
+   - mean:        mean airway pressure over the breath.
+   - rate, ie:    delivered, from the breath's BreathTiming record.
+   - compliance:  static, tidal volume / (plateau - PEEP at the start of
+                  the breath).
+   - resistance:  (pip - plateau) / the mean flow of the stroke, tidal
+                  volume / inspiration time.
+
+   The tidal volume is the one set, as a share of BAG_FULL_STROKE_VOLUME;
+   there is no flow sensor. An aborted inhale has no plateau, so neither
+   compliance nor resistance.
+
+   The alarms check the PEEP of each record, and the LCD shows the last
+   one.
+ */
+
+#ifndef BreathMetrics_h
+#define BreathMetrics_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "MachineStates.h"
+#include "PressureFilter.h"
+#include "BreathTiming.h"
+
+const unsigned long BREATH_METRICS_PLATEAU_MS = 100; // End of the pause averaged for plateau
+const unsigned long BREATH_METRICS_PEEP_MS = 100;    // End of the exhale averaged for PEEP
+
+
+struct BreathMetrics {
+    Pressure pip;
+    Pressure plateau;
+    Pressure peep;
+    Pressure mean;
+    BreathRate rate;      // Delivered, from the breath period
+    Ratio ie;             // Inspiratory over expiratory time
+    uint16_t inspiratory; // ms; inhale and pause
+    uint16_t expiratory;  // ms; exhale to the next inhale
+    uint16_t compliance;  // 0.1 mL/cmH2O, 0 if not known
+    uint16_t resistance;  // 0.1 cmH2O/(L/s), 0 if not known
+    bool aborted;         // Inhale aborted, no plateau, compliance or resistance
+};
+
+
+/* Add a filtered sample to the breath in progress. Call for every sample.
+ */
+void breath_metrics_sample(const FilteredPressure &sample);
+
+
+/* Follow the breath phases. Call after every breath_timing_step, with the
+   phase it started.
+ */
+void breath_metrics_step(const BreathPhase started, const VentilatorState &state);
+
+
+/* Number of breaths published since the start.
+ */
+uint16_t breath_metrics_count();
+
+
+/* The last breath published. All zero until breath_metrics_count() > 0.
+ */
+const BreathMetrics &last_breath_metrics();
+
+#endif
@@ -0,0 +1,245 @@
+#include "BreathTiming.h"
+
+#include "Motor.h"
+#include "breathing.h"
+#include "Log.h"
+#include "conversions.h"
+
+
+static BreathTiming window[BREATH_TIMING_WINDOW];
+static uint8_t window_next = 0;
+static uint16_t breaths = 0;
+
+// Breath in progress.
+static BreathTiming current;
+static BreathPhase phase = PHASE_NONE;
+static unsigned long inhale_start = 0;
+static unsigned long phase_start = 0;
+static unsigned long phase_target = 0; // us
+
+// State after the last step, to spot changes.
+static machineStates last_machine_state = Startup;
+static acModeStates last_ac_state = ACStart;
+static vcModeStates last_vc_state = VCStart;
+
+
+static unsigned long ms_to_us(const unsigned long ms) {
+    return ms * 1000;
+}
+
+
+BreathPhase breath_phase(const VentilatorState &state) {
+    if (ACMode == state.machine_state) {
+        switch (state.ac_state) {
+        case ACInhale:  return PHASE_INHALE;
+        case ACPeak:    return PHASE_PLATEAU;
+        case ACExhale:  return PHASE_EXHALE;
+        case ACReset:   return PHASE_END;
+        default:        return PHASE_NONE;
+        }
+    }
+
+    if (VCMode == state.machine_state) {
+        switch (state.vc_state) {
+        case VCInhale:  return PHASE_INHALE;
+        case VCPeak:    return PHASE_PLATEAU;
+        case VCExhale:  return PHASE_EXHALE;
+        case VCReset:   return PHASE_END;
+        default:        return PHASE_NONE;
+        }
+    }
+
+    return PHASE_NONE;
+}
+
+
+static int32_t phase_error(const unsigned long now) {
+    return (int32_t)(now - phase_start) - (int32_t)phase_target;
+}
+
+
+static void record_breath(const unsigned long now) {
+    current.period = now - inhale_start;
+
+    window[window_next] = current;
+    window_next = (window_next + 1) % BREATH_TIMING_WINDOW;
+    if (breaths < UINT16_MAX) {
+        breaths++;
+    }
+
+    LOG3(LOG_BREATH_TIMING, current.inhale_error, current.plateau_error, current.exhale_error);
+    LOG2(LOG_BREATH_RATE, current.period, current.inspiratory);
+}
+
+
+// Returns whether the phase was taken, rather than out of order.
+static bool start_phase(const BreathPhase next, const VentilatorState &state, const unsigned long now) {
+    switch (next) {
+    case PHASE_INHALE:
+        // A breath is only complete once the next one starts.
+        if (PHASE_EXHALE == phase) {
+            current.exhale_error = phase_error(now);
+        }
+        if (PHASE_EXHALE == phase || PHASE_END == phase) {
+            record_breath(now);
+        }
+
+        memset(&current, 0, sizeof(current));
+        current.set_bpm = state.settings.breaths_per_minute.to_float();
+        {
+            float period = MS_PER_MINUTE / current.set_bpm;
+            float inspiratory = state.settings.inspiration_time + state.settings.plateau_pause_time;
+            current.set_ie = (period > inspiratory) ? inspiratory / (period - inspiratory) : 0;
+        }
+        inhale_start = now;
+        phase_target = ms_to_us(state.settings.inspiration_time + INERTIA_BUFFER_MS);
+        break;
+
+    case PHASE_PLATEAU:
+        if (PHASE_INHALE != phase) {
+            phase = PHASE_NONE;
+            return false;
+        }
+        current.inhale_error = phase_error(now);
+        phase_target = ms_to_us(state.settings.plateau_pause_time);
+        break;
+
+    case PHASE_EXHALE:
+        if (PHASE_PLATEAU == phase) {
+            current.plateau_error = phase_error(now);
+        }
+        else if (PHASE_INHALE == phase) {
+            current.aborted = true;
+        }
+        else {
+            phase = PHASE_NONE;
+            return false;
+        }
+        current.inspiratory = now - inhale_start;
+        phase_target = ms_to_us(state.schedule.breath_end - state.schedule.plateau_end);
+        break;
+
+    case PHASE_END:
+        if (PHASE_EXHALE != phase) {
+            phase = PHASE_NONE;
+            return false;
+        }
+        current.exhale_error = phase_error(now);
+        break;
+
+    default:
+        return false;
+    }
+
+    phase = next;
+    phase_start = now;
+    return true;
+}
+
+
+BreathPhase breath_timing_step(const VentilatorState &state, const unsigned long now) {
+    bool changed = state.machine_state != last_machine_state
+                   || (ACMode == state.machine_state && state.ac_state != last_ac_state)
+                   || (VCMode == state.machine_state && state.vc_state != last_vc_state);
+
+    // Breaths carry on through BreathLoopStart, anything else ends them.
+    if (state.machine_state != last_machine_state && ACMode != state.machine_state
+        && VCMode != state.machine_state && BreathLoopStart != state.machine_state) {
+        phase = PHASE_NONE;
+    }
+
+    last_machine_state = state.machine_state;
+    last_ac_state = state.ac_state;
+    last_vc_state = state.vc_state;
+
+    if (changed) {
+        BreathPhase next = breath_phase(state);
+
+        if (PHASE_NONE != next && start_phase(next, state, now)) {
+            return next;
+        }
+    }
+
+    return PHASE_NONE;
+}
+
+
+BreathPhase breath_timing_phase() {
+    return phase;
+}
+
+
+uint16_t breath_timing_count() {
+    return breaths;
+}
+
+
+const BreathTiming &last_breath_timing() {
+    return window[(window_next + BREATH_TIMING_WINDOW - 1) % BREATH_TIMING_WINDOW];
+}
+
+
+// Min, mean and max of one column over the window.
+static void print_stat(Print &out, const char *name, float (*value)(const BreathTiming &), bool skip_aborted) {
+    uint8_t count = 0;
+    float min = 0, max = 0, total = 0;
+    uint8_t n = (breaths < BREATH_TIMING_WINDOW) ? breaths : BREATH_TIMING_WINDOW;
+
+    for (uint8_t i = 0; i < n; i++) {
+        if (skip_aborted && window[i].aborted) {
+            continue;
+        }
+
+        float v = value(window[i]);
+        if (0 == count || v < min) {
+            min = v;
+        }
+        if (0 == count || v > max) {
+            max = v;
+        }
+        total += v;
+        count++;
+    }
+
+    out.print(name);
+    out.print(' ');
+    out.print(count);
+    out.print(' ');
+    out.print(min);
+    out.print(' ');
+    out.print(count ? total / count : 0);
+    out.print(' ');
+    out.println(max);
+}
+
+
+static float inhale_error_ms(const BreathTiming &b)  { return b.inhale_error / 1000.0; }
+static float plateau_error_ms(const BreathTiming &b) { return b.plateau_error / 1000.0; }
+static float exhale_error_ms(const BreathTiming &b)  { return b.exhale_error / 1000.0; }
+static float delivered_bpm(const BreathTiming &b)    { return b.period ? SECONDS_PER_MINUTE * 1e6 / b.period : 0; }
+static float set_bpm(const BreathTiming &b)          { return b.set_bpm; }
+static float set_ie(const BreathTiming &b)           { return b.set_ie; }
+static float delivered_ie(const BreathTiming &b) {
+    return (b.period > b.inspiratory) ? (float)b.inspiratory / (b.period - b.inspiratory) : 0;
+}
+
+
+void print_breath_timing(Print &out) {
+    out.print("breaths ");
+    out.println(breaths);
+    out.println("metric n min mean max");
+
+    print_stat(out, "inhale_error_ms", inhale_error_ms, true);
+    print_stat(out, "plateau_error_ms", plateau_error_ms, true);
+    print_stat(out, "exhale_error_ms", exhale_error_ms, false);
+    print_stat(out, "bpm", delivered_bpm, false);
+    print_stat(out, "set_bpm", set_bpm, false);
+    print_stat(out, "ie", delivered_ie, false);
+    print_stat(out, "set_ie", set_ie, false);
+}
+
+
+void reset_breath_timing() {
+    breaths = 0;
+    window_next = 0;
+}
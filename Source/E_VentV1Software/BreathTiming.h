@@ -0,0 +1,105 @@
+/* Delivered breath timing, measured against the settings.
+
+   The AC and VC state machines only look at the clock once per step, so
+   every phase ends up to a step of the state task late, plus however late
+   that step was released. breath_timing_step watches the state after every
+   step and timestamps each phase as it starts:
+
+   - inhale:  ACInhale / VCInhale, target inspiration_time + INERTIA_BUFFER
+   - plateau: ACPeak / VCPeak,     target plateau_pause_time
+   - exhale:  ACExhale / VCExhale, target schedule.breath_end - plateau_end
+   - end:     ACReset / VCReset
+
+   The inhale starts on the step that runs breathInhaleCommand, which sets
+   the inhale deadline, in both modes; the motor was told to go on the
+   step before.
+
+   Each phase error is its delivered length minus its target. The exhale
+   ends at a deadline from the start of the breath rather than a time from
+   its own start, so it takes up whatever the other phases and the steps
+   between breaths ran over. The breath period runs from one inhale to the
+   next, and gives the delivered BPM, and with the inhale and plateau the
+   delivered I:E, both next to what the settings ask for.
+
+   A breath is recorded once the next one starts, after its exhale, whether
+   or not it got as far as the end state, logged as LOG_BREATH_TIMING
+   and LOG_BREATH_RATE, and kept with the last BREATH_TIMING_WINDOW breaths
+   for the rolling statistics print_breath_timing dumps over Serial (command
+   'b'). An aborted inhale has no inhale or plateau error.
+
+   The phases, and when they started, are the ones the breath metrics go
+   by too, see BreathMetrics.h.
+ */
+
+#ifndef BreathTiming_h
+#define BreathTiming_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "MachineStates.h"
+
+const uint8_t BREATH_TIMING_WINDOW = 8; // Breaths
+
+
+enum BreathPhase : uint8_t {
+                            PHASE_NONE,
+                            PHASE_INHALE,
+                            PHASE_PLATEAU,
+                            PHASE_EXHALE,
+                            PHASE_END
+};
+
+
+struct BreathTiming {
+    int32_t inhale_error;    // us; delivered - target
+    int32_t plateau_error;   // us
+    int32_t exhale_error;    // us
+    uint32_t period;         // us; inhale start to the next inhale start
+    uint32_t inspiratory;    // us; inhale and plateau
+    float set_bpm;           // From the settings at the start of the breath.
+    float set_ie;            // Inspiratory over expiratory time the settings ask for.
+    bool aborted;            // Inhale aborted, no inhale or plateau error.
+};
+
+
+/* Phase that starts on entering the state the AC or VC machine is in, as
+   in the list above. PHASE_NONE for any other state.
+ */
+BreathPhase breath_phase(const VentilatorState &state);
+
+
+/* Watch for phase changes. Call after every step of the AC or VC state
+   machine, with the time the step finished. Returns the phase that
+   started, PHASE_NONE if none did or it came out of order.
+ */
+BreathPhase breath_timing_step(const VentilatorState &state, const unsigned long now);
+
+
+/* Phase of the breath in progress, PHASE_NONE outside of one.
+ */
+BreathPhase breath_timing_phase();
+
+
+/* Number of breaths recorded since the last reset.
+ */
+uint16_t breath_timing_count();
+
+
+/* The last breath recorded. Only valid once breath_timing_count() > 0.
+ */
+const BreathTiming &last_breath_timing();
+
+
+/* Print min, mean and max of each phase error, delivered BPM and I:E over
+   the last BREATH_TIMING_WINDOW breaths, next to the set BPM and I:E.
+ */
+void print_breath_timing(Print &out);
+
+
+void reset_breath_timing();
+
+#endif
@@ -1,4 +1,3 @@
-#define SERIAL_DEBUG //Comment this out if not debugging, used for visual confirmation of state changes
 #define NO_INPUT_DEBUG //Comment this out if not debugging, used to spoof input parameters at startup when no controls are present
 #define NO_LIMIT_SWITCH_DEBUG
 
@@ -22,18 +21,30 @@
 #include "MotorZeroing.h"
 #include "PinAssignments.h"
 #include "Motor.h"
-#include "RoboClaw.h"
+#include "MotorLink.h"
+#include "SafetyLane.h"
+#include "Scheduler.h"
+#include "Log.h"
+#include "Telemetry.h"
+#include "Profiler.h"
+#include "BreathTiming.h"
+#include "BreathMetrics.h"
 
 //Begin User Defined Section----------------------------------------------------
 
 //Define LCD displays
-LiquidCrystal alarmDisplay(ALARM_LCD_RS, ALARM_LCD_ENABLE, ALARM_LCD_DB4, ALARM_LCD_DB5, ALARM_LCD_DB6, ALARM_LCD_DB7);
-LiquidCrystal ventilatorDisplay(VENT_LCD_RS, VENT_LCD_ENABLE, VENT_LCD_DB4, VENT_LCD_DB5, VENT_LCD_DB6, VENT_LCD_DB7);
+LiquidCrystal alarmLCD(ALARM_LCD_RS, ALARM_LCD_ENABLE, ALARM_LCD_DB4, ALARM_LCD_DB5, ALARM_LCD_DB6, ALARM_LCD_DB7);
+LiquidCrystal ventilatorLCD(VENT_LCD_RS, VENT_LCD_ENABLE, VENT_LCD_DB4, VENT_LCD_DB5, VENT_LCD_DB6, VENT_LCD_DB7);
+//Both displays share RS and DB4-DB7, the bus sends to them from a timer interrupt
+LCDBus displayBus(VENT_LCD_RS, VENT_LCD_DB4, VENT_LCD_DB5, VENT_LCD_DB6, VENT_LCD_DB7);
+//Screens are drawn here, and only the changes are sent to the displays
+LCDBuffer alarmDisplay(alarmLCD, displayBus, ALARM_LCD_ENABLE);
+LCDBuffer ventilatorDisplay(ventilatorLCD, displayBus, VENT_LCD_ENABLE);
 
 //Define Motor Controller
-RoboClaw motorController(&Serial2, MOTOR_CONTROLLER_TIMEOUT);
+MotorLink motorController(&Serial2, MOTOR_CONTROLLER_TIMEOUT);
 
-//#define SERIAL_DEBUG //Comment this out if not debugging, used for visual confirmation of state changes
+//SERIAL_DEBUG is a build flag, see Log.h
 //#define NO_INPUT_DEBUG //Comment this out if not debugging, used to spoof input parameters at startup when no controls are present
 
 const char softwareVersion[] = "VERSION 0.1";
@@ -72,8 +83,6 @@ UserParameter userParameters[NUM_USER_PARAMETERS] = {UserParameter(MIN_THRESHOLD
 volatile boolean alarmReset = false;
 // TODO: These are never set?
 // TODO: Do these really have to be globals?
-float measuredPIP;
-float measuredPlateau;
 float singleBreathTime;
 
 float inspirationTime;
@@ -97,18 +106,46 @@ vcModeStates vcModeState   = VCStart;
 //------------------------------------------------------------------------------
 
 VentilatorState state;
+StagedSettings stagedSettings; // Applied at the next BreathLoopStart
+bool failureStopped = false;   // The controller has acknowledged the failure mode stop
+
+//Tasks------------------------------------------------------------------------------------------------------------------
+void taskPressure();
+void taskStateMachine();
+void taskMotorLink();
+void taskMotorTelemetry();
+void taskButtons();
+void taskAlarms();
+void taskDisplays();
+void taskSerialCommands();
+void taskLog();
+void taskWaveform();
+
+// Listed in priority order, see Scheduler.h
+Task tasks[] = {{"pressure",  taskPressure,       hz_to_period(200), TASK_CONTROL},
+                {"state",     taskStateMachine,   hz_to_period(200), TASK_CONTROL},
+                {"motor",     taskMotorLink,      hz_to_period(500), TASK_CONTROL},
+                {"buttons",   taskButtons,        hz_to_period(100), TASK_NORMAL},
+                {"alarms",    taskAlarms,         hz_to_period(50),  TASK_NORMAL},
+                {"telemetry", taskMotorTelemetry, hz_to_period(100), TASK_NORMAL},
+                {"lcd",       taskDisplays,       hz_to_period(5),   TASK_BACKGROUND},
+                {"serial",    taskSerialCommands, hz_to_period(10),  TASK_BACKGROUND},
+                {"log",       taskLog,            hz_to_period(100), TASK_BACKGROUND},
+                {"waveform",  taskWaveform,       hz_to_period(100), TASK_BACKGROUND}};
+
+const uint8_t NUM_TASKS = sizeof(tasks) / sizeof(tasks[0]);
 
 
 void setup() {  
 
-#ifdef SERIAL_DEBUG
-    Serial.begin(9600);
-    Serial.println("Initialization starting...");
-#endif //SERIAL_DEBUG
+    //Binary log records and serial commands
+    Serial.begin(SERIAL_BAUD);
+    LOG(LOG_INIT_START);
 
     setupLimitSwitch();
     setUpAlarmSwitch();
     setUpPressureSensor(9600);
+    startPressureSampling();
 
     // Motor serial communications startup
     // MotorSerial.begin(9600); //********
@@ -122,9 +159,11 @@ void setup() {
     //LCD Setup
     alarmDisplay.begin(LCD_COLUMNS, LCD_ROWS); 
     ventilatorDisplay.begin(LCD_COLUMNS, LCD_ROWS);
+    displayBus.begin();
 
     //Motor Controller Start
-    motorController.begin(38400);
+    motorController.negotiateBaud(MOTOR_ADDRESS, MOTOR_CONTROLLER_BAUD, MOTOR_CONTROLLER_FAST_BAUD);
+    safety_lane_begin(motorController, MOTOR_ADDRESS);
 
     //LCD Display Startup Message for two seconds
     displayStartupScreen(ventilatorDisplay, softwareVersion, LCD_COLUMNS);
@@ -132,15 +171,12 @@ void setup() {
 // Set up ventilator state.
     state = get_init_state();
     state.machine_state = StartupHold;
+    setStateParameters(stagedSettings, userParameters);
 
     //LCD Startup hold message
     displayStartupHoldScreen(ventilatorDisplay);
 
-#ifdef SERIAL_DEBUG
-    Serial.begin(9600);
-    Serial.println("StartupHold");
-    Serial.println(state.machine_state);
-#endif //SERIAL_DEBUG
+    LOG1(LOG_STARTUP_HOLD, state.machine_state);
 
 
 #ifndef NO_INPUT_DEBUG
@@ -160,60 +196,165 @@ void setup() {
 #ifdef NO_LIMIT_SWITCH_DEBUG
     state.machine_state = BreathLoopStart;
     motorController.SetEncM1(MOTOR_ADDRESS, 0);
+    motorController.waitIdle(MOTOR_LINK_WAIT_TIMEOUT);
 #endif //Set the startup position as zero
 
-
+    setup_tasks(tasks, NUM_TASKS);
 }
 
 void loop() {
-    //Update LCD*********
-
-
-    //Update the state user input parameters
-    state = updateStateUserParameters(state, currentlySelectedParameter, parameterSet, parameterSelectEncoder,
-                       userParameters, NUM_USER_PARAMETERS);
-
-    //LCD display internal variables and regular screen
-    //displayVentilationScreen(internalTV, internalBPM, internalIERatio, internalThresholdPressure, machineState, peakPressure, plateauPressure, peepPressure);
-    displayUserParameters(currentlySelectedParameter, ventilatorDisplay, state.machine_state, state.vc_state, state.ac_state, measuredPIP, measuredPlateau, LCD_MAX_STRING, userParameters);
+    profile_loop();
+    run_tasks(tasks, NUM_TASKS);
+}
 
-    //TODO: Add in alarm display
-    update_motor_settings(state);
+//TASKS
 
+void taskPressure() {
     // Read in values for state
+    unsigned long start = profile_start();
     update_state(state);
+    profile_end(PROFILE_UPDATE_STATE, start);
+}
 
-    //Beginning of state machine code
+void taskStateMachine() {
+    unsigned long start = profile_start();
 
-    // TODO: factor out into a function and turn into switch statement.
-    if (MotorZeroing == state.machine_state){
-        state = motor_zeroing_step(state);
-    }
-    else if (BreathLoopStart == state.machine_state) { // BreathLoopStart
+    if (BreathLoopStart == state.machine_state) { // BreathLoopStart
+
+        LOG(LOG_BREATH_LOOP_START);
+
+        // Between breaths, the only time settings change.
+        if (apply_staged_settings(stagedSettings, state)) {
+            LOG2(LOG_SETTINGS_APPLIED, breath_period(state.settings), state.derived.motor_inhale_pulses);
+        }
 
-#ifdef SERIAL_DEBUG
-        Serial.println("Breath Loop Start");
-#endif //SERIAL_DEBUG
-        
+        // Straight on into the mode below, rather than a step later, so a
+        // breath the patient triggered starts as soon as it can.
         state.machine_state = check_mode();
     }
 
+    // TODO: factor out into a function and turn into switch statement.
+    if (MotorZeroing == state.machine_state){
+        motor_zeroing_step(motorController, state);
+    }
     else if (ACMode == state.machine_state) {
-        state = ac_mode_step(state);
+        ac_mode_step(motorController, state);
     }
     else if (VCMode == state.machine_state) {
-        state = vc_mode_step(state);
+        vc_mode_step(motorController, state);
     }
     else if (FailureMode == state.machine_state) {
-        state = failure_mode(state);
+        // The stop goes out again until the controller acknowledges it
+        if (failure_mode(state) && !failureStopped) {
+            failureStopped = true;
+            LOG1(LOG_FAILURE_STOPPED, motorController.stats().stops);
+        }
+    }
+
+    start = profile_end(PROFILE_MODE_STEP, start);
+    BreathPhase started = breath_timing_step(state, start);
+    breath_metrics_step(started, state);
+    profile_end(PROFILE_BREATH_TIMING, start);
+}
+
+void taskMotorLink() {
+    // Never waits on the UART, see MotorLink.h
+    safety_lane_poll();
+    motorController.poll();
+}
+
+void taskMotorTelemetry() {
+    // Only queues the reads, alarm checks use the cached snapshot
+    pollMotorTelemetry(motorController);
+}
+
+void taskButtons() {
+    //Update the user input parameters, and stage them for the next breath when one is set
+    unsigned long start = profile_start();
+    bool set = updateStateUserParameters(currentlySelectedParameter, parameterSet, parameterSelectEncoder,
+                                         userParameters, NUM_USER_PARAMETERS);
+
+    start = profile_end(PROFILE_PARAMETERS, start);
+    if (set) {
+        setStateParameters(stagedSettings, userParameters);
+        profile_end(PROFILE_MOTOR_SETTINGS, start);
     }
+}
+
+void taskAlarms() {
+    unsigned long start = profile_start();
+    handle_alarms(alarmReset, state);
+    profile_end(PROFILE_ALARMS, start);
+}
 
+void taskDisplays() {
+    //LCD display internal variables and regular screen
+    unsigned long start = profile_start();
+    displayUserParameters(currentlySelectedParameter, ventilatorDisplay, state.machine_state, state.vc_state, state.ac_state, last_breath_metrics(), LCD_MAX_STRING, userParameters);
+    profile_end(PROFILE_VENT_LCD, start);
 
-    state = handle_motor(motorController, state);
+    displayAlarms(state, alarmDisplay, userParameters, currentlySelectedParameter);
 
-    state = handle_alarms(alarmReset, state, alarmDisplay, userParameters, currentlySelectedParameter);
+    ventilatorDisplay.flush();
+    alarmDisplay.flush();
+}
 
-    //delay(1000);
+void taskLog() {
+    // The waveform stream has Serial to itself, records stay queued until it stops
+    if (telemetry_enabled()) {
+        return;
+    }
+
+    // Never waits, records that do not fit yet stay queued
+    log_flush(Serial);
+}
+
+void taskWaveform() {
+    // Builds a frame every 1/TELEMETRY_RATE, and in between keeps the
+    // transmit buffer topped up
+    telemetry_step(state, Serial);
+}
+
+/* Single character commands over Serial:
+   - 't': print per task run / overrun / shed counters
+   - 'r': reset the counters, the stage profile and the breath timing
+   - 'p': print the stage profile, see Profiler.h
+   - 'b': print delivered breath timing, see BreathTiming.h
+   - 'm': print motor link statistics
+   - 'w': start / stop the binary waveform stream, see Telemetry.h
+ */
+void taskSerialCommands() {
+    while (Serial.available()) {
+        switch (Serial.read()) {
+        case 't':
+            print_task_stats(Serial, tasks, NUM_TASKS);
+            Serial.print("log_dropped ");
+            Serial.println(log_dropped());
+            Serial.print("waveform_dropped ");
+            Serial.println(telemetry_dropped());
+            break;
+        case 'r':
+            reset_task_stats(tasks, NUM_TASKS);
+            motorController.resetStats();
+            reset_profile();
+            reset_breath_timing();
+            break;
+        case 'p':
+            print_profile(Serial);
+            break;
+        case 'b':
+            print_breath_timing(Serial);
+            break;
+        case 'm':
+            motorController.printStats(Serial);
+            break;
+        case 'w':
+            telemetry_enable(!telemetry_enabled());
+            break;
+        default:
+            break;
+        }
+    }
 }
 
 //FUNCTIONS
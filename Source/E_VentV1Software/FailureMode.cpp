@@ -1,25 +1,23 @@
-#define SERIAL_DEBUG
-
 #include "FailureMode.h"
+#include "SafetyLane.h"
+#include "Log.h"
 
+// FailureMode is never left, so this is only ever set once.
+static bool entered = false;
 
 
+bool failure_mode(VentilatorState &state) {
 
-VentilatorState failure_mode(VentilatorState state) {
-
-    //TODO: Set motor velocity to zero
+    //Already stopped if the failure came through handle_alarms, latched either way
+    safety_stop();
 
     //TODO: Set errors to critcal failure
 
 
-#ifdef SERIAL_DEBUG
-    Serial.println("Failure Mode");
-    Serial.println("Error Code:");
-    Serial.println(state.errors);
-    Serial.println("AC Mode State:");
-    Serial.println(state.ac_state);
-    Serial.println("VC Mode State:");
-    Serial.println(state.vc_state);
-#endif //SERIAL_DEBUG
+    if (!entered) {
+        entered = true;
+        LOG3(LOG_FAILURE_MODE, state.errors, state.ac_state, state.vc_state);
+    }
 
+    return safety_stopped();
 }
\ No newline at end of file
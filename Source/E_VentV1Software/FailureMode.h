@@ -6,16 +6,18 @@
 
 #include "MachineStates.h"
 
-/* Displays mechanism failure alarm and stops all motion
+/* Displays mechanism failure alarm and stops all motion, through the
+   safety lane. Sends the stop again, every SAFETY_STOP_RESEND_MS, until
+   the motor controller acknowledges it.
 
    Input:
    - displays for error message
    - errors
 
    Output:
-   - none
+   - true once the motor controller has acknowledged the stop
  */
-VentilatorState failure_mode(VentilatorState state);
+bool failure_mode(VentilatorState &state);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+/* Fixed point numbers for the control path.
+
+   The ATmega2560 has no FPU, so every float add, multiply and compare is a
+   library call of a few hundred cycles. The state machines, alarms and
+   pressure conversion work in fixed point instead, and floats are only used
+   where values come from or go to the user: the UserParameter values, the
+   LCD and the debug prints.
+
+   Fixed<T, FRAC, UNIT> stores value * 2^FRAC in the integer T. The scale
+   and unit are part of the type, so adding a pressure to a percentage, or a
+   Q8 value to a Q4 one, does not compile. Constants are converted with
+   from_float, which is constexpr, so a static_assert on fits() checks at
+   compile time that a constant is in range for its type:
+
+     constexpr Pressure MAX_LIMIT = Pressure::from_float(MAX_PRESSURE);
+     static_assert(Pressure::fits(MAX_PRESSURE), "MAX_PRESSURE out of range");
+
+   Add and subtract wrap like the underlying integer. Anything else goes
+   through raw, with the intermediate widened to 32 bits by the caller.
+
+   Times are not fixed point: they stay whole milliseconds, like millis(),
+   see seconds_to_ms in conversions.h.
+ */
+
+#ifndef FixedPoint_h
+#define FixedPoint_h
+
+#include <stdint.h>
+
+
+template <typename T, uint8_t FRAC, typename UNIT>
+struct Fixed {
+    static_assert(sizeof(T) <= 2, "Fixed is meant for 8 and 16 bit storage, widen by hand for math");
+    static_assert(FRAC < 8 * sizeof(T), "Fixed has more fraction bits than storage bits");
+
+    T raw;
+
+    static constexpr float scale() {
+        return (float)(1UL << FRAC);
+    }
+
+    static constexpr long min_raw() {
+        return ((T)-1 < 0) ? -(1L << (8 * sizeof(T) - 1)) : 0;
+    }
+
+    static constexpr long max_raw() {
+        return ((T)-1 < 0) ? (1L << (8 * sizeof(T) - 1)) - 1 : (1L << (8 * sizeof(T))) - 1;
+    }
+
+    /* True if value can be stored without overflow.
+     */
+    static constexpr bool fits(const float value) {
+        return value * scale() >= min_raw() && value * scale() <= max_raw();
+    }
+
+    /* Round to the nearest step. Only the UI and constants should need it.
+     */
+    static constexpr Fixed from_float(const float value) {
+        return Fixed{(T)(value * scale() + ((value < 0) ? -0.5f : 0.5f))};
+    }
+
+    static constexpr Fixed from_raw(const T value) {
+        return Fixed{value};
+    }
+
+    constexpr float to_float() const {
+        return raw / scale();
+    }
+
+    /* Nearest whole unit, halves away from 0, without going through float.
+     */
+    constexpr int to_int() const {
+        return (raw < 0) ? -(int)((-(long)raw + ((1L << FRAC) >> 1)) >> FRAC)
+                         : (int)(((long)raw + ((1L << FRAC) >> 1)) >> FRAC);
+    }
+
+    constexpr Fixed operator+(const Fixed other) const { return Fixed{(T)(raw + other.raw)}; }
+    constexpr Fixed operator-(const Fixed other) const { return Fixed{(T)(raw - other.raw)}; }
+    constexpr Fixed operator-() const { return Fixed{(T)-raw}; }
+
+    constexpr bool operator==(const Fixed other) const { return raw == other.raw; }
+    constexpr bool operator!=(const Fixed other) const { return raw != other.raw; }
+    constexpr bool operator<(const Fixed other) const  { return raw < other.raw; }
+    constexpr bool operator>(const Fixed other) const  { return raw > other.raw; }
+    constexpr bool operator<=(const Fixed other) const { return raw <= other.raw; }
+    constexpr bool operator>=(const Fixed other) const { return raw >= other.raw; }
+};
+
+
+// Units, only used to keep types apart.
+struct UnitCmH2O;
+struct UnitPercent;
+struct UnitPerMinute;
+struct UnitCmH2OPerSecond;
+struct UnitRatio;
+
+typedef Fixed<int16_t, 8, UnitCmH2O> Pressure;               // cmH2O, +-128 in steps of 1/256
+typedef Fixed<int16_t, 8, UnitPercent> Percentage;           // %, +-128 in steps of 1/256
+typedef Fixed<int16_t, 8, UnitPerMinute> BreathRate;         // 1/min, +-128 in steps of 1/256
+typedef Fixed<int16_t, 4, UnitCmH2OPerSecond> PressureRate;  // cmH2O/s, +-2048 in steps of 1/16
+typedef Fixed<int16_t, 8, UnitRatio> Ratio;                  // Unitless, +-128 in steps of 1/256
+
+#endif
@@ -2,9 +2,7 @@
 
 //Alarm Display Functions
 
-void displayNoAlarm(LiquidCrystal &displayName, float highPressure, float lowPressure, float highPEEP, float lowPEEP, float lowPlateau, const int LCD_MAX_STRING) {
-        char alarmStr[LCD_MAX_STRING];
-	
+void displayNoAlarm(LCDBuffer &displayName, float highPressure, float lowPressure, float highPEEP, float lowPEEP, float lowPlateau, const int LCD_MAX_STRING) {
 	int displayHighPressure = roundAndCast(highPressure);
 	int displayLowPressure = roundAndCast(lowPressure);
 	int displayHighPEEP = roundAndCast(highPEEP);
@@ -17,28 +15,32 @@ void displayNoAlarm(LiquidCrystal &displayName, float highPressure, float lowPre
 	displayName.write("NO ALARM  SETPOINTS:");
 
         // Second line
-	snprintf(alarmStr, LCD_MAX_STRING, "PIP=%11d-%2dCM", displayLowPressure, displayHighPressure);
 	displayName.setCursor(0,1);
-	displayName.write(alarmStr);
+	displayName.write("PIP=");
+	displayName.writeNumber(displayLowPressure, 11);
+	displayName.write('-');
+	displayName.writeNumber(displayHighPressure, 2);
+	displayName.write("CM");
 
         // Third line
-	snprintf(alarmStr, LCD_MAX_STRING, "PEEP=%10d-%2dCM", displayLowPEEP, displayHighPEEP);
 	displayName.setCursor(0,2);
-	displayName.write(alarmStr);
+	displayName.write("PEEP=");
+	displayName.writeNumber(displayLowPEEP, 10);
+	displayName.write('-');
+	displayName.writeNumber(displayHighPEEP, 2);
+	displayName.write("CM");
 
         // Fourth line
 	displayName.setCursor(0,3);
-	snprintf(alarmStr, LCD_MAX_STRING, "PLATEAU MIN=%6dCM", displayLowPlateau);
-	displayName.write(alarmStr);
+	displayName.write("PLATEAU MIN=");
+	displayName.writeNumber(displayLowPlateau, 6);
+	displayName.write("CM");
 }
 
 
-void displayHighPressureAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
+void displayHighPressureAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
 	int displayPressure = roundAndCast(pressureMeasurement);
 
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
-
 	displayName.clear();
 
         // First line
@@ -50,65 +52,59 @@ void displayHighPressureAlarm(LiquidCrystal &displayName, float pressureMeasurem
 
         // Fourth line
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayPressureLine(displayName, displayPressure);
 }
 
-void displayLowPressureAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
+void displayLowPressureAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
 	
 	int displayPressure = roundAndCast(pressureMeasurement);
 
 	const char alarmDispL1[] = "ALARM CONDITION:";
 	const char alarmDispL3[] = "LOW INSPIRATION";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayPressureLine(displayName, displayPressure);
 
 }
 
-void displayHighPEEPAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
+void displayHighPEEPAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
 	
 	int displayPressure = roundAndCast(pressureMeasurement);
 
 	const char alarmDispL1[] = "ALARM CONDITION:";
 	const char alarmDispL3[] = "HIGH PEEP";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayPressureLine(displayName, displayPressure);
 
 }
 
-void displayLowPEEPAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
+void displayLowPEEPAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING) {
 	
 	int displayPressure = roundAndCast(pressureMeasurement);
 
 	const char alarmDispL1[] = "ALARM CONDITION:";
 	const char alarmDispL3[] = "LOW PEEP";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayPressureLine(displayName, displayPressure);
 
 }
 
 
-void displayDisconnectAlarm(LiquidCrystal &displayName) {
+void displayDisconnectAlarm(LCDBuffer &displayName) {
 	
 	const char alarmDispL1[] = "ALARM CONDITION:";
 	const char alarmDispL2[] = "POSSIBLE DISCONNECT";
@@ -127,25 +123,25 @@ void displayDisconnectAlarm(LiquidCrystal &displayName) {
 }
 
 
-void displayTemperatureAlarm(LiquidCrystal &displayName, float temperatureMeasurement, int const LCD_MAX_STRING) {
+void displayTemperatureAlarm(LCDBuffer &displayName, float temperatureMeasurement, int const LCD_MAX_STRING) {
 	
 	int displayTemperature = roundAndCast(temperatureMeasurement);
 
 	const char alarmDispL1[] = "ALARM CONDITION:";
 	const char alarmDispL3[] = "HIGH CONTROLLER TEMP";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "TEMPERATURE=%3d C", displayTemperature);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayName.write("TEMPERATURE=");
+	displayName.writeNumber(displayTemperature, 3);
+	displayName.write(" C");
 
 }
 
-void displayApneaAlarm(LiquidCrystal &displayName) { //Currently unused
+void displayApneaAlarm(LCDBuffer &displayName) { //Currently unused
 	
 	const char alarmDispL1[] = "ALARM CONDITION:";
 	const char alarmDispL3[] = "APNEA";
@@ -159,7 +155,21 @@ void displayApneaAlarm(LiquidCrystal &displayName) { //Currently unused
 	displayName.write(alarmDispL4);
 
 }
-void displayDeviceFailureAlarm(LiquidCrystal &displayName) {
+void displayPressureSensorAlarm(LCDBuffer &displayName) {
+	
+	const char alarmDispL1[] = "ALARM CONDITION:";
+	const char alarmDispL3[] = "PRESSURE SENSOR";
+	const char alarmDispL4[] = "NOT RESPONDING";
+
+	displayName.clear();
+	displayName.write(alarmDispL1);
+	displayName.setCursor(0,2);
+	displayName.write(alarmDispL3);
+	displayName.setCursor(0,3);
+	displayName.write(alarmDispL4);
+
+}
+void displayDeviceFailureAlarm(LCDBuffer &displayName) {
 	
 	const char alarmDispL1[] = "ALARM CONDITION:";
 	const char alarmDispL3[] = "UNRECOVERABLE ERROR";
@@ -177,169 +187,170 @@ void displayDeviceFailureAlarm(LiquidCrystal &displayName) {
 
 //Alarm setpoint change functions
 
-void displayHighPressureChange(LiquidCrystal &displayName, float tempHighPressure, const int LCD_MAX_STRING) {
+void displayHighPressureChange(LCDBuffer &displayName, float tempHighPressure, const int LCD_MAX_STRING) {
 
 	int displayPressure = roundAndCast(tempHighPressure);
 
 	const char alarmDispL1[] = "PRESS TO SET";
 	const char alarmDispL3[] = "HIGH PIP LIMIT";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayPressureLine(displayName, displayPressure);
 
 }
 
-void displayLowPressureChange(LiquidCrystal &displayName, float tempLowPressure, const int LCD_MAX_STRING) {
+void displayLowPressureChange(LCDBuffer &displayName, float tempLowPressure, const int LCD_MAX_STRING) {
 
 	int displayPressure = roundAndCast(tempLowPressure);
 
 	const char alarmDispL1[] = "PRESS TO SET";
 	const char alarmDispL3[] = "LOW PIP LIMIT";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayPressureLine(displayName, displayPressure);
 
 }
 
-void displayHighPEEPChange(LiquidCrystal &displayName, float tempHighPEEP, const int LCD_MAX_STRING) {
+void displayHighPEEPChange(LCDBuffer &displayName, float tempHighPEEP, const int LCD_MAX_STRING) {
 
 	int displayPressure = roundAndCast(tempHighPEEP);
 
 	const char alarmDispL1[] = "PRESS TO SET";
 	const char alarmDispL3[] = "HIGH PEEP LIMIT";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4); 
+	displayPressureLine(displayName, displayPressure);
 }
 
-void displayLowPEEPChange(LiquidCrystal &displayName, float tempLowPEEP, const int LCD_MAX_STRING) {
+void displayLowPEEPChange(LCDBuffer &displayName, float tempLowPEEP, const int LCD_MAX_STRING) {
 
 	int displayPressure = roundAndCast(tempLowPEEP);
 
 	const char alarmDispL1[] = "PRESS TO SET";
 	const char alarmDispL3[] = "LOW PEEP LIMIT";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4); 
+	displayPressureLine(displayName, displayPressure);
 }
 
-void displayLowPlateauChange(LiquidCrystal &displayName, float tempLowPlateau, const int LCD_MAX_STRING) {
+void displayLowPlateauChange(LCDBuffer &displayName, float tempLowPlateau, const int LCD_MAX_STRING) {
 
 	int displayPressure = roundAndCast(tempLowPlateau);
 
 	const char alarmDispL1[] = "PRESS TO SET";
 	const char alarmDispL3[] = "LOW PLATEAU PRESSURE";
-	char alarmDispL4[LCD_MAX_STRING];
-	snprintf(alarmDispL4, LCD_MAX_STRING, "PRESSURE=%3d CM", displayPressure);
 
 	displayName.clear();
 	displayName.write(alarmDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(alarmDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(alarmDispL4);
+	displayPressureLine(displayName, displayPressure);
 }
 //End of Alarm Screen Functions
 
 //Parameter display functions
 
-void displayVentilationParameters(LiquidCrystal &displayName,
+void displayVentilationParameters(LCDBuffer &displayName,
 								  machineStates machineState,
 								  vcModeStates vcState, 
 								  acModeStates acState, 
 								  float breathsPerMinute, float thresholdPressure, 
-								  float tidalVolume, float inspirationTime, 
-								  float inspirationPause, float measuredPIP, 
-								  float measuredPlateau, const int LCD_MAX_STRING) {
+								  float tidalVolume, uint16_t inspirationTime, 
+								  uint16_t inspirationPause, const BreathMetrics &measured,
+								  const int LCD_MAX_STRING) {
 
 	int displayBPM = roundAndCast(breathsPerMinute);
 	int displayThresholdPressure = roundAndCast(thresholdPressure);
 	int displayTV = roundAndCast(tidalVolume);
-	int displayITFirstDigit = (int) inspirationTime;
-	int displayITSecondDigit = getFirstDigitPastDecimal(inspirationTime);
-	int displayIPFirstDigit = getFirstDigitPastDecimal(inspirationPause);
-	int displayIPSecondDigit = getSecondDigitPastDecimal(inspirationPause);
-	int displayPIP = roundAndCast(measuredPIP);
-	int displayPlateau = roundAndCast(measuredPlateau);
+	int displayIT = (inspirationTime + 50) / 100; //Tenths of a second
+	int displayIP = (inspirationPause + 5) / 10;  //Hundredths of a second
+	int displayPIP = measured.pip.to_int();
+	int displayPlateau = measured.plateau.to_int();
 	int displayVCStateCode = vcCodeAssignment(vcState);
 	int displayACStateCode = acCodeAssignment(acState);
 	char displayMachineStateCode = machineStateCodeAssignment(machineState);
 
-	// TODO: This makes me nervous...
-	char displayVentilatorMode[5];
+	const char *displayVentilatorMode;
 	if('A' == displayMachineStateCode){
-		strcpy(displayVentilatorMode,"AC");
+		displayVentilatorMode = "AC ";
 	}
 	else if('V' == displayMachineStateCode){
-		strcpy(displayVentilatorMode,"VC");
+		displayVentilatorMode = "VC ";
 	}
 	else{
-		strcpy(displayVentilatorMode,"--");
+		displayVentilatorMode = "-- ";
 	}
 
-	//TODO
-	char parameterDispL1[LCD_MAX_STRING];
-	char parameterDispL2[LCD_MAX_STRING];
-	char parameterDispL3[LCD_MAX_STRING];
-	char parameterDispL4[LCD_MAX_STRING];
+	displayName.clear();
 
-	snprintf(parameterDispL1, LCD_MAX_STRING, "MODE:%-3s|BPM=%2d  %1c%1d%1d", displayVentilatorMode, displayBPM, displayMachineStateCode, displayACStateCode, displayVCStateCode);
-	snprintf(parameterDispL2, LCD_MAX_STRING, "TP=%2dCM |TV=%3d%%", displayThresholdPressure, displayTV);
-	snprintf(parameterDispL3, LCD_MAX_STRING, "IT=%1d.%1ds |PAUSE 0.%1d%1ds", displayITFirstDigit, displayITSecondDigit, displayIPFirstDigit, displayIPSecondDigit);
-	snprintf(parameterDispL4, LCD_MAX_STRING, "PIP=%2dCM|PLAT=%2dCM", displayPIP, displayPlateau);
+	displayName.write("MODE:");
+	displayName.write(displayVentilatorMode);
+	displayName.write("|BPM=");
+	displayName.writeNumber(displayBPM, 2);
+	displayName.write("  ");
+	displayName.write(displayMachineStateCode);
+	displayName.writeNumber(displayACStateCode, 1);
+	displayName.writeNumber(displayVCStateCode, 1);
 
-	displayName.clear();
-	displayName.write(parameterDispL1);
 	displayName.setCursor(0,1);
-	displayName.write(parameterDispL2);
+	displayName.write("TP=");
+	displayName.writeNumber(displayThresholdPressure, 2);
+	displayName.write("CM |TV=");
+	displayName.writeNumber(displayTV, 3);
+	displayName.write('%');
+
 	displayName.setCursor(0,2);
-	displayName.write(parameterDispL3);
+	displayName.write("IT=");
+	displayName.writeNumber(displayIT/10, 1);
+	displayName.write('.');
+	displayName.writeDigits(displayIT, 1);
+	displayName.write("s |PAUSE ");
+	displayName.writeNumber(displayIP/100, 1);
+	displayName.write('.');
+	displayName.writeDigits(displayIP, 2);
+	displayName.write('s');
+
 	displayName.setCursor(0,3);
-	displayName.write(parameterDispL4);
+	displayName.write("PIP=");
+	displayName.writeNumber(displayPIP, 2);
+	displayName.write("CM|PLAT=");
+	displayName.writeNumber(displayPlateau, 2);
+	displayName.write("CM");
 
 } 
 
-void displayStartupScreen(LiquidCrystal &displayName, const char softwareVersion[], const int LCD_MAX_STRING) {
+void displayStartupScreen(LCDBuffer &displayName, const char softwareVersion[], const int LCD_MAX_STRING) {
 
 	const char parameterDispL1[] = "EMERGENCY VENTILATOR";
-	char parameterDispL3[LCD_MAX_STRING];
-
-	snprintf(parameterDispL3, LCD_MAX_STRING, "%s",softwareVersion);
 
 	displayName.clear();
 	displayName.write(parameterDispL1);
 	displayName.setCursor(0,2);
-	displayName.write(parameterDispL3);
+	displayName.write(softwareVersion);
+	displayName.flush();
 
 	delay(2000);
 
 }
 
-void displayStartupHoldScreen(LiquidCrystal &displayName) {
+void displayStartupHoldScreen(LCDBuffer &displayName) {
 
 	const char parameterDispL1[] = "ENSURE PERSONNEL ARE";
 	const char parameterDispL2[] = "CLEAR OF VENTILATOR";
@@ -354,10 +365,11 @@ void displayStartupHoldScreen(LiquidCrystal &displayName) {
 	displayName.write(parameterDispL3);
 	displayName.setCursor(0,3);
 	displayName.write(parameterDispL4);
+	displayName.flush();
 
 }
 
-void displayHomingScreen(LiquidCrystal &displayName) {
+void displayHomingScreen(LCDBuffer &displayName) {
 
 	const char parameterDispL1[] = "CALIBRATION";
 	const char parameterDispL2[] = "IN PROGRESS...";
@@ -373,118 +385,109 @@ void displayHomingScreen(LiquidCrystal &displayName) {
 
 //Parameter setpoint change functions
 
-void displayTVChange(LiquidCrystal &displayName, float tempTV, const int LCD_MAX_STRING) {
+void displayTVChange(LCDBuffer &displayName, float tempTV, const int LCD_MAX_STRING) {
 
 	int displayTV = roundAndCast(tempTV);
 
 	const char parameterDispL1[] = "PRESS TO SET";
 	const char parameterDispL3[] = "TIDAL VOLUME SETTING";
-	char parameterDispL4[LCD_MAX_STRING];
-	snprintf(parameterDispL4, LCD_MAX_STRING, "=%d%%", displayTV);
 
 	displayName.clear();
 	displayName.write(parameterDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(parameterDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(parameterDispL4);
+	displayName.write('=');
+	displayName.writeNumber(displayTV);
+	displayName.write('%');
 
 }
 
-void displayBPMChange(LiquidCrystal &displayName, float tempBPM, const int LCD_MAX_STRING) {
+void displayBPMChange(LCDBuffer &displayName, float tempBPM, const int LCD_MAX_STRING) {
 
 	int displayBPM = roundAndCast(tempBPM);
 
 	const char parameterDispL1[] = "PRESS TO SET";
 	const char parameterDispL3[] = "BREATHS/MIN SETTING";
-	char parameterDispL4[LCD_MAX_STRING];
-	snprintf(parameterDispL4, LCD_MAX_STRING, "=%2d/MIN", displayBPM);
 
 	displayName.clear();
 	displayName.write(parameterDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(parameterDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(parameterDispL4);
+	displayName.write('=');
+	displayName.writeNumber(displayBPM, 2);
+	displayName.write("/MIN");
 
 }
 
-void displayInspirationTimeChange(LiquidCrystal &displayName, float tempIT, const int LCD_MAX_STRING) {
+void displayInspirationTimeChange(LCDBuffer &displayName, uint16_t tempIT, const int LCD_MAX_STRING) {
 
-	int displayITFirstDigit = (int) tempIT;
-	int displayITSecondDigit = getFirstDigitPastDecimal(tempIT);
+	int displayIT = (tempIT + 50) / 100; //Tenths of a second
 
 	const char parameterDispL1[] = "PRESS TO SET";
 	const char parameterDispL3[] = "INSPIRATION TIME";
-	char parameterDispL4[LCD_MAX_STRING];
-	snprintf(parameterDispL4, LCD_MAX_STRING, "=%d.%d SEC", displayITFirstDigit, displayITSecondDigit);
 
 	displayName.clear();
 	displayName.write(parameterDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(parameterDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(parameterDispL4);
+	displayName.write('=');
+	displayName.writeNumber(displayIT/10);
+	displayName.write('.');
+	displayName.writeDigits(displayIT, 1);
+	displayName.write(" SEC");
 
 }
 
-void displayPauseTimeChange(LiquidCrystal &displayName, float tempPauseTime, const int LCD_MAX_STRING) {
+void displayPauseTimeChange(LCDBuffer &displayName, uint16_t tempPauseTime, const int LCD_MAX_STRING) {
 
-	int displayPTLeadDigit = getFirstDigitPastDecimal(tempPauseTime);
-	int displayPTLastDigit = (int) (10*(10*tempPauseTime - displayPTLeadDigit));
+	int displayPT = (tempPauseTime + 5) / 10; //Hundredths of a second
 
 	const char parameterDispL1[] = "PRESS TO SET";
 	const char parameterDispL3[] = "PLATEAU PAUSE";
-	char parameterDispL4[LCD_MAX_STRING];
-	snprintf(parameterDispL4, LCD_MAX_STRING, "=0.%d%d SEC", displayPTLeadDigit, displayPTLastDigit);
 
 	displayName.clear();
 	displayName.write(parameterDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(parameterDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(parameterDispL4);
+	displayName.write('=');
+	displayName.writeNumber(displayPT/100);
+	displayName.write('.');
+	displayName.writeDigits(displayPT, 2);
+	displayName.write(" SEC");
 
 }
 
-void displayThresholdPressureChange(LiquidCrystal &displayName, float tempThresholdPressure, const int LCD_MAX_STRING) {
+void displayThresholdPressureChange(LCDBuffer &displayName, float tempThresholdPressure, const int LCD_MAX_STRING) {
 
 	int displayThresholdPressure = roundAndCast(tempThresholdPressure);
 
 	const char parameterDispL1[] = "PRESS TO SET";
 	const char parameterDispL3[] = "THRESHOLD PRESSURE";
-	char parameterDispL4[LCD_MAX_STRING];
-	snprintf(parameterDispL4, LCD_MAX_STRING, "=%d CM", displayThresholdPressure);
 
 	displayName.clear();
 	displayName.write(parameterDispL1);
 	displayName.setCursor(0,2);
 	displayName.write(parameterDispL3);
 	displayName.setCursor(0,3);
-	displayName.write(parameterDispL4);
+	displayName.write('=');
+	displayName.writeNumber(displayThresholdPressure);
+	displayName.write(" CM");
 
 }
 
 //Helper Functions
 
-int roundAndCast(float x) {
-	int new_var;
-  	new_var = (int) round(x);
-  	return new_var;
+void displayPressureLine(LCDBuffer &displayName, int pressure) {
+	displayName.write("PRESSURE=");
+	displayName.writeNumber(pressure, 3);
+	displayName.write(" CM");
 }
 
-
-int getFirstDigitPastDecimal(float realNumber) {
-	int naturalNumber = (int) realNumber;
-	int firstDigitPastDecimal = (int) (10*(realNumber - naturalNumber));
-
-	return firstDigitPastDecimal;
-}
-
-
-int getSecondDigitPastDecimal(float realNumber) {
-	int naturalNumber = 10*((int) (10*realNumber));
-	int secondDigitPastDecimal = (int) (100*realNumber - naturalNumber);
-
-	return secondDigitPastDecimal;
+int roundAndCast(float x) {
+	//Round half away from zero, without pulling in round()
+	return (int) (x < 0 ? x - 0.5f : x + 0.5f);
 }
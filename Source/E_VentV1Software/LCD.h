@@ -5,16 +5,13 @@
 #include <Arduino.h>
 #include <LiquidCrystal.h>
 
+#include "LCDBuffer.h"
 #include "MachineStates.h"
+#include "BreathMetrics.h"
 #include "VCMode.h"
 #include "ACMode.h"
 #include "PinAssignments.h"
 
-//LCD Constants
-const int LCD_COLUMNS    = 20;
-const int LCD_ROWS       = 4;
-const int LCD_MAX_STRING = 21;
-
 const int VENTILATOR_LCD_ENABLE = 11;
 const int VENTILATOR_LCD_RS     = 12;
 const int VENTILATOR_LCD_DB4    = 5;
@@ -26,34 +23,36 @@ const int VENTILATOR_LCD_DB7    = 2;
 //ALARM DISPLAY FUNCTIONS---------------------------------------------------------------------------------------------------------------------------------------------
 
 //Alarm Display
-void displayNoAlarm(LiquidCrystal &displayName, float highPressure, float lowPressure, float highPEEP, float lowPEEP, float lowPlateau, const int LCD_MAX_STRING);
+void displayNoAlarm(LCDBuffer &displayName, float highPressure, float lowPressure, float highPEEP, float lowPEEP, float lowPlateau, const int LCD_MAX_STRING);
+
+void displayHighPressureAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
 
-void displayHighPressureAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
+void displayLowPressureAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
 
-void displayLowPressureAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
+void displayHighPEEPAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
 
-void displayHighPEEPAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
+void displayLowPEEPAlarm(LCDBuffer &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
 
-void displayLowPEEPAlarm(LiquidCrystal &displayName, float pressureMeasurement, const int LCD_MAX_STRING);
+void displayDisconnectAlarm(LCDBuffer &displayName);
 
-void displayDisconnectAlarm(LiquidCrystal &displayName);
+void displayTemperatureAlarm(LCDBuffer &displayName, float temperatureMeasurement, const int LCD_MAX_STRING);
 
-void displayTemperatureAlarm(LiquidCrystal &displayName, float temperatureMeasurement, const int LCD_MAX_STRING);
+void displayApneaAlarm(LCDBuffer &displayName); //Currently will not be used
 
-void displayApneaAlarm(LiquidCrystal &displayName); //Currently will not be used
+void displayPressureSensorAlarm(LCDBuffer &displayName);
 
-void displayDeviceFailureAlarm(LiquidCrystal &displayName);
+void displayDeviceFailureAlarm(LCDBuffer &displayName);
 
 //Alarm setpoint change
-void displayHighPressureChange(LiquidCrystal &displayName, float tempHighPressure, const int LCD_MAX_STRING);
+void displayHighPressureChange(LCDBuffer &displayName, float tempHighPressure, const int LCD_MAX_STRING);
 
-void displayLowPressureChange(LiquidCrystal &displayName, float tempLowPressure, const int LCD_MAX_STRING);
+void displayLowPressureChange(LCDBuffer &displayName, float tempLowPressure, const int LCD_MAX_STRING);
 
-void displayHighPEEPChange(LiquidCrystal &displayName, float tempHighPEEP, const int LCD_MAX_STRING);
+void displayHighPEEPChange(LCDBuffer &displayName, float tempHighPEEP, const int LCD_MAX_STRING);
 
-void displayLowPEEPChange(LiquidCrystal &displayName, float tempLowPEEP, const int LCD_MAX_STRING);
+void displayLowPEEPChange(LCDBuffer &displayName, float tempLowPEEP, const int LCD_MAX_STRING);
 
-void displayLowPlateauChange(LiquidCrystal &displayName, float tempLowPlateau, const int LCD_MAX_STRING);
+void displayLowPlateauChange(LCDBuffer &displayName, float tempLowPlateau, const int LCD_MAX_STRING);
 
 //END OF ALARM DISPLAY FUNCTIONS-------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -63,41 +62,40 @@ void displayLowPlateauChange(LiquidCrystal &displayName, float tempLowPlateau, c
 
 //Parameter Display
 
-void displayVentilationParameters(LiquidCrystal &displayName,
+void displayVentilationParameters(LCDBuffer &displayName,
 								  machineStates machineState, 
 								  vcModeStates vcState, 
 								  acModeStates acState, 
 								  float breathsPerMinute, float thresholdPressure, 
-								  float tidalVolume, float inspirationTime, 
-								  float inspirationPause, float measuredPIP, 
-								  float measuredPlateau, const int LCD_MAX_STRING);
+								  float tidalVolume, uint16_t inspirationTime, 
+								  uint16_t inspirationPause, const BreathMetrics &measured,
+								  const int LCD_MAX_STRING); //Times in ms
 
-void displayStartupScreen(LiquidCrystal &displayName, const char softwareVersion[], const int LCD_MAX_STRING); 
+void displayStartupScreen(LCDBuffer &displayName, const char softwareVersion[], const int LCD_MAX_STRING); 
 
-void displayStartupHoldScreen(LiquidCrystal &displayName);
+void displayStartupHoldScreen(LCDBuffer &displayName);
 
-void displayHomingScreen(LiquidCrystal &displayName);
+void displayHomingScreen(LCDBuffer &displayName);
 
 //Parameter setpoint change
-void displayTVChange(LiquidCrystal &displayName, float tempTV, const int LCD_MAX_STRING);
+void displayTVChange(LCDBuffer &displayName, float tempTV, const int LCD_MAX_STRING);
 
-void displayBPMChange(LiquidCrystal &displayName, float tempBPM, const int LCD_MAX_STRING);
+void displayBPMChange(LCDBuffer &displayName, float tempBPM, const int LCD_MAX_STRING);
 
-void displayInspirationTimeChange(LiquidCrystal &displayName, float tempIT, const int LCD_MAX_STRING);
+void displayInspirationTimeChange(LCDBuffer &displayName, uint16_t tempIT, const int LCD_MAX_STRING); //ms
 
-void displayPauseTimeChange(LiquidCrystal &displayName, float tempPauseTime, const int LCD_MAX_STRING);
+void displayPauseTimeChange(LCDBuffer &displayName, uint16_t tempPauseTime, const int LCD_MAX_STRING); //ms
 
-void displayThresholdPressureChange(LiquidCrystal &displayName, float tempThresholdPressure, const int LCD_MAX_STRING);
+void displayThresholdPressureChange(LCDBuffer &displayName, float tempThresholdPressure, const int LCD_MAX_STRING);
 
 //END OF PARAMETER DISPLAY FUNCTIONS--------------------------------------------------------------------------------------------------------------------------------------------
 
 
 //Helper Functions
 
-int roundAndCast(float x);
+//Writes "PRESSURE=nnn CM", the last line of most alarm screens
+void displayPressureLine(LCDBuffer &displayName, int pressure);
 
-int getFirstDigitPastDecimal(float realNumber);
-
-int getSecondDigitPastDecimal(float realNumber);
+int roundAndCast(float x);
 
 #endif
@@ -0,0 +1,122 @@
+#include "LCDBuffer.h"
+
+
+// DDRAM address of the start of each row on a 20x4 display.
+static const uint8_t ROW_ADDRESS[LCD_ROWS] = {0x00, 0x40, 0x14, 0x54};
+
+
+LCDBuffer::LCDBuffer(LiquidCrystal &lcd, LCDBus &bus, uint8_t enable)
+    : lcd(lcd), bus(bus), enable(enable), display(LCD_BUS_MAX_DISPLAYS), column(0), row(0) {
+    memset(next, ' ', sizeof(next));
+    memset(shown, ' ', sizeof(shown));
+}
+
+
+void LCDBuffer::begin(uint8_t columns, uint8_t rows) {
+    lcd.begin(columns, rows);
+    lcd.clear();
+    display = bus.addDisplay(enable);
+
+    memset(next, ' ', sizeof(next));
+    memset(shown, ' ', sizeof(shown));
+    column = 0;
+    row = 0;
+}
+
+
+void LCDBuffer::clear() {
+    memset(next, ' ', sizeof(next));
+    column = 0;
+    row = 0;
+}
+
+
+void LCDBuffer::setCursor(uint8_t column, uint8_t row) {
+    this->column = column;
+    this->row = row;
+}
+
+
+void LCDBuffer::write(char c) {
+    if (row < LCD_ROWS && column < LCD_COLUMNS) {
+        next[row][column] = c;
+    }
+    column++;
+}
+
+
+void LCDBuffer::write(const char *str) {
+    while (*str) {
+        write(*str++);
+    }
+}
+
+
+void LCDBuffer::writeNumber(long value, uint8_t width) {
+    char digits[11];
+    uint8_t length = 0;
+    bool negative = value < 0;
+    unsigned long magnitude = negative ? -(unsigned long)value : value;
+
+    do {
+        digits[length++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+
+    for (uint8_t i = length + negative; i < width; i++) {
+        write(' ');
+    }
+    if (negative) {
+        write('-');
+    }
+    while (length) {
+        write(digits[--length]);
+    }
+}
+
+
+void LCDBuffer::writeDigits(unsigned int value, uint8_t digits) {
+    unsigned int place = 1;
+
+    for (uint8_t i = 1; i < digits; i++) {
+        place *= 10;
+    }
+
+    for (; place; place /= 10) {
+        write('0' + (value / place) % 10);
+    }
+}
+
+
+uint8_t LCDBuffer::flush() {
+    uint8_t written = 0;
+
+    for (uint8_t r = 0; r < LCD_ROWS; r++) {
+        // The display moves its cursor along the row by itself, so a run of
+        // changed cells only needs one cursor move.
+        bool cursor_here = false;
+
+        for (uint8_t c = 0; c < LCD_COLUMNS; c++) {
+            if (next[r][c] == shown[r][c]) {
+                cursor_here = false;
+                continue;
+            }
+
+            // Worst case is a cursor move and the character.
+            if (bus.space() < 2) {
+                return written;
+            }
+
+            if (!cursor_here) {
+                bus.command(display, LCD_SET_DDRAM_ADDRESS | (ROW_ADDRESS[r] + c));
+                cursor_here = true;
+            }
+
+            bus.data(display, next[r][c]);
+            shown[r][c] = next[r][c];
+            written++;
+        }
+    }
+
+    return written;
+}
@@ -0,0 +1,81 @@
+/* Shadow framebuffer for a 20x4 HD44780 display.
+
+   Screens are drawn into the buffer with the same clear / setCursor / write
+   calls as LiquidCrystal, none of which touch the display. flush() then
+   compares the buffer with what the display is showing, and only sends the
+   cells that changed. The display is never cleared after begin(), so an
+   unchanged screen costs nothing and a changing value does not flicker.
+
+   The changed cells are queued on an LCDBus rather than written directly,
+   so flush() does not wait on the display either. Anything that does not
+   fit in the queue is left for the next flush().
+
+   Numbers are formatted with integer arithmetic only, instead of snprintf.
+ */
+
+#ifndef LCDBuffer_h
+#define LCDBuffer_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <LiquidCrystal.h>
+
+#include "LCDBus.h"
+
+//LCD Constants
+const int LCD_COLUMNS    = 20;
+const int LCD_ROWS       = 4;
+const int LCD_MAX_STRING = 21;
+
+
+class LCDBuffer {
+public:
+    /* lcd is only used to initialise the display, after that all writes
+       go through bus.
+     */
+    LCDBuffer(LiquidCrystal &lcd, LCDBus &bus, uint8_t enable);
+
+    /* Initialise the display and clear it, the only clear it will get.
+       Blocks, and must be called before bus.begin().
+     */
+    void begin(uint8_t columns, uint8_t rows);
+
+    // Drawing, buffer only. Text past the end of a row is dropped.
+    void clear();
+    void setCursor(uint8_t column, uint8_t row);
+    void write(char c);
+    void write(const char *str);
+
+    /* Write value right aligned in a field of width characters, padded with
+       spaces, the same as printf("%*ld"). Wider values use as many
+       characters as they need.
+     */
+    void writeNumber(long value, uint8_t width = 0);
+
+    /* Write the lowest digits digits of value, padded with zeros.
+     */
+    void writeDigits(unsigned int value, uint8_t digits);
+
+    /* Queue the cells that differ from what is on the display. Returns the
+       number of cells queued.
+     */
+    uint8_t flush();
+
+private:
+    LiquidCrystal &lcd;
+    LCDBus &bus;
+    uint8_t enable;
+    uint8_t display; // Number on the bus.
+
+    char next[LCD_ROWS][LCD_COLUMNS];  // Being drawn.
+    char shown[LCD_ROWS][LCD_COLUMNS]; // On the display.
+
+    uint8_t column;
+    uint8_t row;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "LCDBus.h"
+
+
+LCDBus *LCDBus::running = NULL;
+
+
+LCDBus::LCDBus(uint8_t rs, uint8_t db4, uint8_t db5, uint8_t db6, uint8_t db7) : num_displays(0) {
+    this->rs.number = rs;
+    db[0].number = db4;
+    db[1].number = db5;
+    db[2].number = db6;
+    db[3].number = db7;
+}
+
+
+void LCDBus::resolve(Pin &pin) {
+    pin.out = portOutputRegister(digitalPinToPort(pin.number));
+    pin.mask = digitalPinToBitMask(pin.number);
+    pinMode(pin.number, OUTPUT);
+}
+
+
+uint8_t LCDBus::addDisplay(uint8_t enable) {
+    if (num_displays >= LCD_BUS_MAX_DISPLAYS) {
+        return LCD_BUS_MAX_DISPLAYS;
+    }
+
+    enables[num_displays].number = enable;
+    resolve(enables[num_displays]);
+    set(enables[num_displays], false);
+
+    return num_displays++;
+}
+
+
+void LCDBus::begin() {
+    resolve(rs);
+    for (uint8_t i = 0; i < 4; i++) {
+        resolve(db[i]);
+    }
+
+    running = this;
+
+#ifdef TIMSK4 // Boards with a Timer4, the Mega and the host build
+    cli();
+
+    // Timer4, CTC mode on OCR4A, clk/8
+    TCCR4A = 0;
+    TCCR4B = _BV(WGM42) | _BV(CS41);
+    TCNT4  = 0;
+    OCR4A  = (F_CPU / 8 / LCD_BUS_TICK_RATE) - 1;
+    TIMSK4 = _BV(OCIE4A);
+
+    sei();
+#endif
+}
+
+
+bool LCDBus::command(uint8_t display, uint8_t value) {
+    Write write = {display, value};
+    if (display >= num_displays || !queue.push(write)) {
+        return false;
+    }
+
+    wake();
+    return true;
+}
+
+
+bool LCDBus::data(uint8_t display, uint8_t value) {
+    Write write = {(uint8_t)(display | DATA_FLAG), value};
+    if (display >= num_displays || !queue.push(write)) {
+        return false;
+    }
+
+    wake();
+    return true;
+}
+
+
+// Turn the tick back on, if the last one found nothing to send.
+void LCDBus::wake() {
+#ifdef TIMSK4
+    if (running == this && !(TIMSK4 & _BV(OCIE4A))) {
+        cli();
+        TIMSK4 |= _BV(OCIE4A);
+        sei();
+    }
+#endif
+}
+
+
+uint8_t LCDBus::space() const {
+    return queue.space();
+}
+
+
+uint16_t LCDBus::droppedCount() const {
+    return queue.droppedCount();
+}
+
+
+void LCDBus::set(const Pin &pin, bool high) {
+    if (high) {
+        *pin.out |= pin.mask;
+    }
+    else {
+        *pin.out &= ~pin.mask;
+    }
+}
+
+
+void LCDBus::writeNibble(const Pin &enable, uint8_t nibble) {
+    for (uint8_t i = 0; i < 4; i++) {
+        set(db[i], nibble & (1 << i));
+    }
+
+    // ENABLE must be high for at least 450ns, and the data is latched on
+    // the falling edge.
+    set(enable, true);
+    delayMicroseconds(1);
+    set(enable, false);
+}
+
+
+void LCDBus::tick() {
+    Write write;
+
+    if (!queue.pop(write)) {
+#ifdef TIMSK4
+        // Nothing to send until wake.
+        TIMSK4 &= ~_BV(OCIE4A);
+#endif
+        return;
+    }
+
+    const Pin &enable = enables[write.display & ~DATA_FLAG];
+
+    set(rs, write.display & DATA_FLAG);
+    writeNibble(enable, write.value >> 4);
+    writeNibble(enable, write.value);
+}
+
+
+#ifdef TIMSK4
+// Runs with interrupts disabled, so the port read-modify-writes in tick are
+// safe from other interrupts.
+ISR(TIMER4_COMPA_vect){
+    if (LCDBus::running) {
+        LCDBus::running->tick();
+    }
+}
+#endif
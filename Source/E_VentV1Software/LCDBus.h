@@ -0,0 +1,102 @@
+/* Interrupt driven writes to HD44780 displays on a shared 4 bit bus.
+
+   LiquidCrystal busy-waits for every byte it sends, around 100us with
+   digitalWrite and the execution delay. LCDBus instead queues bytes, and a
+   Timer4 interrupt sends one byte per tick, as two nibbles written straight
+   to the port registers. Each tick takes a few microseconds, and ticks are
+   further apart than the 37us an HD44780 needs to carry out a write, so
+   nothing ever waits on the display. The interrupt is turned off by the
+   tick that finds the queue empty, and back on when a byte is queued, so
+   an idle bus costs nothing.
+
+   The displays share RS and DB4-DB7 and each has its own ENABLE, so only the
+   display whose ENABLE is pulsed latches the bus. A whole byte always goes
+   out within one tick, so writes to different displays can be interleaved
+   freely.
+
+   Initialising a display still needs the long delays in LiquidCrystal::begin,
+   so do that first, during setup, and only then call LCDBus::begin. The
+   clear and home commands also take longer than a tick and must not be
+   queued.
+ */
+
+#ifndef LCDBus_h
+#define LCDBus_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "RingBuffer.h"
+
+const uint8_t LCD_BUS_MAX_DISPLAYS = 2;
+const uint8_t LCD_BUS_QUEUE_SIZE   = 128; // Bytes, a full redraw of one 20x4 display is at most 100
+const uint16_t LCD_BUS_TICK_RATE   = 5000; // Hz, one byte per tick
+
+// HD44780 instructions
+const uint8_t LCD_SET_DDRAM_ADDRESS = 0x80;
+
+
+class LCDBus {
+public:
+    LCDBus(uint8_t rs, uint8_t db4, uint8_t db5, uint8_t db6, uint8_t db7);
+
+    /* Register the display with this ENABLE pin, and return its number for
+       command / data. The display must already be initialised.
+     */
+    uint8_t addDisplay(uint8_t enable);
+
+    /* Start the timer. Only one LCDBus can be running.
+     */
+    void begin();
+
+    /* Queue an instruction or a character. Returns false if the queue is
+       full.
+     */
+    bool command(uint8_t display, uint8_t value);
+    bool data(uint8_t display, uint8_t value);
+
+    /* Number of bytes that can still be queued.
+     */
+    uint8_t space() const;
+
+    /* Bytes that did not fit in the queue.
+     */
+    uint16_t droppedCount() const;
+
+    /* Send the next queued byte. Called from the timer interrupt.
+     */
+    void tick();
+
+    static LCDBus *running;
+
+private:
+    struct Pin {
+        uint8_t number;
+        volatile uint8_t *out;
+        uint8_t mask;
+    };
+
+    struct Write {
+        uint8_t display; // Bit 7 set for data (RS high).
+        uint8_t value;
+    };
+
+    static const uint8_t DATA_FLAG = 0x80;
+
+    void resolve(Pin &pin);
+    void set(const Pin &pin, bool high);
+    void writeNibble(const Pin &enable, uint8_t nibble);
+    void wake();
+
+    Pin rs;
+    Pin db[4];
+    Pin enables[LCD_BUS_MAX_DISPLAYS];
+    uint8_t num_displays;
+
+    RingBuffer<Write, LCD_BUS_QUEUE_SIZE> queue;
+};
+
+#endif
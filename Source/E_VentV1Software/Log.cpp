@@ -0,0 +1,51 @@
+#include "Log.h"
+
+
+struct LogRecord {
+    uint8_t event;
+    uint8_t num_args;
+    uint32_t args[LOG_MAX_ARGS];
+};
+
+static RingBuffer<LogRecord, LOG_BUFFER_SIZE> records;
+
+
+void log_write(const LogEvent event, const uint32_t *args, const uint8_t num_args) {
+    LogRecord record;
+
+    record.event = event;
+    record.num_args = num_args < LOG_MAX_ARGS ? num_args : LOG_MAX_ARGS;
+    for (uint8_t i = 0; i < record.num_args; i++) {
+        record.args[i] = args[i];
+    }
+
+    records.push(record);
+}
+
+
+void log_flush(HardwareSerial &out) {
+    LogRecord record;
+
+    // Whole records only, so that other output on the port never lands in
+    // the middle of one.
+    while (records.peek(record) && out.availableForWrite() >= 3 + 4*record.num_args) {
+        out.write(LOG_SYNC);
+        out.write(record.event);
+        out.write(record.num_args);
+
+        for (uint8_t i = 0; i < record.num_args; i++) {
+            uint32_t arg = record.args[i];
+            for (uint8_t byte = 0; byte < 4; byte++) {
+                out.write((uint8_t)arg);
+                arg >>= 8;
+            }
+        }
+
+        records.pop(record);
+    }
+}
+
+
+uint16_t log_dropped() {
+    return records.droppedCount();
+}
@@ -0,0 +1,144 @@
+/* Binary debug log.
+
+   Printing text at every state change costs far more than the change
+   itself, and Serial.print blocks as soon as the 64 byte transmit buffer is
+   full. A LOG call instead stores a small record: the event ID and up to
+   LOG_MAX_ARGS raw 4 byte arguments. Records are kept in a RAM ring buffer
+   and the log task moves whole records into the Serial transmit buffer as
+   room frees up, so a LOG call never waits. Records that do not fit are
+   dropped and counted.
+
+   On the wire a record is LOG_SYNC, the event ID, the argument count and the
+   arguments, little endian. LOG_SYNC is not printable, so records can share
+   the port with text output. Source/Tools/decode_log.py reads LOG_EVENTS from
+   this file and turns records back into text.
+
+   SERIAL_DEBUG is a build flag, on unless the build sets it to 0, as
+   make SERIAL_DEBUG=0 does; off, every LOG call compiles to nothing.
+ */
+
+#ifndef Log_h
+#define Log_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "RingBuffer.h"
+
+#ifndef SERIAL_DEBUG
+#define SERIAL_DEBUG 1
+#endif
+
+const long SERIAL_BAUD         = 115200; // Log and serial commands
+const uint8_t LOG_SYNC         = 0xA5;
+const uint8_t LOG_MAX_ARGS     = 3;
+const uint8_t LOG_BUFFER_SIZE  = 16;     // Records
+
+/* Every event that can be logged, and the text it decodes to. The format
+   says how to read each argument: %lu unsigned, %ld signed, %f float.
+   IDs follow the order of the list, so only ever add to the end.
+ */
+#define LOG_EVENTS(X) \
+    X(LOG_INIT_START,         "Initialization starting...") \
+    X(LOG_STARTUP_HOLD,       "StartupHold machine_state=%lu") \
+    X(LOG_BREATH_LOOP_START,  "Breath Loop Start") \
+    X(LOG_AC_START,           "ACStart") \
+    X(LOG_AC_INHALE_WAIT,     "ACInhaleWait: %lu Trigger Time: %lu ms") \
+    X(LOG_AC_INHALE_COMMAND,  "ACInhaleCommand") \
+    X(LOG_AC_INHALE,          "ACInhale: %lu ms Inhale Ends: %lu ms") \
+    X(LOG_AC_INHALE_ABORT,    "ACInhaleAbort: %lu") \
+    X(LOG_AC_PEAK,            "ACPeak: %lu ms Pause Ends: %lu ms") \
+    X(LOG_AC_EXHALE_COMMAND,  "ACExhaleCommand") \
+    X(LOG_AC_EXHALE,          "ACExhale: %lu ms Breath Ends: %lu ms") \
+    X(LOG_AC_RESET,           "ACReset") \
+    X(LOG_AC_INVALID,         "Invalid AC state! %lu") \
+    X(LOG_VC_START,           "VCStart") \
+    X(LOG_VC_INHALE_COMMAND,  "VCInhaleCommand") \
+    X(LOG_VC_INHALE,          "VCInhale: %lu ms Inhale Ends: %lu ms") \
+    X(LOG_VC_INHALE_ABORT,    "VCInhaleAbort: %lu") \
+    X(LOG_VC_PEAK,            "VCPeak: %lu ms Pause Ends: %lu ms") \
+    X(LOG_VC_EXHALE_COMMAND,  "VCExhaleCommand") \
+    X(LOG_VC_EXHALE,          "VCExhale: %lu ms Breath Ends: %lu ms") \
+    X(LOG_VC_RESET,           "VCReset") \
+    X(LOG_VC_INVALID,         "Invalid VC state! %lu") \
+    X(LOG_COMMAND_HOME,       "CommandHome") \
+    X(LOG_MOTOR_HOMING_WAIT,  "motorHomingWait Elapsed time: %lu") \
+    X(LOG_COMMAND_ZERO,       "CommandZero") \
+    X(LOG_MOTOR_ZEROING_WAIT, "MotorZeroingWait Elapsed time: %lu") \
+    X(LOG_MOTOR_ZERO,         "motorZero") \
+    X(LOG_FAILURE_MODE,       "Failure Mode Error Code: %lu AC Mode State: %lu VC Mode State: %lu") \
+    X(LOG_MOTOR_INHALE,       "Motor Inhale Command position=%ld speed=%ld") \
+    X(LOG_MOTOR_EXHALE,       "Motor Exhale Command speed=%ld") \
+    X(LOG_PRESSURE_READING,   "Pressure sensor status changed, output: %lu pressure: %f") \
+    X(LOG_BREATH_TIMING,      "Breath timing error inhale=%ld plateau=%ld exhale=%ld us") \
+    X(LOG_BREATH_RATE,        "Breath period=%lu inspiratory=%lu us") \
+    X(LOG_ZEROING_INVALID,    "Invalid zeroing state! %lu") \
+    X(LOG_SETTINGS_APPLIED,   "Settings applied period=%lu ms inhale=%ld pulses") \
+    X(LOG_PATIENT_TRIGGER,    "Patient trigger latency=%lu us") \
+    X(LOG_SAFETY_STOP,        "Safety stop %lu latency=%lu us") \
+    X(LOG_BREATH_PRESSURES,   "Breath PIP=%f plateau=%f PEEP=%f cmH2O") \
+    X(LOG_BREATH_RATIOS,      "Breath mean=%f cmH2O rate=%f bpm I:E=%f") \
+    X(LOG_BREATH_MECHANICS,   "Breath compliance=%f mL/cmH2O resistance=%f cmH2O/L/s") \
+    X(LOG_FAILURE_STOPPED,    "Failure mode stop acknowledged after %lu stops") \
+    X(LOG_MOTOR_REFUSED,      "Motor command refused, link queue full, %lu refused")
+
+enum LogEvent : uint8_t {
+#define LOG_EVENT_ID(id, format) id,
+    LOG_EVENTS(LOG_EVENT_ID)
+#undef LOG_EVENT_ID
+    NUM_LOG_EVENTS
+};
+
+
+/* Store a record, or count a drop if the buffer is full. Use the LOG macros
+   rather than calling this directly.
+ */
+void log_write(const LogEvent event, const uint32_t *args, const uint8_t num_args);
+
+/* Move as many whole records as fit into the transmit buffer of out, without
+   waiting. Run periodically from the main loop.
+ */
+void log_flush(HardwareSerial &out);
+
+/* Records dropped because the buffer was full.
+ */
+uint16_t log_dropped();
+
+// Raw bits of a log argument.
+inline uint32_t log_arg(const int value)           { return (uint32_t)(long)value; }
+inline uint32_t log_arg(const unsigned int value)  { return value; }
+inline uint32_t log_arg(const long value)          { return (uint32_t)value; }
+inline uint32_t log_arg(const unsigned long value) { return (uint32_t)value; }
+inline uint32_t log_arg(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+#if SERIAL_DEBUG
+#define LOG(event) log_write(event, NULL, 0)
+#define LOG1(event, a) do { \
+        const uint32_t log_args_[] = {log_arg(a)}; \
+        log_write(event, log_args_, 1); \
+    } while (0)
+#define LOG2(event, a, b) do { \
+        const uint32_t log_args_[] = {log_arg(a), log_arg(b)}; \
+        log_write(event, log_args_, 2); \
+    } while (0)
+#define LOG3(event, a, b, c) do { \
+        const uint32_t log_args_[] = {log_arg(a), log_arg(b), log_arg(c)}; \
+        log_write(event, log_args_, 3); \
+    } while (0)
+#else
+// sizeof uses the arguments without evaluating them, so values kept only
+// for the log do not warn as unused.
+#define LOG(event) do {} while (0)
+#define LOG1(event, a) do { (void)sizeof(a); } while (0)
+#define LOG2(event, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define LOG3(event, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif //SERIAL_DEBUG
+
+#endif
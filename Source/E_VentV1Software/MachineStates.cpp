@@ -2,8 +2,9 @@
 #include "pressure.h"
 #include "breathing.h"
 #include "UserParameter.h"
-#include "pinAssignments.h"
+#include "PinAssignments.h"
 #include "Motor.h"
+#include "BreathMetrics.h"
 
 
 char machineStateCodeAssignment(machineStates machineState) {
@@ -27,47 +28,35 @@ VentilatorState get_init_state(void) {
 
     state.breath_time_start = millis();
     state.current_time = state.breath_time_start;
+    state.schedule.inhale_end = 0;
+    state.schedule.plateau_end = 0;
+    state.schedule.breath_end = 0;
 
     //Ventilation Primary Values -----------------------------------------------------------------------------
         //BPM
-    state.breaths_per_minute = DEFAULT_BPM; //1/MIN
+    state.settings.breaths_per_minute = BreathRate::from_float(DEFAULT_BPM); //1/MIN
         //Tidal Volume
-    state.tidal_volume = DEFAULT_TIDAL_VOLUME; //percentage (out of 100)
+    state.settings.tidal_volume = Percentage::from_float(DEFAULT_TIDAL_VOLUME); //percentage (out of 100)
 
     //Pressure Values -----------------------------------------------------------------------------------------
-    state.pressure = 0; //CM H2O; pressure sensing reading
-        //PIP Pressure
-    state.current_loop_peak_pressure = 0; //CM H2O; peak pressure of the current loop, running value
-    state.peak_pressure = 0; //CM H2O; measured PIP value
-        //PEEP Pressure
-    state.peep_pressure = 0; //CM H2O; measured PEEP value
-        //Plateau Pressure
-    state.plateau_pressure = 0; //CM H2O; measured plateau pressure value
+    state.pressure = Pressure::from_raw(0); //CM H2O; pressure sensing reading
+    state.pressure_slope = PressureRate::from_raw(0); //CM H2O/s
         //AC Mode Threshold Pressure
-    state.ac_threshold_pressure = DEFAULT_THRESHOLD_PRESSURE; //CM H2O; value below PEEP required to trigger a breath
+    state.settings.ac_threshold_pressure = Pressure::from_float(DEFAULT_THRESHOLD_PRESSURE); //CM H2O; value below PEEP required to trigger a breath
 
     //Timing Values--------------------------------------------------------------------------------------------
         //AC Mode Threshold Time
-     state.ac_threshold_time = 0; //seconds;
+     state.settings.ac_threshold_time = 0; //ms;
         //Plateau Pause Time
-     state.plateau_pause_time = DEFAULT_PLATEAU_PAUSE_TIME; //seconds;
+     state.settings.plateau_pause_time = seconds_to_ms(DEFAULT_PLATEAU_PAUSE_TIME); //ms;
         //Inspiration Time
-     state.inspiration_time = DEFAULT_INSPIRATION_TIME;
-        //Nominal expiration time
-     state.expiration_time = SECONDS_PER_MINUTE/state.breaths_per_minute - state.inspiration_time - state.plateau_pause_time;
-     
+     state.settings.inspiration_time = seconds_to_ms(DEFAULT_INSPIRATION_TIME); //ms;
 
     //Mechanism Values -----------------------------------------------------------------------------------------
         //Controller temperature
     state.controller_temperature = 0; //C?
-        //Distance of motor travel during inhale
-    state.motor_inhale_pulses = 0.01*DEFAULT_TIDAL_VOLUME*QP_AT_FULL_STROKE;
-        //Speed of motor during inhale
-    state.motor_inhale_speed = state.motor_inhale_pulses/state.inspiration_time; //QPPS
-       //Motor Return Time
-    state.motor_return_time = state.expiration_time*MOTOR_RETURN_FACTOR; //seconds;
-
-    state.motor_return_speed = state.motor_inhale_pulses/state.motor_return_time; //QPPS
+        //Expiration time, motor travel and speeds
+    update_motor_settings(state.settings, state.derived);
 
     state.future_motor_position = 0;
     state.current_motor_position = 0;
@@ -88,7 +77,17 @@ machineStates check_mode(void) {
 }
 
 void update_state(VentilatorState &state) {
-    state.pressure     = readPressureSensor();
+    FilteredPressure sample;
+
+    // Samples arrive from the TWI interrupt, already filtered. The breath
+    // metrics take every one, the state only the newest. Keep the last
+    // pressure if nothing new has come in.
+    while (getPressureSample(sample)) {
+        breath_metrics_sample(sample);
+        state.pressure = sample.pressure;
+        state.pressure_slope = sample.slope;
+    }
+
     state.current_time = millis();
 }
 
@@ -96,16 +95,50 @@ void reset_timer(VentilatorState &state) {
     state.breath_time_start = state.current_time;
 }
 
-void update_motor_settings(VentilatorState &state) {
+// Speed to cover pulses in time ms, 0 if there is no time.
+static long pulses_per_second(const long pulses, const uint16_t time) {
+    return time ? pulses*1000L/time : 0;
+}
+
+void update_motor_settings(const VentilatorSettings &settings, VentilatorDerived &derived) {
 
     //TODO: need to deal with invalid user input combinations
 
-    state.motor_inhale_pulses = 0.01*state.tidal_volume*QP_AT_FULL_STROKE;
-    state.motor_inhale_speed = state.motor_inhale_pulses/state.inspiration_time;
-    state.expiration_time = SECONDS_PER_MINUTE/state.breaths_per_minute - state.inspiration_time; //This can go negative
-    state.motor_return_time = state.expiration_time*MOTOR_RETURN_FACTOR;
-    state.motor_return_speed = state.motor_inhale_pulses/state.motor_return_time;
+    // All integer: tidal volume and BPM are Q8, times are ms.
+    derived.motor_inhale_pulses = (long)settings.tidal_volume.raw*(long)QP_AT_FULL_STROKE/(100L << 8);
+    derived.motor_inhale_speed = pulses_per_second(derived.motor_inhale_pulses, settings.inspiration_time);
+
+    long expiration_time = (long)breath_period(settings) - settings.inspiration_time - settings.plateau_pause_time; //This can go negative
+    derived.expiration_time = (expiration_time > 0) ? expiration_time : 0;
+
+    // Return speed from the return time before it is rounded to ms, which
+    // would lose up to 1% on the shortest returns.
+    uint32_t motor_return_time = (uint32_t)derived.expiration_time*MOTOR_RETURN_FACTOR_Q8;
+    derived.motor_return_time = motor_return_time >> 8;
+    derived.motor_return_speed = motor_return_time ? ((derived.motor_inhale_pulses*1000L) << 8)/motor_return_time : 0;
+
+}
+
+void stage_settings(StagedSettings &staged, const VentilatorSettings &settings) {
+    staged.settings = settings;
+    update_motor_settings(staged.settings, staged.derived);
+    staged.pending = true;
+}
+
+bool apply_staged_settings(StagedSettings &staged, VentilatorState &state) {
+    if (!staged.pending) {
+        return false;
+    }
+
+    state.settings = staged.settings;
+    state.derived = staged.derived;
+    staged.pending = false;
+    return true;
+}
 
+uint16_t breath_period(const VentilatorSettings &settings) {
+    // BPM is Q8.
+    return ((MS_PER_MINUTE << 8) + settings.breaths_per_minute.raw/2)/settings.breaths_per_minute.raw;
 }
 
 unsigned long elapsed_time(const VentilatorState &state) {
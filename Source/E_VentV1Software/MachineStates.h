@@ -10,10 +10,14 @@
 #include "WProgram.h"
 #endif
 
+#include <stddef.h>
+
+#include "FixedPoint.h"
+
 
 // Make sure each state has a character in machineStatesCodes
 // This is for debug information.
-enum machineStates {
+enum machineStates : uint8_t {
                     Startup,
                     StartupHold,
                     MotorZeroing,
@@ -28,7 +32,7 @@ enum machineStates {
 
    TODO: directions to state machine diagram.
  */
-enum acModeStates {
+enum acModeStates : uint8_t {
                    ACStart,
                    ACInhaleWait,
                    ACInhaleCommand,
@@ -45,7 +49,7 @@ enum acModeStates {
 
    TODO: directions to state machine diagram.
  */
-enum vcModeStates {
+enum vcModeStates : uint8_t {
                    VCStart,
                    VCInhale,
                    VCInhaleCommand,
@@ -60,7 +64,7 @@ enum vcModeStates {
 
    TODO: directions to state machine diagram.
  */
-enum zeroingStates {
+enum zeroingStates : uint8_t {
                     CommandHome,
                     MotorHomingWait,
                     CommandZero,
@@ -69,7 +73,50 @@ enum zeroingStates {
 };
 
 
-// Structure containing the full state of the ventilator.
+/* Settings the user chooses. These only change when a parameter is set.
+   Converted from the UserParameter floats by setStateParameters, so that
+   nothing past the UI needs float math. Times are whole milliseconds.
+ */
+struct VentilatorSettings {
+    BreathRate breaths_per_minute;  // 1/MIN
+    Percentage tidal_volume;        // Percentage (out of 100)
+    Pressure ac_threshold_pressure; // CM H2O; value below PEEP required to trigger a breath
+    uint16_t ac_threshold_time;     // ms
+    uint16_t plateau_pause_time;    // ms
+    uint16_t inspiration_time;      // ms
+};
+
+
+/* Values worked out from the settings by update_motor_settings, when they
+   are staged.
+ */
+struct VentilatorDerived {
+    uint16_t expiration_time;        // ms; nominal
+    long int motor_inhale_pulses;    // Distance of motor travel during inhale
+    long int motor_inhale_speed;     // QPPS
+    uint16_t motor_return_time;      // ms
+    long int motor_return_speed;     // QPPS
+};
+
+
+/* Where the phases of the breath in progress end, in ms since it started
+   at breath_time_start. Latched from the settings once per breath, by
+   breathStart and breathInhaleCommand, so a phase ends at a fixed time
+   however late the step before it ran.
+ */
+struct BreathSchedule {
+    uint16_t inhale_end;  // Inspiration and the motor inertia buffer
+    uint16_t plateau_end;
+    uint16_t breath_end;  // 60000 / BPM; the next breath starts here
+};
+
+
+/* Structure containing the full state of the ventilator.
+
+   The fields read and written on every step of the state machines come
+   first and are kept small, then the settings and the values derived from
+   them, which are only read while breathing.
+ */
 struct VentilatorState {
     machineStates machine_state;
 
@@ -80,59 +127,54 @@ struct VentilatorState {
     acModeStates ac_state;
     zeroingStates zeroing_state;
 
-    // Parameters
+    uint16_t errors;
+    uint16_t controller_temperature;
+
     // TODO: should we worry about overflow for these?
-    unsigned long breath_time_start; // When timer was started (ms).
+    unsigned long breath_time_start; // When the breath, or the timer, started (ms).
     unsigned long current_time;      // Current time (ms).
-
-    //TODO: consider naming
-
-    //Ventilation Primary Values -----------------------------------------------------------------------------
-        //BPM
-    float breaths_per_minute; //1/MIN
-        //Tidal Volume
-    float tidal_volume; //percentage (out of 100)
+    BreathSchedule schedule;
 
     //Pressure Values -----------------------------------------------------------------------------------------
-    float pressure; //CM H2O; pressure sensing reading
-        //PIP Pressure
-    float current_loop_peak_pressure; //CM H2O; peak pressure of the current loop, running value
-    float peak_pressure; //CM H2O; measured PIP value
-        //PEEP Pressure
-    float peep_pressure; //CM H2O; measured PEEP value
-        //Plateau Pressure
-    float plateau_pressure; //CM H2O; measured plateau pressure value
-        //AC Mode Threshold Pressure
-    float ac_threshold_pressure; //CM H2O; value below PEEP required to trigger a breath
-
-    //Timing Values--------------------------------------------------------------------------------------------
-        //AC Mode Threshold Time
-     float ac_threshold_time; //seconds;
-        //Plateau Pause Time
-     float plateau_pause_time; //seconds;
-        //Inspiration Time
-     float inspiration_time;
-        //Nominal expiration time
-     float expiration_time;
-     
+    Pressure pressure; //CM H2O; pressure sensing reading, filtered
+    PressureRate pressure_slope; //CM H2O/s; rate of change of pressure
+    // PIP, plateau and PEEP are measured per breath, see BreathMetrics.h
 
     //Mechanism Values -----------------------------------------------------------------------------------------
-    uint16_t controller_temperature;
+    long int future_motor_position;
+    long int current_motor_position;
 
-    float motor_inhale_pulses;
+    VentilatorSettings settings;
+    VentilatorDerived derived;
+};
 
-    float motor_inhale_speed;
-         //Motor Return Time
-    float motor_return_time; //seconds;
 
-    float motor_return_speed;
+/* Settings the user has set, and the values derived from them, waiting for
+   the end of the breath in progress. The UI stages a block when a
+   parameter is set, and apply_staged_settings swaps it into the state at
+   BreathLoopStart, so every breath runs on one set of settings, and the
+   derived values are worked out once per change rather than every pass.
+ */
+struct StagedSettings {
+    VentilatorSettings settings;
+    VentilatorDerived derived;
+    bool pending;
+};
 
-    long int future_motor_position;
 
-    long int current_motor_position;
+// Every state fits in a byte.
+static_assert(sizeof(machineStates) == 1 && sizeof(acModeStates) == 1
+              && sizeof(vcModeStates) == 1 && sizeof(zeroingStates) == 1,
+              "state enums must be one byte");
 
-    uint16_t errors;
-};
+#ifdef __AVR__
+// SRAM budget for the state on the Mega, which has 8 KB in all for the
+// sample buffers, telemetry and log. Think before raising these.
+static_assert(offsetof(VentilatorState, settings) <= 42, "hot part of VentilatorState over budget");
+static_assert(sizeof(VentilatorSettings) <= 12, "VentilatorSettings over budget");
+static_assert(sizeof(VentilatorDerived) <= 16, "VentilatorDerived over budget");
+static_assert(sizeof(VentilatorState) <= 72, "VentilatorState over budget");
+#endif
 
 
 // Bools for mode.
@@ -166,7 +208,9 @@ VentilatorState get_init_state(void);
 machineStates check_mode(void);
 
 
-/* Update state with current time + pressure readings.
+/* Update state with current time + the newest buffered pressure sample,
+   filtered, and its slope, and pass every buffered sample on to the breath
+   metrics. Does not block on the pressure sensor.
  */
 void update_state(VentilatorState &state);
 
@@ -175,10 +219,30 @@ void update_state(VentilatorState &state);
  */
 void reset_timer(VentilatorState &state);
 
-void update_motor_settings(VentilatorState &state);
+/* Work out the expiration time, motor travel and speeds for settings.
+ */
+void update_motor_settings(const VentilatorSettings &settings, VentilatorDerived &derived);
+
+
+/* Stage settings to be applied at the start of the next breath, replacing
+   any staged before.
+ */
+void stage_settings(StagedSettings &staged, const VentilatorSettings &settings);
+
+
+/* Swap staged settings into state, if there are any. Only call between
+   breaths. Returns true if settings were applied.
+ */
+bool apply_staged_settings(StagedSettings &staged, VentilatorState &state);
+
+
+/* Length of a breath in ms, 60000 / BPM rounded.
+ */
+uint16_t breath_period(const VentilatorSettings &settings);
 
 
-/* Get elapsed time in ms.
+/* Get elapsed time in ms. Correct across the wrap of millis(), as long as
+   the timer is restarted at least every 49 days.
  */
 unsigned long elapsed_time(const VentilatorState &state);
 
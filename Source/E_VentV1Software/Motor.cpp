@@ -3,87 +3,210 @@
 
 #include "alarms.h"
 #include "conversions.h"
+#include "Log.h"
+
+
+//Latest readings from the motor controller, filled in by MotorLink callbacks
+
+static MotorTelemetry telemetry;
+static bool telemetryPending = false;
+static uint8_t telemetryNext = 0;
+static bool positionRequested = false;
+
+//MotorLink runs transactions in the order they were queued, so numbering motion commands and
+//reads as they are queued tells which readings were taken after the motor was last commanded.
+static uint32_t linkSequence = 0;
+static uint32_t motionSequence = 0;      //Last motion or encoder reset command
+static uint32_t telemetrySequence = 0;   //Telemetry read in flight
+static uint32_t positionRequestSequence = 0;
+static uint32_t positionSequence = 0;    //Read that gave telemetry.position
+static uint32_t speedSequence = 0;       //Read that gave telemetry.speed
+
+static uint16_t motionRefused = 0;      //Motion commands the link had no room for
+
+//A refused move leaves the motor somewhere other than where the breath expects it,
+//so it is not retried a step late but raised as a device failure by checkMotorStatus.
+static void motionQueued(bool queued) {
+	if (queued) {
+		motionSequence = ++linkSequence;
+	}
+	else {
+		motionRefused++;
+		LOG1(LOG_MOTOR_REFUSED, motionRefused);
+	}
+}
+
+static void positionReceived(bool valid, const uint8_t *data, uint8_t length) {
+	positionRequested = false;
+	if (valid) {
+		telemetry.position = (long int) RoboClawCodec::get32(data);
+		telemetry.position_time = millis();
+		positionSequence = positionRequestSequence;
+	}
+}
+
+static void encodersReceived(bool valid, const uint8_t *data, uint8_t length) {
+	telemetryPending = false;
+	if (valid) {
+		telemetry.position = (long int) RoboClawCodec::get32(data);
+		telemetry.position_time = millis();
+		positionSequence = telemetrySequence;
+	}
+}
+
+static void speedsReceived(bool valid, const uint8_t *data, uint8_t length) {
+	telemetryPending = false;
+	if (valid) {
+		telemetry.speed = (long int) RoboClawCodec::get32(data);
+		telemetry.speed_time = millis();
+		speedSequence = telemetrySequence;
+	}
+}
+
+static void currentsReceived(bool valid, const uint8_t *data, uint8_t length) {
+	telemetryPending = false;
+	if (valid) {
+		telemetry.current = (int16_t) RoboClawCodec::get16(data);
+		telemetry.current_time = millis();
+	}
+}
+
+static void temperatureReceived(bool valid, const uint8_t *data, uint8_t length) {
+	telemetryPending = false;
+	if (valid) {
+		telemetry.temperature = RoboClawCodec::get16(data);
+		telemetry.temperature_time = millis();
+	}
+}
+
+static void errorReceived(bool valid, const uint8_t *data, uint8_t length) {
+	telemetryPending = false;
+	if (valid) {
+		telemetry.error = RoboClawCodec::get32(data);
+		telemetry.error_time = millis();
+	}
+}
+
+
+//Telemetry Functions
+
+void pollMotorTelemetry(MotorLink &controller_name) {
+	if (telemetryPending) {
+		return;
+	}
+
+	//One read at a time, so motion commands never wait behind more than one reply.
+	//Encoders, speeds and currents come back for both motors at once, motor 1 first.
+	switch (telemetryNext) {
+	case 0:
+		telemetryPending = controller_name.queueRead(MOTOR_ADDRESS, RoboClaw::GETENCODERS, 8, encodersReceived);
+		break;
+	case 1:
+		telemetryPending = controller_name.queueRead(MOTOR_ADDRESS, RoboClaw::GETISPEEDS, 8, speedsReceived);
+		break;
+	case 2:
+		telemetryPending = controller_name.queueRead(MOTOR_ADDRESS, RoboClaw::GETCURRENTS, 4, currentsReceived);
+		break;
+	case 3:
+		telemetryPending = controller_name.ReadTemp(MOTOR_ADDRESS, temperatureReceived);
+		break;
+	default:
+		telemetryPending = controller_name.queueRead(MOTOR_ADDRESS, RoboClaw::GETERROR, 4, errorReceived);
+		break;
+	}
+
+	if (telemetryPending) {
+		telemetrySequence = ++linkSequence;
+		telemetryNext = (telemetryNext + 1) % MOTOR_TELEMETRY_READS;
+	}
+}
+
+const MotorTelemetry &getMotorTelemetry() {
+	return telemetry;
+}
+
+unsigned long motorTelemetryAge(const unsigned long reading_time) {
+	return millis() - reading_time;
+}
 
 
 //Helper Functions
 
-void setMotorZero(RoboClaw &controller_name) {
-	controller_name.SetEncM1(MOTOR_ADDRESS, 0);
+void setMotorZero(MotorLink &controller_name) {
+	motionQueued(controller_name.SetEncM1(MOTOR_ADDRESS, 0));
 }
 
-long int readPosition(RoboClaw &controller_name) {
-  Serial.println("read position");
-	long int pos = controller_name.ReadEncM1(MOTOR_ADDRESS);
-  Serial.println(pos);
-  return pos;
+long int readPosition(MotorLink &controller_name) {
+	if (!positionRequested) {
+		positionRequested = controller_name.ReadEncM1(MOTOR_ADDRESS, positionReceived);
+		if (positionRequested) {
+			positionRequestSequence = ++linkSequence;
+		}
+	}
+	return telemetry.position;
 }
 
 
-void commandStop(RoboClaw &controller_name) {
-	controller_name.SpeedDistanceM1(MOTOR_ADDRESS, 0, 0, 1); //Stop motion
+void commandStop(MotorLink &controller_name) {
+	motionQueued(controller_name.SpeedDistanceM1(MOTOR_ADDRESS, 0, 0, 1)); //Stop motion
 }
 
 
 //Command Functions
 
-void commandMotorHoming(RoboClaw &controller_name) {
+void commandMotorHoming(MotorLink &controller_name) {
 	//command motor to move outwards
-	controller_name.SpeedM1(MOTOR_ADDRESS, MOTOR_HOMING_SPEED);
+	motionQueued(controller_name.SpeedM1(MOTOR_ADDRESS, MOTOR_HOMING_SPEED));
 }
 
 
 
-VentilatorState commandMotorZero(RoboClaw &controller_name, VentilatorState state) {
+void commandMotorZero(MotorLink &controller_name, VentilatorState &state) {
 	//Stop motion
 	commandStop(controller_name);
+	controller_name.waitIdle(MOTOR_LINK_WAIT_TIMEOUT);
 
 	//Make sure the motor has come to a stop
 	delay((HOMING_BUFFER*S_TO_MS));
 
+	//Need the position after the stop, not a cached one. Zeroing only.
+	readPosition(controller_name);
+	controller_name.waitIdle(MOTOR_LINK_WAIT_TIMEOUT);
+
 	state.current_motor_position = readPosition(controller_name);
 	state.future_motor_position = state.current_motor_position + QP_TO_ZEROPOINT;
 	//Move to zeropoint
-	controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, MOTOR_ZEROING_SPEED, DECCEL, QP_TO_ZEROPOINT, 1);
-
-	return state;
+	motionQueued(controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, MOTOR_ZEROING_SPEED, DECCEL, QP_TO_ZEROPOINT, 1));
 }
 
-VentilatorState commandInhale(RoboClaw &controller_name, VentilatorState state) { 
-  #ifdef SERIAL_DEBUG
-    Serial.println("Motor Inhale Command");
-  #endif
+void commandInhale(MotorLink &controller_name, VentilatorState &state) { 
+	long int desired_position = (long int) state.derived.motor_inhale_pulses;
+	long int desired_speed = state.derived.motor_inhale_speed;
 
-	long int desired_position = (long int) state.motor_inhale_pulses;
-	long int desired_speed = (long int) desired_position/state.inspiration_time;
+	LOG2(LOG_MOTOR_INHALE, desired_position, desired_speed);
 
 	//Update expected location
 	state.future_motor_position = desired_position;
 
-	controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, desired_speed, DECCEL, desired_position, 1);
-
-	return state;
+	motionQueued(controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, desired_speed, DECCEL, desired_position, 1));
 }
 
-VentilatorState commandExhale(RoboClaw &controller_name, VentilatorState state) {
-  #ifdef SERIAL_DEBUG
-    Serial.println("Motor Exhale Command");
-  #endif
-
+void commandExhale(MotorLink &controller_name, VentilatorState &state) {
 	long int desired_position = 0;
-	long int desired_speed = (long int) state.motor_return_speed;
+	long int desired_speed = (long int) state.derived.motor_return_speed;
+
+	LOG1(LOG_MOTOR_EXHALE, desired_speed);
 
 	//Update expected location
 	state.future_motor_position = 0;
 
 	//Change sign of speed to travel backwards
-	controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, desired_speed, DECCEL, desired_position, 1);
-
-	return state;
+	motionQueued(controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, desired_speed, DECCEL, desired_position, 1));
 }
 
-VentilatorState commandInhaleAbort(RoboClaw &controller_name, VentilatorState state) {
+void commandInhaleAbort(MotorLink &controller_name, VentilatorState &state) {
 	
-	long int desired_speed = (long int) state.motor_return_speed;
+	long int desired_speed = (long int) state.derived.motor_return_speed;
 	//Stop Motion
 	commandStop(controller_name);
 	//Read Current Location
@@ -91,151 +214,31 @@ VentilatorState commandInhaleAbort(RoboClaw &controller_name, VentilatorState st
 	state.future_motor_position = 0;
 
 	//Command a return to zero
-	controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, desired_speed, DECCEL, desired_position, 1);
-
-	return state;
-}
-
-VentilatorState checkMotorStatus(RoboClaw &controller_name, VentilatorState state) {
-
-  Serial.println("check motor status");
-
-	//Check current position
-	state.current_motor_position = readPosition(controller_name);
-
-	state.errors |= check_motor_position(state.current_motor_position, state.future_motor_position);
- 
-	controller_name.ReadTemp(MOTOR_ADDRESS, state.controller_temperature);
-	state.errors |= check_controller_temperature(state.controller_temperature);	
-
-	
-  Serial.println("exit check motor status");
-	return state;
-}
-
-
-
-//State Machine Functions
-
-VentilatorState handle_ACMode(RoboClaw &controller_name, VentilatorState state) {
-
-  Serial.println("Motor ac mode handle");
-	
-	switch(state.ac_state) {
-	case ACStart:
-		//no action required
-		break;
-	case ACInhaleWait:
-		//no action required
-		break;
-	case ACInhaleCommand:
-		return commandInhale(controller_name, state);
-	case ACInhale:
-		//no action required
-		break;
-	case ACInhaleAbort:
-		return commandInhaleAbort(controller_name, state);
-	case ACPeak:
-		return checkMotorStatus(controller_name, state);
-	case ACExhaleCommand:
-		return commandExhale(controller_name, state);
-	case ACExhale:
-		//no action required
-	case ACReset:
-		return checkMotorStatus(controller_name, state);
-	default:
-		//Should not happen
-		break;
-	}
-	return state;
+	motionQueued(controller_name.SpeedAccelDeccelPositionM1(MOTOR_ADDRESS, ACCEL, desired_speed, DECCEL, desired_position, 1));
 }
 
-VentilatorState handle_VCMode(RoboClaw &controller_name, VentilatorState state) {
+void checkMotorStatus(MotorLink &controller_name, VentilatorState &state) {
+	//Only looks at the cached telemetry, pollMotorTelemetry keeps it fresh
+	const MotorTelemetry &motor = getMotorTelemetry();
 
-  Serial.println("Motor vc mode handle");
-
-		switch(state.vc_state) {
-	case VCStart:
-		//no action required
-		break;
-	case VCInhaleCommand:
-		return commandInhale(controller_name, state);
-	case VCInhale:
-		//no action required
-		break;
-	case VCInhaleAbort:
-		return commandInhaleAbort(controller_name, state);
-	case VCPeak:
-		return checkMotorStatus(controller_name, state);
-	case VCExhaleCommand:
-		return commandExhale(controller_name, state);
-	case VCExhale:
-		//no action required
-	case VCReset:
-		return checkMotorStatus(controller_name, state);
-	default:
-		//Should not happen
-		break;
+	//Check current position. The motor is still moving at the start of the peak and all
+	//through the exhale, so it only has to be where it was sent once a speed read queued
+	//after the last motion command shows it stopped, going by a position read queued after that.
+	state.current_motor_position = motor.position;
+	if (0 == motor.speed && speedSequence > motionSequence && positionSequence > speedSequence) {
+		state.errors |= check_motor_position(state.current_motor_position, state.future_motor_position);
 	}
+	state.errors |= check_telemetry_age(motorTelemetryAge(motor.position_time));
+	state.errors |= check_telemetry_age(motorTelemetryAge(motor.speed_time));
 
-	return state;
-}
+	state.controller_temperature = motor.temperature;
+	state.errors |= check_controller_temperature(state.controller_temperature);
+	state.errors |= check_telemetry_age(motorTelemetryAge(motor.temperature_time));
 
-VentilatorState handle_MotorZeroing(RoboClaw &controller_name, VentilatorState state) {
-  Serial.println("Motor zeroing handle");
+	state.errors |= check_controller_error(motor.error);
+	state.errors |= check_telemetry_age(motorTelemetryAge(motor.error_time));
 
-	switch(state.zeroing_state) {
-	case CommandHome:
-		commandMotorHoming(controller_name);
-		break;
-	case MotorHomingWait:
-		//no action required
-		break;
-	case CommandZero:
-		return commandMotorZero(controller_name, state);		
-	case MotorZeroingWait:
-		//no action required
-		break;
-	case MotorZero:
-		state = checkMotorStatus(controller_name, state);
-		setMotorZero(controller_name);
-		return state;
-	default:
-		//Should not happen
-		break;
+	if (motionRefused) {
+		state.errors |= DEVICE_FAILURE_ALARM;
 	}
-
-	return state;
-}
-
-
-
-VentilatorState handle_motor(RoboClaw &controller_name, VentilatorState state) {
-  Serial.println("Motor handle");
-
-	switch(state.machine_state) {
-	case Startup:
-		//should not happen
-		break;
-	case StartupHold:
-		//Should not happen
-		break;
-	case MotorZeroing:
-		return handle_MotorZeroing(controller_name, state);
-	case BreathLoopStart:
-		//No action required
-		break;
-	case ACMode:
-		return handle_ACMode(controller_name, state);
-	case VCMode:
-		return handle_VCMode(controller_name, state);
-	case FailureMode:
-		commandStop(controller_name);
-		break;
-	default:
-		//should not happen
-		break;
-	}
-
-	return state;
 }
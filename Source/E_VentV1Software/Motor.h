@@ -1,64 +1,107 @@
 #ifndef Motor_h
 #define Motor_h
 
-#define SERIAL_DEBUG
 
-
-#include "RoboClaw.h"
+#include "MotorLink.h"
 #include "MachineStates.h"
+#include "conversions.h"
 
 //Motor Constants specific to the motor
 //const float QPPR = 17700.6; //Quadrature pulses per revolution
 
 const long int QP_TO_ZEROPOINT = 50; //Quadrature pulses from limit switch to bag edge
 //const long int POSITION_TOLERANCE = 2; //Removing this for the time being
-const float QP_AT_FULL_STROKE = 500; //Quadrature pulses at 100% TV that occurs from zeropoint
-const float MOTOR_RETURN_FACTOR = 0.25; // Percent of nominal exalation time used to return the motor to zeropoint
+constexpr float QP_AT_FULL_STROKE = 500; //Quadrature pulses at 100% TV that occurs from zeropoint
+constexpr float MOTOR_RETURN_FACTOR = 0.25; // Percent of nominal exalation time used to return the motor to zeropoint
+const uint16_t MOTOR_RETURN_FACTOR_Q8 = MOTOR_RETURN_FACTOR*256; //The same, out of 256 for integer math
 const int MOTOR_ZEROING_SPEED = 50;
 const int MOTOR_HOMING_SPEED = -1*MOTOR_ZEROING_SPEED; //QPPS for homing
 const long int ACCEL = 500000;
 const long int DECCEL = 500000;
 
-const uint16_t MAX_CONTROLLER_TEMPERATURE = 60;//Set to 50C
-
-const int MOTOR_CONTROLLER_TIMEOUT = 10000;
-
-const float INERTIA_BUFFER = 0.02; //Seconds; The motor has inertia, we allow extra time for it too start and stop
-const float HOMING_BUFFER = 1.0; //Seconds
-
+const uint16_t MAX_CONTROLLER_TEMPERATURE = 600; //0.1C, as the controller reports it, so 60C
 
-#define MOTOR_ADDRESS 0x80 //Set on the RoboClaw controller via Basic Micro Motion Studio
+//Controller error word bits that stop the ventilator: E-Stop, temperature, main voltage high,
+//logic voltage high/low, M1 driver fault, M1 speed, M1 position and M1 current. See ReadError
+//in the RoboClaw user manual, the remaining bits are warnings or belong to M2.
+const uint32_t MOTOR_CONTROLLER_FAULTS = 0x157B;
 
-void setMotorZero(RoboClaw &controller_name);
+const uint8_t MOTOR_TELEMETRY_READS = 5; //Reads that make up a full snapshot, one queued per poll
+const unsigned long MOTOR_TELEMETRY_MAX_AGE = 250; //ms; older readings raise a device failure
 
-long int readPosition(RoboClaw &controller_name);
+const int MOTOR_CONTROLLER_TIMEOUT = 10000; //us, per try
+const long MOTOR_CONTROLLER_BAUD = 38400; //Packet serial baud rate set in Basic Micro Motion Studio
+const long MOTOR_CONTROLLER_FAST_BAUD = 115200; //Negotiated at startup, falls back to MOTOR_CONTROLLER_BAUD
 
-void commandStop(RoboClaw &controller_name);
+//Longest a blocking wait on the motor link should take, for setup and zeroing only
+const unsigned long MOTOR_LINK_WAIT_TIMEOUT = 4UL*MOTOR_CONTROLLER_TIMEOUT*(MOTOR_LINK_MAX_RETRY + 1);
 
-//Command Functions
-
-void commandMotorHoming(RoboClaw &controller_name);
+constexpr float INERTIA_BUFFER = 0.02; //Seconds; The motor has inertia, we allow extra time for it too start and stop
+const unsigned long INERTIA_BUFFER_MS = seconds_to_ms(INERTIA_BUFFER);
+const float HOMING_BUFFER = 1.0; //Seconds
 
-VentilatorState commandMotorZero(RoboClaw &controller_name, VentilatorState state);
 
-VentilatorState commandInhale(RoboClaw &controller_name, VentilatorState state);
+#define MOTOR_ADDRESS 0x80 //Set on the RoboClaw controller via Basic Micro Motion Studio
 
-VentilatorState commandExhale(RoboClaw &controller_name, VentilatorState state);
+/* Latest readings from the motor controller. Each group of readings carries
+   the millis() time it arrived, so that stale data can be told apart from
+   good data. A time of 0 means that reading has not arrived yet.
+ */
+struct MotorTelemetry {
+    long int position;              //QP, encoder 1
+    long int speed;                 //QPPS, instantaneous speed of motor 1
+    int16_t current;                //10mA, motor 1
+    uint16_t temperature;           //0.1C
+    uint32_t error;                 //Controller error word
+
+    unsigned long position_time;    //ms
+    unsigned long speed_time;       //ms
+    unsigned long current_time;     //ms
+    unsigned long temperature_time; //ms
+    unsigned long error_time;       //ms
+};
+
+/* Queue the next telemetry read, unless the previous one is still
+   outstanding. Cycles through all MOTOR_TELEMETRY_READS reads, so each
+   reading refreshes at 1/MOTOR_TELEMETRY_READS of the call rate. Only
+   queues on the MotorLink; the replies are parsed by poll().
+ */
+void pollMotorTelemetry(MotorLink &controller_name);
+
+/* The latest snapshot. Never touches the UART.
+ */
+const MotorTelemetry &getMotorTelemetry();
+
+/* Milliseconds since a reading with the given time arrived.
+ */
+unsigned long motorTelemetryAge(const unsigned long reading_time);
+
+void setMotorZero(MotorLink &controller_name);
+
+/* Returns the last motor position reported by the controller, and requests
+   a new one if none is outstanding. Does not wait for the reply.
+ */
+long int readPosition(MotorLink &controller_name);
+
+void commandStop(MotorLink &controller_name);
 
-VentilatorState commandInhaleAbort(RoboClaw &controller_name, VentilatorState state);
+//Command Functions
 
-VentilatorState checkMotorStatus(RoboClaw &controller_name, VentilatorState state);
+void commandMotorHoming(MotorLink &controller_name);
 
+void commandMotorZero(MotorLink &controller_name, VentilatorState &state);
 
+void commandInhale(MotorLink &controller_name, VentilatorState &state);
 
-//State Machine Functions
+void commandExhale(MotorLink &controller_name, VentilatorState &state);
 
-VentilatorState handle_ACMode(RoboClaw &controller_name, VentilatorState state);
+void commandInhaleAbort(MotorLink &controller_name, VentilatorState &state);
 
-VentilatorState handle_VCMode(RoboClaw &controller_name, VentilatorState state);
+/* Raises alarms from the cached telemetry, and a device failure once any
+   motion command has been refused for want of room on the link.
+ */
+void checkMotorStatus(MotorLink &controller_name, VentilatorState &state);
 
-VentilatorState handle_MotorZeroing(RoboClaw &controller_name, VentilatorState state);
 
-VentilatorState handle_motor(RoboClaw &controller_name, VentilatorState state);
 
 #endif
@@ -0,0 +1,456 @@
+#include "MotorLink.h"
+
+
+// Filled in by probeReceived during negotiateBaud.
+static bool probeValid = false;
+static uint16_t probeConfig = 0;
+
+
+static void probeReceived(bool valid, const uint8_t *data, uint8_t length) {
+    probeValid = valid;
+    if (valid) {
+        probeConfig = RoboClawCodec::get16(data);
+    }
+}
+
+
+MotorLink::MotorLink(HardwareSerial *serial, uint32_t timeout)
+    : serial(serial), timeout(timeout), head(0), count(0), next_sequence(0), in_flight(false), tries(0),
+      sent_at(0), crc(0), received(0), stop_length(0), stop_acknowledged(NULL), writing(false),
+      stop_requested(false), stop_sent(false), stop_since(0), stop_sequence(0) {
+    resetStats();
+}
+
+
+void MotorLink::begin(long speed) {
+    // Let anything still in the transmit buffer go out at the old speed.
+    serial->flush();
+    serial->begin(speed);
+}
+
+
+bool MotorLink::probe(uint8_t address, long speed) {
+    begin(speed);
+
+    probeValid = false;
+    GetConfig(address, probeReceived);
+    waitIdle(timeout * (MOTOR_LINK_MAX_RETRY + 2));
+
+    return probeValid;
+}
+
+
+long MotorLink::negotiateBaud(uint8_t address, long speed, long fastSpeed) {
+    uint16_t baud = RoboClawCodec::baudConfig(fastSpeed);
+
+    if (ROBOCLAW_BAUD_INVALID == baud) {
+        begin(speed);
+        return speed;
+    }
+
+    // The controller keeps the faster speed when only the Arduino restarts.
+    if (probe(address, fastSpeed)) {
+        return fastSpeed;
+    }
+
+    if (!probe(address, speed)) {
+        return speed;
+    }
+
+    // The controller switches speed as soon as it takes the new
+    // configuration, so the acknowledgement may be lost.
+    SetConfig(address, (probeConfig & ~ROBOCLAW_CONFIG_BAUD_MASK) | baud);
+    waitIdle(timeout * (MOTOR_LINK_MAX_RETRY + 2));
+
+    if (probe(address, fastSpeed)) {
+        return fastSpeed;
+    }
+
+    begin(speed);
+    return speed;
+}
+
+
+uint8_t *MotorLink::reserve(uint8_t keep) {
+    if (count + keep >= MOTOR_LINK_QUEUE_SIZE) {
+        link_stats.dropped++;
+        return NULL;
+    }
+
+    return transactions[head].packet;
+}
+
+
+bool MotorLink::commit(uint8_t length, uint8_t replyLength, MotorReplyCallback callback) {
+    Transaction &transaction = transactions[head];
+
+    transaction.packet_length = length;
+    transaction.reply_length = replyLength;
+    transaction.callback = callback;
+    // Only read by stopNow, so no need to disable interrupts.
+    transaction.sequence = next_sequence++;
+
+    head = (head + 1) % MOTOR_LINK_QUEUE_SIZE;
+    count++;
+    link_stats.queued++;
+
+    return true;
+}
+
+
+bool MotorLink::queueWrite(uint8_t address, uint8_t cmd, const uint8_t *payload, uint8_t length,
+                           MotorReplyCallback callback) {
+    if (length + 4 > MOTOR_LINK_MAX_PACKET) {
+        link_stats.dropped++;
+        return false;
+    }
+
+    uint8_t *frame = reserve();
+    return frame && commit(RoboClawCodec::Write(frame, address, cmd, payload, length), 0, callback);
+}
+
+
+bool MotorLink::queueRead(uint8_t address, uint8_t cmd, uint8_t replyLength, MotorReplyCallback callback) {
+    if (replyLength > MOTOR_LINK_MAX_REPLY) {
+        link_stats.dropped++;
+        return false;
+    }
+
+    uint8_t *frame = reserve(MOTOR_LINK_READ_RESERVE);
+    return frame && commit(RoboClawCodec::Read(frame, address, cmd), replyLength, callback);
+}
+
+
+bool MotorLink::SpeedM1(uint8_t address, uint32_t speed) {
+    uint8_t *frame = reserve();
+    return frame && commit(RoboClawCodec::SpeedM1(frame, address, speed), 0, NULL);
+}
+
+
+bool MotorLink::SpeedDistanceM1(uint8_t address, uint32_t speed, uint32_t distance, uint8_t flag) {
+    uint8_t *frame = reserve();
+    return frame && commit(RoboClawCodec::SpeedDistanceM1(frame, address, speed, distance, flag), 0, NULL);
+}
+
+
+bool MotorLink::SpeedAccelDeccelPositionM1(uint8_t address, uint32_t accel, uint32_t speed,
+                                           uint32_t deccel, uint32_t position, uint8_t flag) {
+    uint8_t *frame = reserve();
+    return frame && commit(RoboClawCodec::SpeedAccelDeccelPositionM1(frame, address, accel, speed, deccel, position, flag),
+                           0, NULL);
+}
+
+
+bool MotorLink::SetEncM1(uint8_t address, int32_t val) {
+    uint8_t *frame = reserve();
+    return frame && commit(RoboClawCodec::SetEncM1(frame, address, val), 0, NULL);
+}
+
+
+bool MotorLink::SetConfig(uint8_t address, uint16_t config, MotorReplyCallback callback) {
+    uint8_t *frame = reserve();
+    return frame && commit(RoboClawCodec::SetConfig(frame, address, config), 0, callback);
+}
+
+
+bool MotorLink::ReadEncM1(uint8_t address, MotorReplyCallback callback) {
+    // Encoder count followed by a status byte.
+    return queueRead(address, RoboClaw::GETM1ENC, 5, callback);
+}
+
+
+bool MotorLink::ReadTemp(uint8_t address, MotorReplyCallback callback) {
+    return queueRead(address, RoboClaw::GETTEMP, 2, callback);
+}
+
+
+bool MotorLink::GetConfig(uint8_t address, MotorReplyCallback callback) {
+    return queueRead(address, RoboClaw::GETCONFIG, 2, callback);
+}
+
+
+uint8_t MotorLink::tail() const {
+    return (head + MOTOR_LINK_QUEUE_SIZE - count) % MOTOR_LINK_QUEUE_SIZE;
+}
+
+
+bool MotorLink::send() {
+    const Transaction &transaction = transactions[tail()];
+    bool sent = false;
+
+    // Set before anything is looked at, so that a stopNow from here on
+    // waits for the packet rather than going out ahead of it, where the
+    // packet would override it.
+    writing = true;
+
+    // Only hand over whole packets, so that write() never waits for room.
+    // A packet that has not started yet when a stop comes in was decided
+    // on before it, and is dropped with the rest of the queue.
+    if (serial->availableForWrite() >= transaction.packet_length && !stop_requested) {
+        // Anything left over from an earlier reply would be parsed as this one.
+        while (serial->available()) {
+            serial->read();
+        }
+
+        serial->write(transaction.packet, transaction.packet_length);
+        sent = true;
+    }
+
+    // A stop that came in while the packet was being handed over goes
+    // straight after it.
+    cli();
+    writing = false;
+    if (stop_requested) {
+        writeStop();
+    }
+    sei();
+
+    if (!sent) {
+        return false;
+    }
+
+    // The reply CRC covers the address and command as well as the data.
+    crc = RoboClawCodec::crc(transaction.packet, 2);
+    received = 0;
+    sent_at = micros();
+    in_flight = true;
+    tries++;
+
+    return true;
+}
+
+
+void MotorLink::finish(bool valid) {
+    const Transaction &transaction = transactions[tail()];
+    MotorReplyCallback callback = transaction.callback;
+    uint8_t reply_length = transaction.reply_length;
+
+    if (valid) {
+        link_stats.completed++;
+        link_stats.last_rtt = micros() - sent_at;
+        if (link_stats.last_rtt > link_stats.max_rtt) {
+            link_stats.max_rtt = link_stats.last_rtt;
+        }
+    }
+    else {
+        link_stats.failed++;
+    }
+
+    // Free the slot before the callback, so it can queue more work.
+    in_flight = false;
+    tries = 0;
+    count--;
+
+    if (callback) {
+        callback(valid, reply, valid ? reply_length : 0);
+    }
+}
+
+
+void MotorLink::receive(uint8_t data) {
+    const Transaction &transaction = transactions[tail()];
+    bool valid;
+
+    if (0 == transaction.reply_length) {
+        valid = (MOTOR_LINK_ACK == data);
+    }
+    else {
+        reply[received++] = data;
+
+        if (received <= transaction.reply_length) {
+            crc = roboclaw_crc_update(crc, data);
+            return;
+        }
+
+        if (received < transaction.reply_length + 2) {
+            return;
+        }
+
+        uint16_t reply_crc = RoboClawCodec::get16(&reply[transaction.reply_length]);
+        valid = (reply_crc == crc);
+    }
+
+    if (valid) {
+        finish(true);
+        return;
+    }
+
+    link_stats.crc_failures++;
+    in_flight = false;
+
+    if (tries > MOTOR_LINK_MAX_RETRY) {
+        finish(false);
+    }
+    else {
+        link_stats.retries++;
+    }
+}
+
+
+void MotorLink::prepareStop(uint8_t address, MotorReplyCallback acknowledged) {
+    stop_length = RoboClawCodec::SpeedDistanceM1(stop_frame, address, 0, 0, 1);
+    stop_acknowledged = acknowledged;
+}
+
+
+// With interrupts disabled, or from an interrupt.
+void MotorLink::writeStop() {
+    serial->write(stop_frame, stop_length);
+
+    stop_requested = false;
+    stop_sent = true;
+
+    unsigned long latency = micros() - stop_since;
+    link_stats.stops++;
+    link_stats.last_stop_latency = latency;
+    if (latency > link_stats.max_stop_latency) {
+        link_stats.max_stop_latency = latency;
+    }
+}
+
+
+// With interrupts disabled, or from an interrupt.
+void MotorLink::stopNow(unsigned long since) {
+    if (!stop_length) {
+        return;
+    }
+
+    stop_since = since;
+    stop_sequence = next_sequence;
+    if (writing) {
+        // Interrupted send(), which writes the stop once its packet is in.
+        stop_requested = true;
+    }
+    else {
+        writeStop();
+    }
+}
+
+
+// Everything queued before a stop was decided on before it.
+void MotorLink::dropQueued() {
+    cli();
+    stop_sent = false;
+    uint8_t stop = stop_sequence;
+    sei();
+
+    // The reply to a transaction in flight is thrown away by the next send(),
+    // and one queued after the stop is sent again.
+    in_flight = false;
+    tries = 0;
+
+    while (count && (int8_t)(stop - transactions[tail()].sequence) > 0) {
+        finish(false);
+    }
+
+    if (count >= MOTOR_LINK_QUEUE_SIZE) {
+        link_stats.dropped++;
+        return;
+    }
+
+    // Again, ahead of everything queued since, so that it is acknowledged
+    // without undoing them. A stop after this one drops it.
+    count++;
+    link_stats.queued++;
+
+    Transaction &transaction = transactions[tail()];
+    memcpy(transaction.packet, stop_frame, stop_length);
+    transaction.packet_length = stop_length;
+    transaction.reply_length = 0;
+    transaction.callback = stop_acknowledged;
+    transaction.sequence = stop - 1;
+}
+
+
+void MotorLink::poll() {
+    unsigned long start = micros();
+
+    if (stop_sent) {
+        dropQueued();
+    }
+
+    if (in_flight) {
+        // Bounded by the size of the receive buffer.
+        while (in_flight && serial->available()) {
+            receive(serial->read());
+        }
+
+        if (in_flight && (micros() - sent_at) >= timeout) {
+            link_stats.timeouts++;
+            in_flight = false;
+
+            if (tries > MOTOR_LINK_MAX_RETRY) {
+                finish(false);
+            }
+            else {
+                link_stats.retries++;
+            }
+        }
+    }
+
+    // Start the next transaction, or resend the one that failed.
+    if (!in_flight && count) {
+        send();
+    }
+
+    unsigned long poll_time = micros() - start;
+    if (poll_time > link_stats.max_poll_time) {
+        link_stats.max_poll_time = poll_time;
+    }
+}
+
+
+bool MotorLink::idle() const {
+    return 0 == count;
+}
+
+
+bool MotorLink::waitIdle(uint32_t timeout) {
+    unsigned long start = micros();
+
+    while (!idle() && (micros() - start) < timeout) {
+        poll();
+    }
+
+    return idle();
+}
+
+
+const MotorLinkStats &MotorLink::stats() const {
+    return link_stats;
+}
+
+
+void MotorLink::resetStats() {
+    memset(&link_stats, 0, sizeof(link_stats));
+}
+
+
+void MotorLink::printStats(Print &out) const {
+    out.print("queued ");
+    out.println(link_stats.queued);
+    out.print("completed ");
+    out.println(link_stats.completed);
+    out.print("failed ");
+    out.println(link_stats.failed);
+    out.print("dropped ");
+    out.println(link_stats.dropped);
+    out.print("retries ");
+    out.println(link_stats.retries);
+    out.print("crc_failures ");
+    out.println(link_stats.crc_failures);
+    out.print("timeouts ");
+    out.println(link_stats.timeouts);
+    out.print("last_rtt_us ");
+    out.println(link_stats.last_rtt);
+    out.print("max_rtt_us ");
+    out.println(link_stats.max_rtt);
+    out.print("max_poll_us ");
+    out.println(link_stats.max_poll_time);
+    out.print("stops ");
+    out.println(link_stats.stops);
+    out.print("last_stop_latency_us ");
+    out.println(link_stats.last_stop_latency);
+    out.print("max_stop_latency_us ");
+    out.println(link_stats.max_stop_latency);
+}
@@ -0,0 +1,212 @@
+/* Asynchronous packet serial transport for the RoboClaw motor controller.
+
+   The RoboClaw library sends a packet and then busy-waits for the reply, for
+   up to the timeout and MAXRETRY retries, so one lost byte can hold up the
+   main loop for tens of milliseconds. MotorLink instead queues transactions
+   and works through them from poll(), which never waits:
+
+   - A queued packet is only handed to the UART once there is room for all
+     of it in the transmit buffer.
+   - Packets are framed by RoboClawCodec straight into the queue, and sent
+     with a single write.
+   - Reply bytes are taken from the receive buffer as they arrive, and the
+     CRC is updated byte by byte.
+   - A reply that does not arrive within the timeout is retried, and the
+     transaction fails after MOTOR_LINK_MAX_RETRY retries.
+
+   Results are handed back through an optional callback, and idle() can be
+   polled to see whether everything queued has finished.
+
+   stopNow is the exception to the queue, for the safety lane. It hands a
+   stop frame encoded ahead of time by prepareStop straight to the UART,
+   from an interrupt or with interrupts disabled. If it interrupts send(),
+   the stop goes out as send() finishes, after the packet if that was
+   already being handed over, so frames are never interleaved and no
+   older packet follows the stop. The next poll() drops
+   everything that was queued before the stop, and queues the stop again
+   as an ordinary transaction, so that it is acknowledged and retried.
+
+   Nothing else may use the serial port while MotorLink owns it.
+ */
+
+#ifndef MotorLink_h
+#define MotorLink_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include <HardwareSerial.h>
+
+#include "RoboClaw.h"
+#include "RoboClawCodec.h"
+
+const uint8_t MOTOR_LINK_QUEUE_SIZE = 8;   // Transactions
+const uint8_t MOTOR_LINK_READ_RESERVE = 2; // Slots reads leave free, for motion commands
+const uint8_t MOTOR_LINK_MAX_PACKET = ROBOCLAW_MAX_FRAME;
+const uint8_t MOTOR_LINK_MAX_REPLY  = 8;   // Data bytes, excluding CRC
+const uint8_t MOTOR_LINK_MAX_RETRY  = 2;
+const uint8_t MOTOR_LINK_ACK        = 0xFF; // Reply to every write command
+
+
+/* Called once a transaction has finished.
+
+   Input:
+   - valid: false if the transaction failed (timeout or CRC error on every try)
+   - data: reply data, CRC removed, empty for write commands
+   - length: number of bytes in data
+ */
+typedef void (*MotorReplyCallback)(bool valid, const uint8_t *data, uint8_t length);
+
+
+struct MotorLinkStats {
+    uint16_t queued;
+    uint16_t completed;
+    uint16_t failed;
+    uint16_t dropped;      // Rejected because the queue was full.
+    uint16_t retries;
+    uint16_t crc_failures;
+    uint16_t timeouts;
+
+    unsigned long last_rtt;      // us; send to last reply byte.
+    unsigned long max_rtt;       // us
+    unsigned long max_poll_time; // us; longest single call to poll().
+
+    uint16_t stops;                  // Stop frames sent by stopNow.
+    unsigned long last_stop_latency; // us; stopNow's since to the frame going to the UART.
+    unsigned long max_stop_latency;  // us
+};
+
+
+class MotorLink {
+public:
+    MotorLink(HardwareSerial *serial, uint32_t timeout);
+
+    /* Open the serial port at speed, or change to it once everything already
+       written has gone out.
+     */
+    void begin(long speed);
+
+    /* Move the controller from speed (its configured packet serial baud rate)
+       to fastSpeed. Blocks, so only meant for setup. Also copes with a
+       controller that is still at fastSpeed from before the Arduino reset.
+       The new rate is not written to the controller's EEPROM, so a power
+       cycle brings it back to speed.
+
+       Returns the baud rate now in use, which is speed if the controller did
+       not answer at fastSpeed.
+     */
+    long negotiateBaud(uint8_t address, long speed, long fastSpeed);
+
+    /* Queue a command that is acknowledged with a single 0xFF byte.
+       Returns false if the queue is full.
+     */
+    bool queueWrite(uint8_t address, uint8_t cmd, const uint8_t *payload, uint8_t length,
+                    MotorReplyCallback callback = NULL);
+
+    /* Queue a command that replies with replyLength data bytes and a CRC.
+       Returns false if the queue is full, or would leave fewer than
+       MOTOR_LINK_READ_RESERVE slots free: a read can wait for the next
+       poll, a motion command cannot.
+     */
+    bool queueRead(uint8_t address, uint8_t cmd, uint8_t replyLength, MotorReplyCallback callback);
+
+    // Commands used by the ventilator, packed the same way as in RoboClaw.
+    bool SpeedM1(uint8_t address, uint32_t speed);
+    bool SpeedDistanceM1(uint8_t address, uint32_t speed, uint32_t distance, uint8_t flag=0);
+    bool SpeedAccelDeccelPositionM1(uint8_t address, uint32_t accel, uint32_t speed, uint32_t deccel, uint32_t position, uint8_t flag);
+    bool SetEncM1(uint8_t address, int32_t val);
+    bool SetConfig(uint8_t address, uint16_t config, MotorReplyCallback callback = NULL);
+    bool ReadEncM1(uint8_t address, MotorReplyCallback callback);
+    bool ReadTemp(uint8_t address, MotorReplyCallback callback);
+    bool GetConfig(uint8_t address, MotorReplyCallback callback);
+
+    /* Encode the frame stopNow sends: M1 to speed 0, buffer cleared.
+       acknowledged is called once the controller has acknowledged the stop
+       queued after it. Call in setup, before anything can call stopNow.
+     */
+    void prepareStop(uint8_t address, MotorReplyCallback acknowledged = NULL);
+
+    /* Send the stop frame now, ahead of everything queued. Call from an
+       interrupt, or with interrupts disabled. since (us) is when the stop
+       was called for, for the latency stats.
+     */
+    void stopNow(unsigned long since);
+
+    /* Send queued packets and parse any reply bytes that have arrived. Never
+       waits on the UART.
+     */
+    void poll();
+
+    /* True when nothing is queued or in flight.
+     */
+    bool idle() const;
+
+    /* Poll until idle, or until timeout (us) has passed. Blocks, so only meant
+       for setup. Returns idle().
+     */
+    bool waitIdle(uint32_t timeout);
+
+    const MotorLinkStats &stats() const;
+
+    void resetStats();
+
+    void printStats(Print &out) const;
+
+private:
+    struct Transaction {
+        uint8_t packet[MOTOR_LINK_MAX_PACKET];
+        uint8_t packet_length;
+        uint8_t reply_length;    // 0 for writes, which reply with MOTOR_LINK_ACK
+        MotorReplyCallback callback;
+        uint8_t sequence;        // next_sequence when it was queued
+    };
+
+    // Packet buffer of the next free slot, or NULL if fewer than keep+1 are free.
+    uint8_t *reserve(uint8_t keep = 0);
+    // Queue the packet written to the reserve()d slot.
+    bool commit(uint8_t length, uint8_t replyLength, MotorReplyCallback callback);
+
+    bool probe(uint8_t address, long speed);
+
+    bool send();
+    void receive(uint8_t data);
+    void finish(bool valid);
+
+    void writeStop();
+    void dropQueued();
+
+    HardwareSerial *serial;
+    uint32_t timeout;
+
+    Transaction transactions[MOTOR_LINK_QUEUE_SIZE];
+    uint8_t head;  // Next free slot.
+    uint8_t count; // Queued transactions, including the one in flight.
+    volatile uint8_t next_sequence; // Wraps; the queue is far shorter than 128.
+
+    // Transaction in flight, always transactions[tail()].
+    bool in_flight;
+    uint8_t tries;
+    unsigned long sent_at;
+    uint16_t crc;
+    uint8_t received;
+    uint8_t reply[MOTOR_LINK_MAX_REPLY + 2];
+
+    // Safety lane stop, see stopNow.
+    uint8_t stop_frame[MOTOR_LINK_MAX_PACKET];
+    uint8_t stop_length;
+    MotorReplyCallback stop_acknowledged;
+    volatile bool writing;                // send() is handing a packet to the UART.
+    volatile bool stop_requested;         // Stop to write as soon as send() is done.
+    volatile bool stop_sent;              // Stop written, queue not dropped yet.
+    volatile unsigned long stop_since;    // us
+    volatile uint8_t stop_sequence;       // next_sequence at the stop.
+
+    MotorLinkStats link_stats;
+
+    uint8_t tail() const;
+};
+
+#endif
@@ -1,119 +1,63 @@
-#define SERIAL_DEBUG //Comment this out if not debugging, used for visual confirmation of state changes
 #define NO_INPUT_DEBUG //Comment this out if not debugging, used to spoof input parameters at startup when no controls are present
 
 #include "MotorZeroing.h"
 
 #include "alarms.h"
+#include "BreathEngine.h"
+#include "Motor.h"
 #include "PinAssignments.h"
-
-#include <assert.h>
+#include "Log.h"
 
 void setupLimitSwitch(void){
 	pinMode(LIMIT_SWITCH_PIN, INPUT_PULLUP);
 }
 
 
-VentilatorState commandHome(VentilatorState state) {
-    assert(state.zeroing_state == CommandHome);
-#ifdef SERIAL_DEBUG
-    Serial.println("CommandHome");
-#endif //SERIAL_DEBUG
-
-    state.zeroing_state = MotorHomingWait;
-    reset_timer(state);
-
-    return state;
+// Homing is the one command that needs no state.
+static void commandHoming(MotorLink &controller_name, VentilatorState &state) {
+    commandMotorHoming(controller_name);
 }
 
-VentilatorState motorHomingWait(VentilatorState state) {
-    assert(state.zeroing_state == MotorHomingWait);
-
-#ifdef SERIAL_DEBUG
-    Serial.println("motorHomingWait");
-    Serial.print("Elaspsed time: ");
-    Serial.println(elapsed_time(state));
-#endif //SERIAL_DEBUG
-
-
-    if (digitalRead(LIMIT_SWITCH_PIN)) {
-    	state.zeroing_state = CommandZero;
-    }
-    else if (elapsed_time(state) > HOMING_TIMEOUT) {
-    	//TODO: Add time out error
-    }
-
-    return state;
+static void checkMotorZero(MotorLink &controller_name, VentilatorState &state) {
+    checkMotorStatus(controller_name, state);
+    setMotorZero(controller_name);
 }
 
-VentilatorState commandZero(VentilatorState state) {
-    assert(state.zeroing_state == CommandZero);
-
-#ifdef SERIAL_DEBUG
-    Serial.println("CommandZero");
-#endif //SERIAL_DEBUG
-
-    state.zeroing_state = MotorZeroingWait;
-    reset_timer(state);
 
-    //TODO: Add in motor command to move inwards ZERO_POINT_TICKS at MOTOR_HOME_SPEED
-
-    return state;
+unsigned long homingWait(const VentilatorState &state) {
+    //TODO: Add time out error after HOMING_TIMEOUT
+    return WAIT_FOREVER;
 }
 
-VentilatorState motorZeroingWait(VentilatorState state) {
-    assert(state.zeroing_state == MotorZeroingWait);
-
-#ifdef SERIAL_DEBUG
-    Serial.println("MotorZeroingWait");
-    Serial.print("Elaspsed time: ");
-    Serial.println(elapsed_time(state));
-#endif //SERIAL_DEBUG
+bool limitSwitchPressed(const VentilatorState &state) {
+    return digitalRead(LIMIT_SWITCH_PIN);
+}
 
-    
+unsigned long zeroingWait(const VentilatorState &state) {
+    return ZEROING_TIME;
+}
 
-    if (elapsed_time(state) > ZEROING_TIME) {
+void motorZero(VentilatorState &state) {
+	//TODO: Add error if motor position is not expected
 
-       	state.zeroing_state = MotorZero;
-    }
+	//TODO: Add error if the motor controller is too hot
 
-    return state;
+	state.machine_state = BreathLoopStart;
 }
 
-VentilatorState motorZero(VentilatorState state) {
-    assert(state.zeroing_state == MotorZero);
 
-#ifdef SERIAL_DEBUG    
-    Serial.println("motorZero");
-#endif //SERIAL_DEBUG
+static constexpr StateEntry<zeroingStates> ZEROING_STATES[] PROGMEM = {
+    // state          event                   action       wait         trigger             leave  next              on_alarm          motor
+    {CommandHome,      LOG_COMMAND_HOME,       reset_timer, NULL,        NULL,               NULL,  MotorHomingWait,  CommandHome,      commandHoming},
+    {MotorHomingWait,  LOG_MOTOR_HOMING_WAIT,  NULL,        homingWait,  limitSwitchPressed, NULL,  CommandZero,      MotorHomingWait,  NULL},
+    {CommandZero,      LOG_COMMAND_ZERO,       reset_timer, NULL,        NULL,               NULL,  MotorZeroingWait, CommandZero,      commandMotorZero},
+    {MotorZeroingWait, LOG_MOTOR_ZEROING_WAIT, NULL,        zeroingWait, NULL,               NULL,  MotorZero,        MotorZeroingWait, NULL},
+    {MotorZero,        LOG_MOTOR_ZERO,         motorZero,   NULL,        NULL,               NULL,  CommandHome,      MotorZero,        checkMotorZero},
+};
 
-	//TODO: Add error if motor position is not expected
+static_assert(check_states(ZEROING_STATES), "ZEROING_STATES must list every zeroingStates state in order");
 
-	//TODO: Add error if the motor controller is too hot
-
-    state.zeroing_state = CommandHome;
 
-	state.machine_state = BreathLoopStart;
-
-	return state;
+void motor_zeroing_step(MotorLink &controller_name, VentilatorState &state) {
+	step_states(ZEROING_STATES, LOG_ZEROING_INVALID, state.zeroing_state, controller_name, state);
 }
-
-VentilatorState motor_zeroing_step(VentilatorState state) {
-
-	switch(state.zeroing_state) {
-	case CommandHome:
-		return commandHome(state);
-	case MotorHomingWait:
-		return motorHomingWait(state);
-	case CommandZero:
-		return commandZero(state);
-	case MotorZeroingWait:
-		return motorZeroingWait(state);
-	case MotorZero:
-		return motorZero(state);
-	default:
-		//Should not occur
-		break;
-	}
-
-	return state;
-}
\ No newline at end of file
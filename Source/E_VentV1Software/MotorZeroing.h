@@ -5,6 +5,7 @@
 
 #include "elapsedMillis.h"
 #include "MachineStates.h"
+#include "MotorLink.h"
 
 
 //TODO: Add actual values/figure this out with the motor controller library
@@ -21,17 +22,21 @@ const int MOTOR_HOME_SPEED = 20; //Out of 127
 
 void setupLimitSwitch(void);
 
-VentilatorState commandHome(VentilatorState state);
+/* Step the zeroing state machine, a table run by BreathEngine, and issue
+   the motor command of the state it ends in.
+ */
+void motor_zeroing_step(MotorLink &controller_name, VentilatorState &state);
 
-VentilatorState motorHomingWait(VentilatorState state);
 
-VentilatorState commandZero(VentilatorState state);
+// Waits, triggers and actions of the zeroing states, available for testing.
 
-VentilatorState motorZeroingWait(VentilatorState state);
+unsigned long homingWait(const VentilatorState &state);
 
-VentilatorState motorZero(VentilatorState state);
+bool limitSwitchPressed(const VentilatorState &state);
 
-VentilatorState motor_zeroing_step(VentilatorState state);
+unsigned long zeroingWait(const VentilatorState &state);
+
+void motorZero(VentilatorState &state);
 
 
 
@@ -0,0 +1,100 @@
+#include "PatientTrigger.h"
+
+#include "Profiler.h"
+#include "Log.h"
+
+constexpr Pressure TRIGGER_FALL = Pressure::from_float(TRIGGER_MIN_FALL);
+static_assert(Pressure::fits(TRIGGER_MIN_FALL), "TRIGGER_MIN_FALL out of range");
+
+const unsigned long TRIGGER_REFRACTORY_US = TRIGGER_REFRACTORY_MS * 1000;
+
+// Written from the main loop, read in the TWI interrupt.
+static volatile bool armed = false;
+static volatile unsigned long armed_time = 0; // us
+static volatile int16_t threshold = 0;        // Pressure raw
+
+// Written in the TWI interrupt, read from the main loop.
+static volatile bool latched = false;
+static volatile unsigned long trigger_time = 0; // us
+
+// Only touched in the TWI interrupt.
+static int32_t baseline = 0; // Pressure raw << TRIGGER_BASELINE_SHIFT
+static int16_t history[TRIGGER_SLOPE_SAMPLES];
+static uint8_t history_next = 0;
+
+
+void patient_trigger_sample(const unsigned long time, const Pressure sample) {
+    int16_t pressure = sample.raw;
+
+    // Change since TRIGGER_SLOPE_SAMPLES ago, negative while falling.
+    int16_t slope = pressure - history[history_next];
+    history[history_next] = pressure;
+    history_next = (history_next + 1) % TRIGGER_SLOPE_SAMPLES;
+
+    if (armed && !latched && (long)(time - armed_time) < (long)TRIGGER_REFRACTORY_US) {
+        baseline = (int32_t)pressure << TRIGGER_BASELINE_SHIFT;
+        return;
+    }
+
+    bool falling = slope <= -TRIGGER_FALL.raw;
+    int16_t reference = baseline >> TRIGGER_BASELINE_SHIFT;
+
+    if (armed && !latched && falling && pressure < reference - threshold) {
+        latched = true;
+        trigger_time = time;
+    }
+
+    if (!falling) {
+        baseline += pressure - reference;
+    }
+}
+
+
+void arm_patient_trigger(const Pressure threshold_pressure) {
+    cli();
+    threshold = threshold_pressure.raw;
+    armed_time = micros();
+    latched = false;
+    armed = true;
+    sei();
+}
+
+
+void disarm_patient_trigger() {
+    cli();
+    armed = false;
+    latched = false;
+    sei();
+}
+
+
+bool patient_triggered() {
+    return latched;
+}
+
+
+unsigned long take_patient_trigger() {
+    unsigned long time;
+
+    cli();
+    time = trigger_time;
+    armed = false;
+    latched = false;
+    sei();
+
+    unsigned long now = profile_end(PROFILE_TRIGGER_LATENCY, time);
+    LOG1(LOG_PATIENT_TRIGGER, now - time);
+
+    return time;
+}
+
+
+Pressure patient_trigger_baseline() {
+    int32_t value;
+
+    cli();
+    value = baseline;
+    sei();
+
+    return Pressure::from_raw(value >> TRIGGER_BASELINE_SHIFT);
+}
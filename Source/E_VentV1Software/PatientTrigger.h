@@ -0,0 +1,74 @@
+/* Patient trigger detection for AC mode, run on every pressure sample.
+
+   Testing the pressure once per state machine step against a single PEEP
+   sample from the last reset meant an effort could wait a step or more to
+   be seen, and one noisy sample moved the reference. Instead the TWI
+   interrupt that finishes each read passes the sample to
+   patient_trigger_sample, which keeps
+
+   - a baseline: the pressure filtered over about 2^TRIGGER_BASELINE_SHIFT
+     samples, which stops following while the pressure is falling, so an
+     effort does not drag it down with it;
+   - the fall over the last TRIGGER_SLOPE_SAMPLES samples.
+
+   Once armed, and past TRIGGER_REFRACTORY_MS, a sample that is both
+   threshold below the baseline and falling by at least TRIGGER_MIN_FALL
+   latches a trigger with the time of the sample. During the refractory
+   window the baseline follows the pressure down the exhale instead.
+
+   The breath engine polls the latch on its next step, and
+   take_patient_trigger, called as the inhale is commanded, records the
+   time from the sample to the command as PROFILE_TRIGGER_LATENCY.
+ */
+
+#ifndef PatientTrigger_h
+#define PatientTrigger_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "FixedPoint.h"
+
+const uint8_t TRIGGER_BASELINE_SHIFT = 4;        // Baseline filter, 1/16 of each sample
+const uint8_t TRIGGER_SLOPE_SAMPLES = 8;         // 40 ms at PRESSURE_SAMPLE_RATE
+constexpr float TRIGGER_MIN_FALL = 0.2;          // cmH2O over TRIGGER_SLOPE_SAMPLES
+const unsigned long TRIGGER_REFRACTORY_MS = 400; // After arming, while the exhale settles
+
+
+/* Feed one sample. Called from the TWI interrupt for every sample.
+   time is micros() when the sample was taken.
+ */
+void patient_trigger_sample(const unsigned long time, const Pressure sample);
+
+
+/* Clear any trigger and start looking for one threshold below the
+   baseline, after TRIGGER_REFRACTORY_MS.
+ */
+void arm_patient_trigger(const Pressure threshold);
+
+
+/* Stop looking and clear any trigger.
+ */
+void disarm_patient_trigger();
+
+
+/* True once a trigger has latched.
+ */
+bool patient_triggered();
+
+
+/* Disarm, record the latency of the latched trigger and return the
+   micros() time of the sample that set it off. Only call once
+   patient_triggered().
+ */
+unsigned long take_patient_trigger();
+
+
+/* Current baseline pressure.
+ */
+Pressure patient_trigger_baseline();
+
+#endif
@@ -0,0 +1,91 @@
+#include "PressureFilter.h"
+
+#include "pressure.h"
+
+static_assert(PRESSURE_OVERSAMPLE > 0 && (long)PRESSURE_OVERSAMPLE*PRESSURE_COUNTS_MASK <= 0xFFFF,
+              "PRESSURE_OVERSAMPLE reads do not fit in the sum");
+static_assert(PRESSURE_LOWPASS_SHIFT < 16, "PRESSURE_LOWPASS_SHIFT too large");
+static_assert(PRESSURE_SLOPE_SAMPLES > 0, "PRESSURE_SLOPE_SAMPLES must be at least 1");
+
+//Change over PRESSURE_SLOPE_SAMPLES to PressureRate: times PRESSURE_SLOPE_SCALE,
+//which has PRESSURE_SLOPE_SCALE_SHIFT more fraction bits.
+const uint8_t PRESSURE_SLOPE_SCALE_SHIFT = 8;
+constexpr int32_t PRESSURE_SLOPE_SCALE = (float)PRESSURE_SAMPLE_RATE*PressureRate::scale()*(1L << PRESSURE_SLOPE_SCALE_SHIFT)
+                                         /(PRESSURE_SLOPE_SAMPLES*Pressure::scale()) + 0.5f;
+
+//The widest change, from one end of Pressure to the other, can not overflow
+static_assert(65535.0f*PRESSURE_SLOPE_SCALE < 2147483648.0f, "PRESSURE_SLOPE_SCALE_SHIFT too large");
+
+
+static uint16_t median3(const uint16_t a, const uint16_t b, const uint16_t c) {
+    uint16_t low = (a < b) ? a : b;
+    uint16_t high = (a < b) ? b : a;
+
+    if (c <= low) {
+        return low;
+    }
+    return (c < high) ? c : high;
+}
+
+
+bool pressure_decimate(PressureDecimator &decimator, const uint16_t raw, uint16_t &sample) {
+    uint16_t counts = raw & PRESSURE_COUNTS_MASK;
+
+    if (!decimator.primed) {
+        decimator.reads[0] = decimator.reads[1] = decimator.reads[2] = counts;
+        decimator.primed = true;
+    }
+
+    decimator.reads[decimator.next] = counts;
+    decimator.next = (decimator.next < 2) ? decimator.next + 1 : 0;
+
+    if (PRESSURE_REJECT_SPIKES) {
+        decimator.sum += median3(decimator.reads[0], decimator.reads[1], decimator.reads[2]);
+    }
+    else {
+        decimator.sum += counts;
+    }
+
+    if (++decimator.count < PRESSURE_OVERSAMPLE) {
+        return false;
+    }
+
+    sample = ((decimator.sum + PRESSURE_OVERSAMPLE/2) / PRESSURE_OVERSAMPLE) | (raw & ~PRESSURE_COUNTS_MASK);
+    decimator.sum = 0;
+    decimator.count = 0;
+    return true;
+}
+
+
+void pressure_filter_step(PressureFilter &filter, const unsigned long time, const Pressure sample,
+                          FilteredPressure &out) {
+    if (!filter.primed) {
+        filter.lowpass = (int32_t)sample.raw << PRESSURE_LOWPASS_SHIFT;
+        for (uint8_t i = 0; i < PRESSURE_SLOPE_SAMPLES; i++) {
+            filter.history[i] = sample.raw;
+        }
+        filter.primed = true;
+    }
+
+    const int32_t half = (1L << PRESSURE_LOWPASS_SHIFT) >> 1;
+    int16_t previous = (filter.lowpass + half) >> PRESSURE_LOWPASS_SHIFT;
+    filter.lowpass += sample.raw - previous;
+    int16_t pressure = (filter.lowpass + half) >> PRESSURE_LOWPASS_SHIFT;
+
+    // Change since PRESSURE_SLOPE_SAMPLES ago
+    int32_t change = (int32_t)pressure - filter.history[filter.history_next];
+    filter.history[filter.history_next] = pressure;
+    filter.history_next = (filter.history_next + 1) % PRESSURE_SLOPE_SAMPLES;
+
+    int32_t slope = (change*PRESSURE_SLOPE_SCALE) >> PRESSURE_SLOPE_SCALE_SHIFT;
+    if (slope > PressureRate::max_raw()) {
+        slope = PressureRate::max_raw();
+    }
+    else if (slope < PressureRate::min_raw()) {
+        slope = PressureRate::min_raw();
+    }
+
+    out.time = time;
+    out.pressure = Pressure::from_raw(pressure);
+    out.slope = PressureRate::from_raw(slope);
+}
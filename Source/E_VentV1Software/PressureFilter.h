@@ -0,0 +1,79 @@
+/* Conditioning of the pressure signal, between the sensor and the state.
+
+   Peak, plateau and PEEP, the alarms and the trigger all used to see one
+   raw reading at a time, so a noisy read, or a glitch on the bus, went
+   straight into them. The TWI interrupt now runs every read through two
+   stages, in integer math only:
+
+   - pressure_decimate, on sensor counts at PRESSURE_READ_RATE: a median
+     of the last three reads, which throws out a single bad read, averaged
+     over PRESSURE_OVERSAMPLE reads down to one sample at
+     PRESSURE_SAMPLE_RATE. Counts in and counts out, so the waveform stream
+     and everything timed in samples are unchanged.
+   - pressure_filter_step, in cmH2O at PRESSURE_SAMPLE_RATE: a single pole
+     low pass, the pressure filtered over about 2^PRESSURE_LOWPASS_SHIFT
+     samples, and its rate of change over PRESSURE_SLOPE_SAMPLES samples.
+
+   The safety lane and the trigger take the decimated sample, which is
+   clean of spikes but barely delayed, and do their own filtering. The
+   state takes the low pass and the slope.
+
+   Setting PRESSURE_OVERSAMPLE to 1, PRESSURE_REJECT_SPIKES to false or
+   PRESSURE_LOWPASS_SHIFT to 0 turns that part off.
+ */
+
+#ifndef PressureFilter_h
+#define PressureFilter_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "FixedPoint.h"
+
+const uint8_t PRESSURE_OVERSAMPLE = 4;        // Sensor reads per sample
+const bool PRESSURE_REJECT_SPIKES = true;     // Median of 3 reads
+const uint8_t PRESSURE_LOWPASS_SHIFT = 2;     // Low pass, 1/4 of each sample, about 17 ms
+const uint8_t PRESSURE_SLOPE_SAMPLES = 4;     // 20 ms at PRESSURE_SAMPLE_RATE
+
+
+struct PressureDecimator {
+    uint16_t reads[3]; // Counts, the last three reads
+    uint8_t next;
+    bool primed;
+    uint8_t count;     // Reads in sum
+    uint16_t sum;
+};
+
+
+struct PressureFilter {
+    int32_t lowpass; // Pressure raw << PRESSURE_LOWPASS_SHIFT
+    int16_t history[PRESSURE_SLOPE_SAMPLES];
+    uint8_t history_next;
+    bool primed;
+};
+
+
+struct FilteredPressure {
+    unsigned long time;  // us; micros() when the newest read in it was taken
+    Pressure pressure;   // Low pass
+    PressureRate slope;  // Of the low pass
+};
+
+
+/* Feed one sensor read, status bits included. Every PRESSURE_OVERSAMPLE
+   reads returns true and sets sample to their average, with the status
+   bits of the newest read. A zeroed decimator starts from its first read.
+ */
+bool pressure_decimate(PressureDecimator &decimator, const uint16_t raw, uint16_t &sample);
+
+
+/* Feed one decimated sample and set out from it. A zeroed filter starts
+   at the first sample, with no slope.
+ */
+void pressure_filter_step(PressureFilter &filter, const unsigned long time, const Pressure sample,
+                          FilteredPressure &out);
+
+#endif
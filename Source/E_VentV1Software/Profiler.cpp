@@ -0,0 +1,104 @@
+#include "Profiler.h"
+
+
+static const char *const stage_names[NUM_PROFILE_STAGES] = {
+#define PROFILE_STAGE_NAME(id, name) name,
+    PROFILE_STAGES(PROFILE_STAGE_NAME)
+#undef PROFILE_STAGE_NAME
+};
+
+static ProfileStats stats[NUM_PROFILE_STAGES];
+
+static unsigned long last_loop_start = 0;
+static unsigned long last_loop_period = 0;
+static bool loop_started = false;
+
+
+static void record(ProfileStats &s, const uint32_t time) {
+    if (0 == s.runs || time < s.min) {
+        s.min = time;
+    }
+    if (time > s.max) {
+        s.max = time;
+    }
+    s.runs++;
+    s.total += time;
+
+    uint8_t bin = 0;
+    uint32_t bound = time >> PROFILE_HISTOGRAM_SHIFT;
+    while (bound && bin < PROFILE_HISTOGRAM_BINS - 1) {
+        bound >>= 1;
+        bin++;
+    }
+
+    s.histogram[bin]++;
+}
+
+
+unsigned long profile_end(const ProfileStage stage, const unsigned long start) {
+    unsigned long end = micros();
+
+    record(stats[stage], end - start);
+    return end;
+}
+
+
+void profile_loop() {
+    unsigned long now = micros();
+
+    if (loop_started) {
+        unsigned long period = now - last_loop_start;
+
+        // The first period after a reset has nothing to compare with.
+        if (stats[PROFILE_LOOP_PERIOD].runs) {
+            record(stats[PROFILE_LOOP_JITTER], (period > last_loop_period) ? period - last_loop_period
+                                                                           : last_loop_period - period);
+        }
+        record(stats[PROFILE_LOOP_PERIOD], period);
+        last_loop_period = period;
+    }
+
+    last_loop_start = now;
+    loop_started = true;
+}
+
+
+const ProfileStats &profile_stats(const ProfileStage stage) {
+    return stats[stage];
+}
+
+
+void print_profile(Print &out) {
+    out.print("stage runs min_us mean_us max_us");
+    for (uint8_t bin = 0; bin < PROFILE_HISTOGRAM_BINS - 1; bin++) {
+        out.print(" <");
+        out.print(1UL << (PROFILE_HISTOGRAM_SHIFT + bin));
+    }
+    out.print(" >=");
+    out.println(1UL << (PROFILE_HISTOGRAM_SHIFT + PROFILE_HISTOGRAM_BINS - 2));
+
+    for (uint8_t i = 0; i < NUM_PROFILE_STAGES; i++) {
+        const ProfileStats &s = stats[i];
+
+        out.print(stage_names[i]);
+        out.print(' ');
+        out.print(s.runs);
+        out.print(' ');
+        out.print(s.min);
+        out.print(' ');
+        out.print(s.runs ? s.total / s.runs : 0);
+        out.print(' ');
+        out.print(s.max);
+        for (uint8_t bin = 0; bin < PROFILE_HISTOGRAM_BINS; bin++) {
+            out.print(' ');
+            out.print(s.histogram[bin]);
+        }
+        out.println();
+    }
+}
+
+
+void reset_profile() {
+    memset(stats, 0, sizeof(stats));
+    loop_started = false;
+}
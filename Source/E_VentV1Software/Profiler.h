@@ -0,0 +1,90 @@
+/* Run time of each stage of the main loop.
+
+   The scheduler says which task overran, the profiler says which part of it
+   took the time. Each stage is timed with micros() where it runs in its
+   task, and keeps its run count, min, mean and max run time and a log
+   scale histogram of run times. The time between passes through loop() is
+   kept the same way, along with the jitter, the change in that time from
+   one pass to the next, and the latency of each patient trigger, from the
+   sample that set it off to the inhale command, see PatientTrigger.h.
+
+   Timing a stage costs two clock reads, or one when the next stage starts
+   where the last one finished. print_profile dumps everything over Serial
+   (command 'p'), reset_profile clears it (command 'r').
+ */
+
+#ifndef Profiler_h
+#define Profiler_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+const uint8_t PROFILE_HISTOGRAM_BINS = 8;
+const uint8_t PROFILE_HISTOGRAM_SHIFT = 4; // The first bin is under 2^4 us, each bin after it twice as wide.
+
+/* Every stage that is timed, and the name it is printed with.
+ */
+#define PROFILE_STAGES(X) \
+    X(PROFILE_PARAMETERS,      "parameters") \
+    X(PROFILE_VENT_LCD,        "vent_lcd") \
+    X(PROFILE_MOTOR_SETTINGS,  "motor_settings") \
+    X(PROFILE_UPDATE_STATE,    "update_state") \
+    X(PROFILE_MODE_STEP,       "mode_step") \
+    X(PROFILE_BREATH_TIMING,   "breath_timing") \
+    X(PROFILE_ALARMS,          "alarms") \
+    X(PROFILE_TRIGGER_LATENCY, "trigger_latency") \
+    X(PROFILE_LOOP_PERIOD,     "loop_period") \
+    X(PROFILE_LOOP_JITTER,     "loop_jitter")
+
+enum ProfileStage : uint8_t {
+#define PROFILE_STAGE_ID(id, name) id,
+    PROFILE_STAGES(PROFILE_STAGE_ID)
+#undef PROFILE_STAGE_ID
+    NUM_PROFILE_STAGES
+};
+
+
+struct ProfileStats {
+    uint32_t runs;
+    uint32_t total;   // us; wraps after 71 minutes of run time, reset before then.
+    uint32_t min;     // us
+    uint32_t max;     // us
+    uint32_t histogram[PROFILE_HISTOGRAM_BINS];
+};
+
+
+/* Start timing a stage. Returns the time to hand to profile_end.
+ */
+inline unsigned long profile_start() {
+    return micros();
+}
+
+
+/* Finish timing stage, started at start. Returns the end time, so the next
+   stage can start from it without reading the clock again.
+ */
+unsigned long profile_end(const ProfileStage stage, const unsigned long start);
+
+
+/* Called once at the top of every pass through loop(), times the loop
+   period and jitter.
+ */
+void profile_loop();
+
+
+const ProfileStats &profile_stats(const ProfileStage stage);
+
+
+/* Print name, runs, min, mean and max run time and the histogram for each
+   stage, one stage per line. The histogram header gives the upper bound of
+   each bin in us.
+ */
+void print_profile(Print &out);
+
+
+void reset_profile();
+
+#endif
@@ -0,0 +1,101 @@
+/* Lock-free single-producer / single-consumer ring buffer.
+
+   Meant for handing data from an interrupt to the main loop: the ISR is the
+   only caller of push, the main loop the only caller of pop / peek. The
+   head and tail indices are single bytes, so reading and writing them is
+   atomic on the AVR and no interrupts need to be disabled.
+
+   SIZE must be a power of two no larger than 128. One slot is always left
+   empty to tell a full buffer from an empty one.
+ */
+
+#ifndef RingBuffer_h
+#define RingBuffer_h
+
+#include <stdint.h>
+
+
+template <typename T, uint8_t SIZE>
+class RingBuffer {
+    static_assert(SIZE >= 2 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0,
+                  "RingBuffer SIZE must be a power of two between 2 and 128");
+
+public:
+    RingBuffer() : head(0), tail(0), dropped(0) {}
+
+    /* Producer side. Returns false and counts a drop if the buffer is full.
+     */
+    bool push(const T &item) {
+        uint8_t next = (head + 1) & MASK;
+
+        if (next == tail) {
+            dropped++;
+            return false;
+        }
+
+        items[head] = item;
+        barrier();
+        head = next;
+        return true;
+    }
+
+    /* Consumer side. Returns false if there is nothing to read.
+     */
+    bool pop(T &item) {
+        uint8_t current = tail;
+
+        if (current == head) {
+            return false;
+        }
+
+        item = items[current];
+        barrier();
+        tail = (current + 1) & MASK;
+        return true;
+    }
+
+    /* Consumer side. Like pop, but leaves the item in the buffer.
+     */
+    bool peek(T &item) const {
+        uint8_t current = tail;
+
+        if (current == head) {
+            return false;
+        }
+
+        item = items[current];
+        return true;
+    }
+
+    uint8_t available() const {
+        return (head - tail) & MASK;
+    }
+
+    /* Number of items that can be pushed before the buffer is full.
+     */
+    uint8_t space() const {
+        return MASK - available();
+    }
+
+    /* Number of items the producer could not push because the consumer fell
+       behind.
+     */
+    uint16_t droppedCount() const {
+        return dropped;
+    }
+
+private:
+    static const uint8_t MASK = SIZE - 1;
+
+    // Keep the compiler from moving the item copy past the index update.
+    static void barrier() {
+        __asm__ __volatile__("" ::: "memory");
+    }
+
+    T items[SIZE];
+    volatile uint8_t head; // Written by the producer only.
+    volatile uint8_t tail; // Written by the consumer only.
+    volatile uint16_t dropped;
+};
+
+#endif
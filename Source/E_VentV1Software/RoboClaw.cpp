@@ -1,7 +1,9 @@
 #include "Arduino.h"
 #include "RoboClaw.h"
+#include "RoboClawCodec.h"
 
 #define MAXRETRY 2
+#define MAXWRITE 37 //Longest write_n frame (35 bytes) plus CRC
 #define SetDWORDval(arg) (uint8_t)(((uint32_t)arg)>>24),(uint8_t)(((uint32_t)arg)>>16),(uint8_t)(((uint32_t)arg)>>8),(uint8_t)arg
 #define SetWORDval(arg) (uint8_t)(((uint16_t)arg)>>8),(uint8_t)arg
 
@@ -81,6 +83,7 @@ int RoboClaw::peek()
 	else
 		return sserial->peek();
 #endif
+	return -1;
 }
 
 size_t RoboClaw::write(uint8_t byte)
@@ -91,6 +94,7 @@ size_t RoboClaw::write(uint8_t byte)
 	else
 		return sserial->write(byte);
 #endif
+	return 0;
 }
 
 int RoboClaw::read()
@@ -101,6 +105,7 @@ int RoboClaw::read()
 	else
 		return sserial->read();
 #endif
+	return -1;
 }
 
 int RoboClaw::available()
@@ -111,6 +116,7 @@ int RoboClaw::available()
 	else
 		return sserial->available();
 #endif
+	return 0;
 }
 
 void RoboClaw::flush()
@@ -143,6 +149,7 @@ int RoboClaw::read(uint32_t timeout)
 		}
 	}
 #endif
+	return -1;
 }
 
 void RoboClaw::clear()
@@ -166,15 +173,7 @@ void RoboClaw::crc_clear()
 
 void RoboClaw::crc_update (uint8_t data)
 {
-	int i;
-	crc = crc ^ ((uint16_t)data << 8);
-	for (i=0; i<8; i++)
-	{
-		if (crc & 0x8000)
-			crc = (crc << 1) ^ 0x1021;
-		else
-			crc <<= 1;
-	}
+	crc = roboclaw_crc_update(crc, data);
 }
 
 uint16_t RoboClaw::crc_get()
@@ -185,20 +184,27 @@ uint16_t RoboClaw::crc_get()
 bool RoboClaw::write_n(uint8_t cnt, ... )
 {
 	uint8_t trys=MAXRETRY;
+	uint8_t frame[MAXWRITE];
+
+	//Build the frame once, then send it in one go on every try
+	va_list marker;
+	va_start( marker, cnt );     /* Initialize variable arguments. */
+	for(uint8_t index=0;index<cnt;index++){
+		frame[index] = va_arg(marker, int);
+	}
+	va_end( marker );              /* Reset variable arguments.      */
+	crc = RoboClawCodec::crc(frame,cnt);
+	RoboClawCodec::put16(&frame[cnt],crc);
+
 	do{
-		crc_clear();
-		//send data with crc
-		va_list marker;
-		va_start( marker, cnt );     /* Initialize variable arguments. */
-		for(uint8_t index=0;index<cnt;index++){
-			uint8_t data = va_arg(marker, int);
-			crc_update(data);
-			write(data);
+		if(hserial){
+			hserial->write(frame,cnt+2);
 		}
-		va_end( marker );              /* Reset variable arguments.      */
-		uint16_t crc = crc_get();
-		write(crc>>8);
-		write(crc);
+#ifdef __AVR__
+		else{
+			sserial->write(frame,cnt+2);
+		}
+#endif
 		if(read(timeout)==0xFF)
 			return true;
 	}while(trys--);
@@ -284,8 +290,6 @@ bool RoboClaw::read_n(uint8_t cnt,uint8_t address,uint8_t cmd,...)
 }
 
 uint8_t RoboClaw::Read1(uint8_t address,uint8_t cmd,bool *valid){
-	uint8_t crc;
-
 	if(valid)
 		*valid = false;
 	
@@ -327,8 +331,6 @@ uint8_t RoboClaw::Read1(uint8_t address,uint8_t cmd,bool *valid){
 }
 
 uint16_t RoboClaw::Read2(uint8_t address,uint8_t cmd,bool *valid){
-	uint8_t crc;
-
 	if(valid)
 		*valid = false;
 	
@@ -376,8 +378,6 @@ uint16_t RoboClaw::Read2(uint8_t address,uint8_t cmd,bool *valid){
 }
 
 uint32_t RoboClaw::Read4(uint8_t address, uint8_t cmd, bool *valid){
-	uint8_t crc;
-	
 	if(valid)
 		*valid = false;
 	
@@ -437,8 +437,6 @@ uint32_t RoboClaw::Read4(uint8_t address, uint8_t cmd, bool *valid){
 }
 
 uint32_t RoboClaw::Read4_1(uint8_t address, uint8_t cmd, uint8_t *status, bool *valid){
-	uint8_t crc;
-
 	if(valid)
 		*valid = false;
 	
@@ -881,8 +879,6 @@ bool RoboClaw::SetPinFunctions(uint8_t address, uint8_t S3mode, uint8_t S4mode,
 }
 
 bool RoboClaw::GetPinFunctions(uint8_t address, uint8_t &S3mode, uint8_t &S4mode, uint8_t &S5mode){
-	uint8_t crc;
-	bool valid = false;
 	uint8_t val1,val2,val3;
 	uint8_t trys=MAXRETRY;
 	int16_t data;
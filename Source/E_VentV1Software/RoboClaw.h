@@ -30,7 +30,9 @@ class RoboClaw : public Stream
 #ifdef __AVR__
 	SoftwareSerial *sserial;
 #endif
-	
+
+public:
+	// Command codes, public so other transports can build packets.
 	enum {M1FORWARD = 0,
 			M1BACKWARD = 1,
 			SETMINMB = 2,
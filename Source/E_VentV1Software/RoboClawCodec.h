@@ -0,0 +1,78 @@
+/* Packet serial frames for the RoboClaw motor controller.
+
+   RoboClaw::write_n takes every byte of a frame as a variadic argument and
+   updates the CRC a bit at a time. The codec instead packs each command
+   straight into a caller supplied buffer, with fixed argument lists, and
+   updates the CRC a byte at a time from a table in flash. The finished frame
+   can then be handed to the UART in a single write.
+
+   Every encoder returns the length of the frame it wrote. Write frames end
+   with their CRC. Read frames are only the address and command; the CRC
+   comes back at the end of the reply.
+ */
+
+#ifndef RoboClawCodec_h
+#define RoboClawCodec_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "RoboClaw.h"
+
+const uint8_t ROBOCLAW_MAX_FRAME = 21; // Bytes, including CRC. SpeedAccelDeccelPositionM1 is the largest we send
+
+// Packet serial baud rate field of the configuration word, see SETCONFIG in
+// the RoboClaw user manual.
+const uint16_t ROBOCLAW_CONFIG_BAUD_MASK = 0x00E0;
+const uint16_t ROBOCLAW_BAUD_INVALID     = 0xFFFF;
+
+extern const uint16_t ROBOCLAW_CRC_TABLE[256] PROGMEM;
+
+
+/* CRC16 (polynomial 0x1021, initial value 0) over one more byte.
+ */
+inline uint16_t roboclaw_crc_update(uint16_t crc, uint8_t data) {
+    return (crc << 8) ^ pgm_read_word(&ROBOCLAW_CRC_TABLE[(uint8_t)(crc >> 8) ^ data]);
+}
+
+
+class RoboClawCodec {
+public:
+    static uint16_t crc(const uint8_t *data, uint8_t length, uint16_t crc = 0);
+
+    /* Frame an arbitrary write command. frame must hold length + 4 bytes.
+     */
+    static uint8_t Write(uint8_t *frame, uint8_t address, uint8_t cmd, const uint8_t *payload, uint8_t length);
+
+    /* Frame a read command. The reply is the data followed by a CRC over
+       address, command and data.
+     */
+    static uint8_t Read(uint8_t *frame, uint8_t address, uint8_t cmd);
+
+    static uint8_t SpeedM1(uint8_t *frame, uint8_t address, uint32_t speed);
+    static uint8_t SpeedDistanceM1(uint8_t *frame, uint8_t address, uint32_t speed, uint32_t distance, uint8_t flag);
+    static uint8_t SpeedAccelDeccelPositionM1(uint8_t *frame, uint8_t address, uint32_t accel, uint32_t speed,
+                                              uint32_t deccel, uint32_t position, uint8_t flag);
+    static uint8_t SetEncM1(uint8_t *frame, uint8_t address, int32_t val);
+    static uint8_t SetConfig(uint8_t *frame, uint8_t address, uint16_t config);
+
+    /* Baud rate field of the configuration word for baud, or
+       ROBOCLAW_BAUD_INVALID if the RoboClaw does not support it.
+     */
+    static uint16_t baudConfig(long baud);
+
+    // Big endian helpers.
+    static uint8_t *put32(uint8_t *data, uint32_t value);
+    static uint8_t *put16(uint8_t *data, uint16_t value);
+    static uint32_t get32(const uint8_t *data);
+    static uint16_t get16(const uint8_t *data);
+
+private:
+    // Append the CRC of everything from frame up to end, and return the frame length.
+    static uint8_t finish(uint8_t *frame, uint8_t *end);
+};
+
+#endif
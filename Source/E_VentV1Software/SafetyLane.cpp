@@ -0,0 +1,98 @@
+#include "SafetyLane.h"
+
+#include "breathing.h"
+#include "Log.h"
+
+constexpr Pressure SAFETY_STOP_PRESSURE = Pressure::from_float(MAX_PRESSURE);
+static_assert(Pressure::fits(MAX_PRESSURE), "MAX_PRESSURE out of range");
+
+static MotorLink *lane_link = NULL;
+
+// Written from the main loop and the TWI interrupt.
+static volatile bool pressure_armed = false;
+static volatile bool pressure_tripped = false;
+static volatile bool fatal = false;
+static volatile bool acknowledged = false;
+
+// Main loop only.
+static uint16_t logged_stops = 0;
+static unsigned long fatal_sent_at = 0; // ms
+
+
+static void stopAcknowledged(bool valid, const uint8_t *data, uint8_t length) {
+    if (valid && fatal) {
+        acknowledged = true;
+    }
+}
+
+
+void safety_lane_begin(MotorLink &link, const uint8_t address) {
+    link.prepareStop(address, stopAcknowledged);
+    lane_link = &link;
+}
+
+
+void safety_lane_sample(const unsigned long time, const Pressure pressure) {
+    if (pressure_armed && pressure > SAFETY_STOP_PRESSURE && lane_link) {
+        pressure_armed = false;
+        pressure_tripped = true;
+        lane_link->stopNow(time);
+    }
+}
+
+
+void arm_pressure_stop() {
+    pressure_tripped = false;
+    if (!fatal) {
+        pressure_armed = true;
+    }
+}
+
+
+void disarm_pressure_stop() {
+    pressure_armed = false;
+}
+
+
+void safety_stop() {
+    if (acknowledged || !lane_link) {
+        return;
+    }
+
+    if (fatal && (millis() - fatal_sent_at) < SAFETY_STOP_RESEND_MS) {
+        return;
+    }
+
+    fatal_sent_at = millis();
+    unsigned long now = micros();
+
+    cli();
+    fatal = true;
+    pressure_armed = false;
+    lane_link->stopNow(now);
+    sei();
+}
+
+
+bool pressure_stopped() {
+    return pressure_tripped;
+}
+
+
+bool safety_stopped() {
+    return acknowledged;
+}
+
+
+void safety_lane_poll() {
+    if (!lane_link) {
+        return;
+    }
+
+    const MotorLinkStats &stats = lane_link->stats();
+
+    if (stats.stops != logged_stops) {
+        logged_stops = stats.stops;
+        LOG2(LOG_SAFETY_STOP, stats.stops, stats.last_stop_latency);
+    }
+}
@@ -0,0 +1,84 @@
+/* Safety lane: stop the motor without waiting on the main loop.
+
+   A high pressure used to stop the motor only once the breath state
+   machine next checked the pressure and its inhale abort command made it
+   through the motor queue, and a failure only once handle_motor queued a
+   stop on a later step. Both waited on whatever else the loop was doing.
+
+   The lane stops the motor with MotorLink::stopNow, which hands a stop
+   frame encoded at setup straight to the UART, ahead of anything queued:
+
+   - High pressure: the TWI interrupt passes every pressure sample to
+     safety_lane_sample. While armed, from the inhale move being queued to
+     the end of the inhale, a sample over MAX_PRESSURE stops the motor there
+     and then. It trips once per arming, so it never stops the motor on
+     its way back. Once stopped, the airway pressure can fall back under
+     the limit, so the breath state machine raises the alarm from
+     pressure_stopped and aborts the inhale as before.
+   - Failure: safety_stop, where a fatal fault latches. Latched until a
+     restart; arming does nothing after it. The stop copy MotorLink queues
+     can fail on every retry, if the controller is not answering, so until
+     one is acknowledged safety_stop sends the stop again, at most every
+     SAFETY_STOP_RESEND_MS.
+
+   The time from the sample, or the call, to the frame going to the UART
+   is kept in the MotorLink stats (command 'm'), and every stop is logged
+   as LOG_SAFETY_STOP.
+ */
+
+#ifndef SafetyLane_h
+#define SafetyLane_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "MotorLink.h"
+#include "FixedPoint.h"
+
+// Long enough for the stop copy to be tried MOTOR_LINK_MAX_RETRY times.
+const unsigned long SAFETY_STOP_RESEND_MS = 250;
+
+
+/* Encode the stop frame for link. Call in setup.
+ */
+void safety_lane_begin(MotorLink &link, const uint8_t address);
+
+
+/* Check one sample. Called from the TWI interrupt for every sample.
+   time is micros() when the sample was taken.
+ */
+void safety_lane_sample(const unsigned long time, const Pressure pressure);
+
+
+/* Stop on high pressure from now until disarm_pressure_stop.
+ */
+void arm_pressure_stop();
+
+void disarm_pressure_stop();
+
+
+/* True if the pressure stop has stopped the motor since it was last
+   armed.
+ */
+bool pressure_stopped();
+
+
+/* Stop now for a fatal fault, and stay stopped. Call again until
+   safety_stopped() to send the stop again if it has not been acknowledged.
+ */
+void safety_stop();
+
+
+/* True once the controller has acknowledged a safety_stop.
+ */
+bool safety_stopped();
+
+
+/* Log any stop since the last call. Call from the main loop.
+ */
+void safety_lane_poll();
+
+#endif
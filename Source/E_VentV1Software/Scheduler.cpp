@@ -0,0 +1,93 @@
+#include "Scheduler.h"
+
+
+// Wraparound safe "a is at or after b" for micros() timestamps.
+static bool time_reached(const unsigned long a, const unsigned long b) {
+    return (long)(a - b) >= 0;
+}
+
+
+void setup_tasks(Task *tasks, const uint8_t num_tasks) {
+    unsigned long now = micros();
+
+    for (uint8_t i = 0; i < num_tasks; i++) {
+        tasks[i].release  = now;
+        tasks[i].deadline = now + tasks[i].period;
+    }
+
+    reset_task_stats(tasks, num_tasks);
+}
+
+
+void run_tasks(Task *tasks, const uint8_t num_tasks) {
+    bool control_overrun = false;
+
+    for (uint8_t i = 0; i < num_tasks; i++) {
+        Task &task = tasks[i];
+        unsigned long start = micros();
+
+        if (!time_reached(start, task.release)) {
+            continue;
+        }
+
+        if (control_overrun && TASK_BACKGROUND == task.priority) {
+            task.shed++;
+        }
+        else {
+            task.run();
+
+            unsigned long finish = micros();
+            unsigned long run_time = finish - start;
+
+            task.runs++;
+            if (run_time > task.max_run_time) {
+                task.max_run_time = run_time;
+            }
+
+            if (!time_reached(task.deadline, finish)) {
+                task.overruns++;
+
+                if (TASK_CONTROL == task.priority) {
+                    control_overrun = true;
+                }
+            }
+        }
+
+        // Next release. If we are more than a period behind, drop the
+        // missed releases and restart the period from now.
+        task.release = task.deadline;
+        if (!time_reached(task.release + task.period, micros())) {
+            task.release = micros();
+        }
+        task.deadline = task.release + task.period;
+    }
+}
+
+
+void print_task_stats(Print &out, const Task *tasks, const uint8_t num_tasks) {
+    out.println("task period runs overruns shed max_us");
+
+    for (uint8_t i = 0; i < num_tasks; i++) {
+        out.print(tasks[i].name);
+        out.print(' ');
+        out.print(tasks[i].period);
+        out.print(' ');
+        out.print(tasks[i].runs);
+        out.print(' ');
+        out.print(tasks[i].overruns);
+        out.print(' ');
+        out.print(tasks[i].shed);
+        out.print(' ');
+        out.println(tasks[i].max_run_time);
+    }
+}
+
+
+void reset_task_stats(Task *tasks, const uint8_t num_tasks) {
+    for (uint8_t i = 0; i < num_tasks; i++) {
+        tasks[i].max_run_time = 0;
+        tasks[i].runs = 0;
+        tasks[i].overruns = 0;
+        tasks[i].shed = 0;
+    }
+}
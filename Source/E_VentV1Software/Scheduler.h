@@ -0,0 +1,77 @@
+/* Cooperative fixed-rate scheduler for the main loop.
+
+   Each piece of work the ventilator does in loop() is wrapped in a Task with
+   a declared rate and priority. Tasks are released once per period and must
+   finish before the start of their next period (their deadline).
+
+   Tasks are listed in priority order: the task table is scanned from the
+   top on every call to run_tasks, so control tasks should come first. When a
+   control task misses its deadline, every TASK_BACKGROUND task (LCDs, serial
+   commands) that is due is shed for that pass so the control path can catch
+   up.
+ */
+
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+
+enum TaskPriority {
+                   TASK_CONTROL,    // Never shed, overruns shed background tasks.
+                   TASK_NORMAL,     // Never shed.
+                   TASK_BACKGROUND  // Shed whenever a control task overruns.
+};
+
+
+struct Task {
+    const char *name;
+    void (*run)(void);
+    unsigned long period; // us
+    TaskPriority priority;
+
+    // Bookkeeping, filled in by the scheduler.
+    unsigned long release;      // us; when the current period started.
+    unsigned long deadline;     // us; when the current period ends.
+    unsigned long max_run_time; // us; longest single run seen.
+    uint16_t runs;
+    uint16_t overruns;          // Runs that finished after their deadline.
+    uint16_t shed;              // Releases skipped to make room for control tasks.
+};
+
+
+/* Convert a rate in Hz to a task period in microseconds.
+ */
+constexpr unsigned long hz_to_period(unsigned long hz) {
+    return 1000000UL / hz;
+}
+
+
+/* Release every task for the first time at the current time.
+ */
+void setup_tasks(Task *tasks, const uint8_t num_tasks);
+
+
+/* Run every task that is due, in table order.
+
+   Tasks that have fallen more than one period behind are resynchronized to
+   the current time rather than run repeatedly to catch up.
+ */
+void run_tasks(Task *tasks, const uint8_t num_tasks);
+
+
+/* Print name, period, runs, overruns, shed releases and max run time for
+   each task, one task per line.
+ */
+void print_task_stats(Print &out, const Task *tasks, const uint8_t num_tasks);
+
+
+/* Clear run, overrun and shed counters as well as max run times.
+ */
+void reset_task_stats(Task *tasks, const uint8_t num_tasks);
+
+#endif
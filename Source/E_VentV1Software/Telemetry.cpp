@@ -0,0 +1,141 @@
+#include "Telemetry.h"
+
+#include "pressure.h"
+#include "Motor.h"
+#include "RoboClawCodec.h"
+
+
+static bool enabled = false;
+static uint16_t sequence = 0;
+static uint16_t dropped = 0;
+static unsigned long lastFrame = 0;
+
+// Encoded frame being sent.
+static uint8_t encoded[TELEMETRY_MAX_ENCODED];
+static uint8_t encodedLength = 0;
+static uint8_t encodedSent = 0;
+
+
+static uint8_t *put8(uint8_t *data, uint8_t value) {
+    *data++ = value;
+    return data;
+}
+
+static uint8_t *put16(uint8_t *data, uint16_t value) {
+    *data++ = value;
+    *data++ = value >> 8;
+    return data;
+}
+
+static uint8_t *put32(uint8_t *data, uint32_t value) {
+    data = put16(data, value);
+    return put16(data, value >> 16);
+}
+
+
+/* COBS encode length bytes of frame into encoded, followed by the 0
+   delimiter. Returns the encoded length.
+ */
+static uint8_t cobs_encode(const uint8_t *frame, uint8_t length, uint8_t *encoded) {
+    uint8_t code_index = 0;
+    uint8_t code = 1;
+    uint8_t out = 1;
+
+    for (uint8_t i = 0; i < length; i++) {
+        if (frame[i]) {
+            encoded[out++] = frame[i];
+            code++;
+        }
+
+        if (!frame[i] || 0xFF == code) {
+            encoded[code_index] = code;
+            code_index = out++;
+            code = 1;
+        }
+    }
+
+    encoded[code_index] = code;
+    encoded[out++] = 0;
+
+    return out;
+}
+
+
+static void build_frame(const VentilatorState &state) {
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    uint8_t *data = frame;
+    const MotorTelemetry &motor = getMotorTelemetry();
+
+    data = put8(data, TELEMETRY_FRAME_WAVEFORM);
+    data = put16(data, sequence);
+    data = put32(data, state.current_time);
+    data = put8(data, state.machine_state);
+    data = put8(data, state.ac_state);
+    data = put8(data, state.vc_state);
+    data = put16(data, state.errors);
+    data = put32(data, motor.position);
+    data = put32(data, motor.speed);
+
+    uint8_t *num_samples = data++;
+    PressureSample sample;
+    *num_samples = 0;
+    while (*num_samples < TELEMETRY_MAX_SAMPLES && getWaveformSample(sample)) {
+        data = put32(data, sample.time);
+        data = put16(data, sample.raw);
+        (*num_samples)++;
+    }
+
+    data = put16(data, RoboClawCodec::crc(frame, data - frame));
+
+    encodedLength = cobs_encode(frame, data - frame, encoded);
+    encodedSent = 0;
+}
+
+
+void telemetry_step(const VentilatorState &state, HardwareSerial &out) {
+    if (!enabled) {
+        return;
+    }
+
+    unsigned long now = millis();
+    if (now - lastFrame >= 1000 / TELEMETRY_RATE) {
+        lastFrame = now;
+
+        if (encodedSent < encodedLength) {
+            // Link saturated, keep sending the old frame.
+            dropped++;
+        }
+        else {
+            build_frame(state);
+        }
+        sequence++;
+    }
+
+    int room = out.availableForWrite();
+    while (room-- > 0 && encodedSent < encodedLength) {
+        out.write(encoded[encodedSent++]);
+    }
+}
+
+
+void telemetry_enable(const bool enable) {
+    enabled = enable;
+    encodedLength = 0;
+    encodedSent = 0;
+
+    // Samples are only pushed while there is a stream to take them. Drop
+    // what is left, so the next stream starts from fresh samples.
+    setWaveformSampling(enable);
+    PressureSample sample;
+    while (getWaveformSample(sample)) {}
+}
+
+
+bool telemetry_enabled() {
+    return enabled;
+}
+
+
+uint16_t telemetry_dropped() {
+    return dropped;
+}
@@ -0,0 +1,57 @@
+/* Binary telemetry stream of the breath waveform.
+
+   Every TELEMETRY_RATE a frame is built with the pressure samples taken
+   since the last one, the state machine states, the motor position and
+   speed and the alarm bits. Frames are sent on Serial, COBS encoded and
+   ended with a 0 byte, so a receiver can always find the next frame.
+
+   Frame contents, little endian, before encoding:
+   - uint8  TELEMETRY_FRAME_WAVEFORM
+   - uint16 sequence, counts every frame built, so gaps show dropped frames
+   - uint32 current_time (ms)
+   - uint8  machine_state, ac_state, vc_state
+   - uint16 errors
+   - int32  motor position (QP), motor speed (QPPS)
+   - uint8  number of samples, then for each:
+       uint32 time (us), uint16 sensor counts, decimated (PressureFilter.h)
+   - uint16 CRC16 (XMODEM, as RoboClawCodec) of everything above
+
+   A frame is larger than the Serial transmit buffer, so it goes out a piece
+   at a time as room frees up. If the previous frame is still going out when
+   the next one is due, the new one is dropped rather than waited for.
+
+   Source/Tools/decode_telemetry.py turns a capture into CSV.
+ */
+
+#ifndef Telemetry_h
+#define Telemetry_h
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "MachineStates.h"
+
+const uint8_t TELEMETRY_FRAME_WAVEFORM = 1;
+const uint8_t TELEMETRY_RATE           = 50; // Hz, frames
+const uint8_t TELEMETRY_MAX_SAMPLES    = 8;  // Per frame, PRESSURE_SAMPLE_RATE / TELEMETRY_RATE plus room for jitter
+
+// Encoded frame: header, samples and CRC, plus COBS overhead and the delimiter.
+const uint8_t TELEMETRY_MAX_FRAME = 20 + 6*TELEMETRY_MAX_SAMPLES + 2;
+const uint8_t TELEMETRY_MAX_ENCODED = TELEMETRY_MAX_FRAME + TELEMETRY_MAX_FRAME/254 + 2;
+
+
+/* Build a frame from state and the waveform samples that have arrived, and
+   send as much of it, or of the previous frame, as fits. Never waits.
+ */
+void telemetry_step(const VentilatorState &state, HardwareSerial &out);
+
+void telemetry_enable(const bool enable);
+
+bool telemetry_enabled();
+
+uint16_t telemetry_dropped();
+
+#endif
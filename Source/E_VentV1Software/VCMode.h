@@ -6,25 +6,23 @@
 
 #include "elapsedMillis.h"
 #include "MachineStates.h"
+#include "MotorLink.h"
 
 
 // ----------------------------------------------------------------------
 // Functions for handling the VC state machine.
 //
-// Each state is given its own function to hopefully make testing easier.
+// The states are a table run by BreathEngine, which also holds the
+// actions of each state. VC starts a breath as soon as the last one ends.
 // ----------------------------------------------------------------------
 
-/* Step the VC state machine.
-
-   Input:
-   - ventilator state
-   - inspiration time
-   - expiration time.
+/* Step the VC state machine and issue the motor command of the state it
+   ends in.
 
    Output:
-   - returns new state.
+   - updates state in place.
  */
-VentilatorState vc_mode_step(VentilatorState state);
+void vc_mode_step(MotorLink &controller_name, VentilatorState &state);
 
 
 /* Get a debug code for the current vcModeState.
@@ -38,27 +36,4 @@ VentilatorState vc_mode_step(VentilatorState state);
 int vcCodeAssignment(vcModeStates vcState);
 
 
-// ----------------------------------------------------------------------
-// Functions for handling particular states. These should NOT be called
-// in the main loop, but should be documented and available for testing.
-// ----------------------------------------------------------------------
-
-// TODO: These need to be documented with pre and postconditions.
-// These pre/post conditions currently exist in a spreadsheet.
-VentilatorState vcStart(VentilatorState state);
-
-VentilatorState vcInhaleCommand(VentilatorState state);
-
-VentilatorState vcInhale(VentilatorState state);
-
-VentilatorState vcInhaleAbort(VentilatorState state);
-
-VentilatorState vcPeak(VentilatorState state);
-
-VentilatorState vcExhaleCommand(VentilatorState state);
-
-VentilatorState vcExhale(VentilatorState state);
-
-VentilatorState vcReset(VentilatorState state);
-
 #endif
@@ -4,12 +4,29 @@
 #include "LCD.h"
 #include "breathing.h"
 #include "Motor.h"
+#include "SafetyLane.h"
+#include "BreathMetrics.h"
+#include "conversions.h"
 
 #include <assert.h>
 
 
 
 
+// ----------------------------------------------------------------------
+// Alarm limits, converted at compile time
+// ----------------------------------------------------------------------
+
+static_assert(Pressure::fits(MAX_PRESSURE) && Pressure::fits(MIN_PRESSURE)
+              && Pressure::fits(MAX_PEEP_PRESSURE) && Pressure::fits(MIN_PEEP_PRESSURE),
+              "pressure alarm limits out of range");
+
+constexpr Pressure HIGH_PRESSURE_LIMIT = Pressure::from_float(MAX_PRESSURE);
+constexpr Pressure LOW_PRESSURE_LIMIT = Pressure::from_float(MIN_PRESSURE);
+constexpr Pressure HIGH_PEEP_LIMIT = Pressure::from_float(MAX_PEEP_PRESSURE);
+constexpr Pressure LOW_PEEP_LIMIT = Pressure::from_float(MIN_PEEP_PRESSURE);
+
+
 // ----------------------------------------------------------------------
 // Timers for alarms
 // ----------------------------------------------------------------------
@@ -24,13 +41,22 @@ elapsedMillis highTempAlarmTimer;
 elapsedMillis apneaAlarmTimer;
 elapsedMillis deviceFaiulureAlarmTimer;
 
+// Breaths checked so far, see check_breath.
+static uint16_t checkedBreaths = 0;
+
+// Alarms ranked above a device failure in displayAlarms and reset_alarms.
+// FailureMode waits until these have been shown and reset.
+const uint16_t ALARMS_ABOVE_DEVICE_FAILURE = HIGH_PRESSURE_ALARM | LOW_PRESSURE_ALARM | HIGH_PEEP_ALARM
+                                           | LOW_PEEP_ALARM | DISCONNECT_ALARM | HIGH_TEMP_ALARM
+                                           | APNEA_ALARM | PRESSURE_SENSOR_ALARM;
+
 
 // ----------------------------------------------------------------------
 // Function definitions
 // ----------------------------------------------------------------------
 
-uint16_t check_high_pressure(const float pressure) {
-    if (pressure > MAX_PRESSURE) {
+uint16_t check_high_pressure(const Pressure pressure) {
+    if (pressure > HIGH_PRESSURE_LIMIT) {
         return HIGH_PRESSURE_ALARM;
     } else {
         return 0;
@@ -38,8 +64,8 @@ uint16_t check_high_pressure(const float pressure) {
 }
 
 
-uint16_t check_low_pressure(const float pressure) {
-    if (pressure < MIN_PRESSURE) {
+uint16_t check_low_pressure(const Pressure pressure) {
+    if (pressure < LOW_PRESSURE_LIMIT) {
         return LOW_PRESSURE_ALARM;
     } else {
         return 0;
@@ -47,13 +73,13 @@ uint16_t check_low_pressure(const float pressure) {
 }
 
 
-uint16_t check_pressure(const float pressure) {
+uint16_t check_pressure(const Pressure pressure) {
     return check_high_pressure(pressure) | check_low_pressure(pressure);
 }
 
 
-uint16_t check_high_peep(const float pressure) {
-    if (pressure > MAX_PEEP_PRESSURE) {
+uint16_t check_high_peep(const Pressure pressure) {
+    if (pressure > HIGH_PEEP_LIMIT) {
         return HIGH_PEEP_ALARM;
     } else {
         return 0;
@@ -61,8 +87,8 @@ uint16_t check_high_peep(const float pressure) {
 }
 
 
-uint16_t check_low_peep(const float pressure) {
-    if (pressure < MIN_PEEP_PRESSURE) {
+uint16_t check_low_peep(const Pressure pressure) {
+    if (pressure < LOW_PEEP_LIMIT) {
         return LOW_PEEP_ALARM;
     } else {
         return 0;
@@ -70,10 +96,14 @@ uint16_t check_low_peep(const float pressure) {
 }
 
 
-uint16_t check_peep(const float pressure) {
+uint16_t check_peep(const Pressure pressure) {
     return check_high_peep(pressure) | check_low_peep(pressure);
 }
 
+uint16_t check_breath(const BreathMetrics &metrics) {
+    return check_peep(metrics.peep);
+}
+
 uint16_t check_controller_temperature(const uint16_t temperature){
     if (temperature > MAX_CONTROLLER_TEMPERATURE) {
         return HIGH_TEMP_ALARM;
@@ -90,12 +120,45 @@ uint16_t check_motor_position(const long int current_position, const long int ex
     }
 }
 
+uint16_t check_controller_error(const uint32_t error) {
+    if (error & MOTOR_CONTROLLER_FAULTS) {
+        return DEVICE_FAILURE_ALARM;
+    } else {
+        return 0;
+    }
+}
+
+uint16_t check_telemetry_age(const unsigned long age) {
+    if (age > MOTOR_TELEMETRY_MAX_AGE) {
+        return DEVICE_FAILURE_ALARM;
+    } else {
+        return 0;
+    }
+}
+
+uint16_t check_pressure_sample_age(const unsigned long age) {
+    if (age > PRESSURE_SAMPLE_MAX_AGE) {
+        return PRESSURE_SENSOR_ALARM;
+    } else {
+        return 0;
+    }
+}
+
+
+
+void handle_alarms(volatile boolean &alarmReset, VentilatorState &state) {
+    // Once per breath, as it is published
+    if (breath_metrics_count() != checkedBreaths) {
+        checkedBreaths = breath_metrics_count();
+        state.errors |= check_breath(last_breath_metrics());
+    }
 
+    // The trigger, the pressure stop and the metrics all go without samples
+    state.errors |= check_pressure_sample_age(getPressureSampleAge());
 
-VentilatorState handle_alarms(volatile boolean &alarmReset, VentilatorState &state, LiquidCrystal &displayName, UserParameter *userParameters, SelectedParameter &currentlySelectedParameter) {
     if (state.errors) { // There is an unserviced error
         // Control the buzzer
-        if (alarmBuzzerTimer > (ALARM_SOUND_LENGTH*1000)) {
+        if (alarmBuzzerTimer > seconds_to_ms(ALARM_SOUND_LENGTH)) {
             // Reset the timer
             alarmBuzzerTimer = 0;
 
@@ -105,45 +168,12 @@ VentilatorState handle_alarms(volatile boolean &alarmReset, VentilatorState &sta
             digitalWrite(ALARM_RELAY_PIN,!digitalRead(ALARM_RELAY_PIN));
         }
 
-        // Provide the appropriate screen for the error, error flags held in a 16 bit unsigned integer
-        if (state.errors & HIGH_PRESSURE_ALARM) {
-            // Display high pressure alarm screen
-            displayHighPressureAlarm(displayName, state.peak_pressure, LCD_MAX_STRING);
-        }
-        else if (state.errors & LOW_PRESSURE_ALARM) {
-            // Display low pressure alarm screen
-            displayLowPressureAlarm(displayName, state.peak_pressure, LCD_MAX_STRING);
-        }
-        else if (state.errors & HIGH_PEEP_ALARM) {
-            // Display high PEEP alarm screen
-            displayHighPEEPAlarm(displayName, state.peep_pressure, LCD_MAX_STRING);
-        }
-        else if (state.errors & LOW_PEEP_ALARM) {
-            // Display low PEEP alarm screen
-            displayLowPEEPAlarm(displayName, state.peep_pressure, LCD_MAX_STRING);
-        }
-        else if (state.errors & DISCONNECT_ALARM) {
-            // Display disconnect alarm (also a low pressure alarm)
-            displayDisconnectAlarm(displayName);
-        }
-        else if (state.errors & HIGH_TEMP_ALARM) {
-            // Display high temp alarm screen
-            displayTemperatureAlarm(displayName, state.controller_temperature, LCD_MAX_STRING);
-        }
-        else if (state.errors & APNEA_ALARM) {
-            // Display the apnea alarm screen
-            displayApneaAlarm(displayName);
-        }
-        else if (state.errors & DEVICE_FAILURE_ALARM) {
-            displayDeviceFailureAlarm(displayName);
+        if ((state.errors & DEVICE_FAILURE_ALARM) && !(state.errors & ALARMS_ABOVE_DEVICE_FAILURE)) {
+            // Stop now, not once the state machine gets to FailureMode
+            safety_stop();
             state.machine_state = FailureMode;
         }
-        else{
-            // TODO: I (Calvin) am actually pretty nervous about this default.
-            // I feel like we should display an unspecified error or something.
-            assert(false);  // This should NOT happen.
-            state.errors = 0;
-        }
+
         cli();
         if(alarmReset){
           alarmReset = false;
@@ -153,16 +183,59 @@ VentilatorState handle_alarms(volatile boolean &alarmReset, VentilatorState &sta
         sei();
     }
     else{
-
-        displayAlarmParameters(currentlySelectedParameter, displayName, userParameters);
-
         alarmBuzzerTimer = 0;
         digitalWrite(ALARM_BUZZER_PIN,LOW);
         digitalWrite(ALARM_LED_PIN,LOW);
         digitalWrite(ALARM_RELAY_PIN,LOW);
     }
+}
+
+void displayAlarms(const VentilatorState &state, LCDBuffer &displayName, UserParameter *userParameters, SelectedParameter &currentlySelectedParameter) {
+    const BreathMetrics &metrics = last_breath_metrics();
 
-    return state;
+    // Provide the appropriate screen for the error, error flags held in a 16 bit unsigned integer
+    if (!state.errors) {
+        displayAlarmParameters(currentlySelectedParameter, displayName, userParameters);
+    }
+    else if (state.errors & HIGH_PRESSURE_ALARM) {
+        // Display high pressure alarm screen
+        displayHighPressureAlarm(displayName, metrics.pip.to_float(), LCD_MAX_STRING);
+    }
+    else if (state.errors & LOW_PRESSURE_ALARM) {
+        // Display low pressure alarm screen
+        displayLowPressureAlarm(displayName, metrics.pip.to_float(), LCD_MAX_STRING);
+    }
+    else if (state.errors & HIGH_PEEP_ALARM) {
+        // Display high PEEP alarm screen
+        displayHighPEEPAlarm(displayName, metrics.peep.to_float(), LCD_MAX_STRING);
+    }
+    else if (state.errors & LOW_PEEP_ALARM) {
+        // Display low PEEP alarm screen
+        displayLowPEEPAlarm(displayName, metrics.peep.to_float(), LCD_MAX_STRING);
+    }
+    else if (state.errors & DISCONNECT_ALARM) {
+        // Display disconnect alarm (also a low pressure alarm)
+        displayDisconnectAlarm(displayName);
+    }
+    else if (state.errors & HIGH_TEMP_ALARM) {
+        // Display high temp alarm screen
+        displayTemperatureAlarm(displayName, state.controller_temperature, LCD_MAX_STRING);
+    }
+    else if (state.errors & APNEA_ALARM) {
+        // Display the apnea alarm screen
+        displayApneaAlarm(displayName);
+    }
+    else if (state.errors & PRESSURE_SENSOR_ALARM) {
+        displayPressureSensorAlarm(displayName);
+    }
+    else if (state.errors & DEVICE_FAILURE_ALARM) {
+        displayDeviceFailureAlarm(displayName);
+    }
+    else{
+        // TODO: I (Calvin) am actually pretty nervous about this default.
+        // I feel like we should display an unspecified error or something.
+        assert(false);  // This should NOT happen.
+    }
 }
 
 void reset_alarms(VentilatorState &state)
@@ -195,6 +268,10 @@ void reset_alarms(VentilatorState &state)
       // Reset the apnea alarm
       state.errors &= (~APNEA_ALARM);
   }
+  else if (state.errors & PRESSURE_SENSOR_ALARM) {
+      // Reset the pressure sensor alarm, raised again while samples are stale
+      state.errors &= (~PRESSURE_SENSOR_ALARM);
+  }
   else if (state.errors & DEVICE_FAILURE_ALARM) {
       //No point in resetting this alarm since we are going to a fault state
       //state.machine_state = FailureMode; this is handled before 
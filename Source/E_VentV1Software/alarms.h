@@ -4,8 +4,9 @@
 #ifndef alarms_h
 #define alarms_h
 
-#include <LiquidCrystal.h>
+#include "LCDBuffer.h"
 #include "MachineStates.h"
+#include "BreathMetrics.h"
 #include "updateUserParameters.h"
 #include "UserParameter.h"
 #include <assert.h>
@@ -17,7 +18,7 @@
 #endif
 
 // Alarm Sound definitions
-const float ALARM_SOUND_LENGTH = 0.5; //Seconds
+constexpr float ALARM_SOUND_LENGTH = 0.5; //Seconds
 
 // Alarm pins
 const int ALARM_BUZZER_PIN = 11;
@@ -58,7 +59,7 @@ const uint16_t DISCONNECT_ALARM      = 0x01 << 4;
 const uint16_t HIGH_TEMP_ALARM       = 0x01 << 5;
 const uint16_t APNEA_ALARM           = 0x01 << 6;
 const uint16_t DEVICE_FAILURE_ALARM  = 0x01 << 7;
-//const uint16_t PRESSURE_SENSOR_ALARM = 0x01 << 8;
+const uint16_t PRESSURE_SENSOR_ALARM = 0x01 << 8;
 
 // Functions for triggering alarms.
 
@@ -72,7 +73,7 @@ const uint16_t DEVICE_FAILURE_ALARM  = 0x01 << 7;
    - Returns error code for HIGH_PRESSURE_ALARM if there is high
      pressure, and 0 otherwise.
  */
-uint16_t check_high_pressure(const float pressure);
+uint16_t check_high_pressure(const Pressure pressure);
 
 
 /* Function to check for low pressure.
@@ -84,7 +85,7 @@ uint16_t check_high_pressure(const float pressure);
      pressure, and 0 otherwise.
  */
 // TODO we NEVER check for low pressure anywhere!!!!
-uint16_t check_low_pressure(const float pressure);
+uint16_t check_low_pressure(const Pressure pressure);
 
 /* Function to check for both high / low pressure.
 
@@ -95,7 +96,7 @@ uint16_t check_low_pressure(const float pressure);
      pressure, LOW_PRESSURE_ALARM set if there is low pressure, and
      0 otherwise.
  */
-uint16_t check_pressure(const float pressure);
+uint16_t check_pressure(const Pressure pressure);
 
 
 /* Function to check for high peep pressure.
@@ -106,7 +107,7 @@ uint16_t check_pressure(const float pressure);
    - Returns error code for HIGH_PEEP_ALARM if there is high
      pressure, and 0 otherwise.
  */
-uint16_t check_high_peep(const float pressure);
+uint16_t check_high_peep(const Pressure pressure);
 
 
 /* Function to check for low peep pressure.
@@ -117,7 +118,7 @@ uint16_t check_high_peep(const float pressure);
    - Returns error code for LOW_PEEP_ALARM if there is low
      pressure, and 0 otherwise.
  */
-uint16_t check_low_peep(const float pressure);
+uint16_t check_low_peep(const Pressure pressure);
 
 
 /* Function to check for both high / low peep pressure.
@@ -130,7 +131,18 @@ uint16_t check_low_peep(const float pressure);
      0 otherwise.
  */
 
-uint16_t check_peep(const float pressure);
+uint16_t check_peep(const Pressure pressure);
+
+
+/* Function to check the measurements of a whole breath.
+
+   Input:
+   - Takes in the metrics of the breath
+   Output:
+   - Returns error code with the PEEP alarms, as check_peep, for the PEEP
+     measured at the end of the exhale.
+ */
+uint16_t check_breath(const BreathMetrics &metrics);
 
 
 uint16_t check_controller_temperature(const uint16_t temperature);
@@ -138,17 +150,63 @@ uint16_t check_controller_temperature(const uint16_t temperature);
 uint16_t check_motor_position(const long int current_position, const long int expected_position);
 
 
+/* Function to check the motor controller error word.
+
+   Input:
+   - Takes in the error word read from the controller
+   Output:
+   - Returns error code for DEVICE_FAILURE_ALARM if any of the
+     MOTOR_CONTROLLER_FAULTS bits are set, and 0 otherwise.
+ */
+uint16_t check_controller_error(const uint32_t error);
+
+
+/* Function to check that a motor telemetry reading is recent enough
+   to be trusted.
+
+   Input:
+   - Takes in the age of the reading in ms
+   Output:
+   - Returns error code for DEVICE_FAILURE_ALARM if the reading is
+     older than MOTOR_TELEMETRY_MAX_AGE, and 0 otherwise.
+ */
+uint16_t check_telemetry_age(const unsigned long age);
+
+
+/* Function to check that pressure samples are still coming in.
+
+   Input:
+   - Takes in the age of the newest sample in ms
+   Output:
+   - Returns error code for PRESSURE_SENSOR_ALARM if the sample is
+     older than PRESSURE_SAMPLE_MAX_AGE, and 0 otherwise.
+ */
+uint16_t check_pressure_sample_age(const unsigned long age);
+
+
 /* Function to handle alarms
 
    Input:
    - Takes in error flags
 
    Postconditions:
-   - TODO: currently does nothing, should raise alarms (LCD, beeping)
-   - TODO: will reset the errors flag --- only in certain conditions.
-   - TODO: can resent machine state!!!
+   - Checks each breath, once, as its metrics are published.
+   - Checks that pressure samples are still coming in.
+   - Toggles the buzzer, LED and relay while there are unserviced errors.
+   - Resets the highest priority error when the alarm reset button was pressed.
+   - Enters FailureMode on a device failure, once it is the highest
+     priority error.
+ */
+void handle_alarms(volatile boolean &alarmReset, VentilatorState &state);
+
+
+/* Function to display the alarm screen
+
+   Shows the screen for the highest priority error, or the alarm setpoints
+   when there are no errors. Kept separate from handle_alarms so that the
+   display can be refreshed at a lower rate than the alarm logic runs.
  */
-VentilatorState handle_alarms(volatile boolean &alarmReset, VentilatorState &state, LiquidCrystal &displayName, UserParameter *userParameters, SelectedParameter &currentlySelectedParameter);
+void displayAlarms(const VentilatorState &state, LCDBuffer &displayName, UserParameter *userParameters, SelectedParameter &currentlySelectedParameter);
 
 /* TODO: Check alarms more frequently?
 
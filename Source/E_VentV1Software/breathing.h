@@ -8,6 +8,7 @@
 
 
 const float SECONDS_PER_MINUTE = 60.0;
+const long MS_PER_MINUTE = 60000;
 
 // Threshold Pressure Definitions--------------------------------------------------
 
@@ -26,6 +27,7 @@ const float DEFAULT_BPM = 16.0; //Breaths per Minute
 const float MIN_TIDAL_VOLUME     = 5.0; //Tidal Volume (% of max)
 const float MAX_TIDAL_VOLUME     = 100.0; //Tidal Volume (% of max)
 const float DEFAULT_TIDAL_VOLUME = 50.0; //Tidal Volume (% of max)
+const float BAG_FULL_STROKE_VOLUME = 800.0; //mL pushed out of the bag at 100%, TODO: measure on the bag
 //------------------------------------------------------------------------------
 
 // Inspiration Expiration Ratio Definitions--------------------------------------
@@ -39,12 +41,12 @@ const float MIN_PLATEAU_PAUSE_TIME     = 0.10; //Seconds
 const float MAX_PLATEAU_PAUSE_TIME     = 0.50; //Seconds
 const float DEFAULT_PLATEAU_PAUSE_TIME = 0.5; //Seconds
 //Max & Min PIP Pressures--------------------------------------------------------
-const float MAX_PRESSURE = 40.0; //cmH2O
-const float MIN_PRESSURE = 0.0; //cmH2O
+constexpr float MAX_PRESSURE = 40.0; //cmH2O
+constexpr float MIN_PRESSURE = 0.0; //cmH2O
 
 //Max & Min PEEP Pressures-----------------------------------------------------------
-const float MAX_PEEP_PRESSURE = 30.0; //cmH2O
-const float MIN_PEEP_PRESSURE = 0.0; //cmH2O
+constexpr float MAX_PEEP_PRESSURE = 30.0; //cmH2O
+constexpr float MIN_PEEP_PRESSURE = 0.0; //cmH2O
 //------------------------------------------------------------------------------
 
 // ----------------------------------------------------------------------
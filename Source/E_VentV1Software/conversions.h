@@ -4,6 +4,16 @@
 #ifndef conversions_h
 #define conversions_h
 
+#include <stdint.h>
+
 const float S_TO_MS = 1000.0f;
 
+
+/* Whole milliseconds in seconds, rounded. Negative times are 0. Constexpr,
+   so constants are converted at compile time.
+ */
+constexpr uint16_t seconds_to_ms(const float seconds) {
+    return (seconds > 0) ? (uint16_t)(seconds * S_TO_MS + 0.5f) : 0;
+}
+
 #endif
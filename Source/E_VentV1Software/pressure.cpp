@@ -1,39 +1,170 @@
 #include "pressure.h"
+#include "Log.h"
+#include "PatientTrigger.h"
+#include "SafetyLane.h"
 
-// TODO: Replace the adc to voltage conversion factor in readPressureSensor
+static RingBuffer<FilteredPressure, PRESSURE_BUFFER_SIZE> pressureSamples;
+static RingBuffer<PressureSample, PRESSURE_BUFFER_SIZE> waveformSamples;
+static volatile uint16_t pressureReadFailures = 0;
+static volatile unsigned long pressureSampleTime = 0;
+static volatile unsigned long newestSampleTime = 0; //us; time of the newest sample pushed
+static volatile bool waveformSampling = false;
+
+//Only touched in the TWI interrupt.
+static PressureDecimator pressureDecimator;
+static PressureFilter pressureFilter;
+static uint8_t pressureSensorStatus = PRESSURE_STATUS_NORMAL;
+
+//Counts to cmH2O: counts above MIN_DIGITAL_OUTPUT times PRESSURE_SCALE, which is
+//cmH2O per count in Q8 with PRESSURE_SCALE_SHIFT more fraction bits, plus the
+//pressure at MIN_DIGITAL_OUTPUT.
+constexpr float PRESSURE_CMH2O_PER_COUNT = (MAX_SENSOR_PRESSURE - MIN_SENSOR_PRESSURE)*PSI_TO_CMH2O/(MAX_DIGITAL_OUTPUT - MIN_DIGITAL_OUTPUT);
+const uint8_t PRESSURE_SCALE_SHIFT = 14;
+constexpr int32_t PRESSURE_SCALE = PRESSURE_CMH2O_PER_COUNT*Pressure::scale()*(1L << PRESSURE_SCALE_SHIFT) + 0.5f;
+constexpr Pressure PRESSURE_AT_MIN_OUTPUT = Pressure::from_float(MIN_SENSOR_PRESSURE*PSI_TO_CMH2O);
+
+//Every reading, status bits masked off, has to fit, and counts*PRESSURE_SCALE can not overflow
+static_assert(Pressure::fits(MIN_SENSOR_PRESSURE*PSI_TO_CMH2O - MIN_DIGITAL_OUTPUT*PRESSURE_CMH2O_PER_COUNT)
+              && Pressure::fits(MIN_SENSOR_PRESSURE*PSI_TO_CMH2O + (PRESSURE_COUNTS_MASK - MIN_DIGITAL_OUTPUT)*PRESSURE_CMH2O_PER_COUNT),
+              "sensor range does not fit in Pressure");
+static_assert((float)PRESSURE_COUNTS_MASK*PRESSURE_SCALE < 2147483648.0f, "PRESSURE_SCALE_SHIFT too large");
 
 void setUpPressureSensor(uint32_t pressureSensorBaudRate){
-	
+
 	Wire.begin(9600); //TODO: Fix so that this isn't a magic number
-	
+
+}
+
+Pressure pressureCountsToCmH2O(const uint16_t raw){
+    int32_t counts = (int32_t)(raw & PRESSURE_COUNTS_MASK) - MIN_DIGITAL_OUTPUT; //Remove first two bits as per documentation
+
+    //pressure = ((output - MIN_DIGITAL_OUTPUT)*(MAX_SENSOR_PRESSURE - MIN_SENSOR_PRESSURE)/(MAX_DIGITAL_OUTPUT - MIN_DIGITAL_OUTPUT) + MIN_SENSOR_PRESSURE)*PSI_TO_CMH2O;
+    int32_t scaled = (counts*PRESSURE_SCALE + (1L << (PRESSURE_SCALE_SHIFT - 1))) >> PRESSURE_SCALE_SHIFT;
+    return Pressure::from_raw(scaled) + PRESSURE_AT_MIN_OUTPUT;
+}
+
+void startPressureSampling(){
+#ifdef TIMSK3 // Boards with a Timer3, the Mega and the host build
+    cli();
+
+    static_assert(F_CPU / 8 / PRESSURE_READ_RATE <= 65536, "PRESSURE_READ_RATE too low for clk/8");
+
+    // Timer3, CTC mode on OCR3A, clk/8
+    TCCR3A = 0;
+    TCCR3B = _BV(WGM32) | _BV(CS31);
+    TCNT3  = 0;
+    OCR3A  = (F_CPU / 8 / PRESSURE_READ_RATE) - 1;
+    TIMSK3 = _BV(OCIE3A);
+
+    newestSampleTime = micros();
+    sei();
+#endif
 }
 
-float readPressureSensor(){
-    uint8_t numberOfBytesToRequest = 2;
-    uint8_t msbStatusBitMask = 0b00111111;
+// Called from the TWI interrupt once the read started in
+// samplePressureSensor has finished.
+static void pressureReadComplete(uint8_t *data, uint8_t length){
+    if(length < 2){
+      pressureReadFailures++;
+      return;
+    }
+
+    PressureSample sample;
+    sample.time = pressureSampleTime;
 
-    uint8_t numBytesRead = Wire.requestFrom(PRESSURE_SENSOR_ADDRESS, numberOfBytesToRequest);
+    if(!pressure_decimate(pressureDecimator, (data[0]<<8) | data[1], sample.raw)){
+      return;
+    }
 
-    if(0 == numBytesRead){
-      //TODO: Add a device failure alarm here
+    newestSampleTime = sample.time;
+    if(waveformSampling){
+      waveformSamples.push(sample);
     }
-    delay(5);
-    uint8_t MSB = Wire.read();
-    uint8_t LSB = Wire.read();
 
-    MSB &= msbStatusBitMask; //Remove first two bits as per documentation
-    uint16_t output = (MSB<<8) | LSB;
+    // Here rather than in the state machine, so a trigger or a high
+    // pressure is seen as soon as the sample is in
+    Pressure pressure = pressureCountsToCmH2O(sample.raw);
+    safety_lane_sample(sample.time, pressure);
+    patient_trigger_sample(sample.time, pressure);
 
-    //float pressure = (((output - MIN_DIGITAL_OUTPUT) * (MAX_SENSOR_PRESSURE - MIN_SENSOR_PRESSURE)) / (MAX_DIGITAL_OUTPUT - MIN_DIGITAL_OUTPUT)) - MIN_SENSOR_PRESSURE;
-    float pressure = (output - MIN_DIGITAL_OUTPUT)*(MAX_SENSOR_PRESSURE - MIN_SENSOR_PRESSURE)/(MAX_DIGITAL_OUTPUT - MIN_DIGITAL_OUTPUT) + MIN_SENSOR_PRESSURE;
-    pressure = pressure*PSI_TO_CMH2O;
+    // Log the reading the sensor's status changes on, stale reads aside as
+    // the oversampling makes those routine
+    uint8_t status = sample.raw >> PRESSURE_STATUS_SHIFT;
+    if(PRESSURE_STATUS_STALE == status){
+      status = PRESSURE_STATUS_NORMAL;
+    }
+    if(status != pressureSensorStatus){
+      pressureSensorStatus = status;
+      LOG2(LOG_PRESSURE_READING, sample.raw, pressure.to_float());
+    }
+
+    FilteredPressure filtered;
+    pressure_filter_step(pressureFilter, sample.time, pressure, filtered);
+    pressureSamples.push(filtered);
+}
+
+void samplePressureSensor(){
+    if(Wire.requestBusy()){
+      // The previous read is still in flight
+      pressureReadFailures++;
+      return;
+    }
 
-    #ifdef NO_SENSOR_DEBUG
-      Serial.print("Output: ");
-      Serial.println(output);
-      Serial.print("Pressure: ");
-      Serial.println(pressure);
-    #endif
+    // The read is timestamped when it starts, so that the
+    // time between samples follows the timer rather than the bus.
+    pressureSampleTime = micros();
+
+    if(0 != Wire.startRequestFrom(PRESSURE_SENSOR_ADDRESS, 2, pressureReadComplete)){
+      pressureReadFailures++;
+    }
+}
+
+bool getPressureSample(FilteredPressure &sample){
+    return pressureSamples.pop(sample);
+}
+
+bool getWaveformSample(PressureSample &sample){
+    return waveformSamples.pop(sample);
+}
+
+void setWaveformSampling(const bool enable){
+    waveformSampling = enable;
+}
+
+uint16_t getPressureSamplesDropped(){
+    uint16_t dropped;
+
+    // Counted by the TWI interrupt, two bytes on the Mega
+    cli();
+    dropped = pressureSamples.droppedCount();
+    sei();
+
+    return dropped;
+}
+
+uint16_t getPressureReadFailures(){
+    uint16_t failures;
+
+    cli();
+    failures = pressureReadFailures;
+    sei();
+
+    return failures;
+}
+
+unsigned long getPressureSampleAge(){
+    unsigned long newest;
+
+    cli();
+    newest = newestSampleTime;
+    sei();
+
+    return (micros() - newest) / 1000;
+}
 
-    return pressure;
+#ifdef TIMSK3
+// Only starts the I2C read, the TWI interrupt finishes it.
+ISR(TIMER3_COMPA_vect){
+    samplePressureSensor();
 }
+#endif
@@ -9,8 +9,6 @@
 #ifndef pressure_h
 #define pressure_h
 
-#define NO_SENSOR_DEBUG
-
 #if ARDUINO >= 100
 #include "Arduino.h"
 #else
@@ -18,10 +16,13 @@
 #endif
 
 #include "src/SBWire/SBWire.h"
+#include "RingBuffer.h"
+#include "FixedPoint.h"
+#include "PressureFilter.h"
 
 //Pressure Sensor Definitions---------------------------------------------------
 #define PRESSURE_SENSOR_I2C Wire
-const float PSI_TO_CMH2O = 70.307;
+constexpr float PSI_TO_CMH2O = 70.307;
 const uint32_t PRESSURE_SENSOR_BAUD_RATE = 9600;
 const uint8_t PRESSURE_SENSOR_ADDRESS = 40; //Honeywell documentation
 
@@ -29,8 +30,25 @@ const uint16_t MAX_DIGITAL_OUTPUT = 14745; //Honeywell I2C comms documentation
 const uint16_t MIN_DIGITAL_OUTPUT = 1638; //Honeywell I2C comms documentation
 
 // TODO: Double check these constants. I'm unclear on the units.
-const float MIN_SENSOR_PRESSURE = -1.0; //PSI Differential
-const float MAX_SENSOR_PRESSURE = 1.0; //PSI Differential
+constexpr float MIN_SENSOR_PRESSURE = -1.0; //PSI Differential
+constexpr float MAX_SENSOR_PRESSURE = 1.0; //PSI Differential
+
+const uint8_t PRESSURE_STATUS_SHIFT = 14; //Top two bits of the reading are sensor status
+const uint16_t PRESSURE_COUNTS_MASK = 0x3FFF;
+const uint8_t PRESSURE_STATUS_NORMAL = 0;
+const uint8_t PRESSURE_STATUS_STALE = 2; //Read again before the sensor updated, the counts are good
+//------------------------------------------------------------------------------
+
+//Pressure Sampling Definitions-------------------------------------------------
+const unsigned long PRESSURE_SAMPLE_RATE = 200; //Hz, after decimation
+const unsigned long PRESSURE_READ_RATE = PRESSURE_SAMPLE_RATE*PRESSURE_OVERSAMPLE; //Hz, Timer3 driven
+const uint8_t PRESSURE_BUFFER_SIZE = 16; //Samples, must be a power of two
+const unsigned long PRESSURE_SAMPLE_MAX_AGE = 50; //ms; older samples raise a pressure sensor alarm
+
+struct PressureSample {
+    unsigned long time; //us; micros() when the newest read in it was taken
+    uint16_t raw;       //Decimated sensor counts, status bits included
+};
 //------------------------------------------------------------------------------
 
 
@@ -43,11 +61,57 @@ const float MAX_SENSOR_PRESSURE = 1.0; //PSI Differential
 void setUpPressureSensor(const uint32_t PRESSURE_SENSOR_BAUD_RATE);
 
 
-/* Function to read the pressure sensor on the PRESSURE_SENSOR_PIN.
- * Inputs: None.
- * Outputs:
- *  -The pressure is returned in a float in cmH2O
+/* Function to convert a raw sensor reading to cmH2O. Integer math only, it
+ * runs for every sample.
+ */
+Pressure pressureCountsToCmH2O(const uint16_t raw);
+
+
+/* Start reading the sensor at PRESSURE_READ_RATE from Timer3. Every read goes
+ * through the filters in PressureFilter.h, and the samples that come out are
+ * pushed into a ring buffer and read back with getPressureSample.
+ */
+void startPressureSampling();
+
+
+/* Start one read. The read finishes in the TWI interrupt, which filters it
+ * and pushes any sample into the sample buffers, so this never waits on the
+ * bus.
+ * Called from the Timer3 interrupt; exposed so it can be driven by something
+ * else off target.
+ */
+void samplePressureSensor();
+
+
+/* Pop the oldest buffered sample, filtered. Returns false if there is none.
+ */
+bool getPressureSample(FilteredPressure &sample);
+
+
+/* Pop the oldest sample, in sensor counts, from a second copy of the sample
+ * stream, kept for waveform capture, so every sample can be streamed
+ * whatever the state machine takes. Returns false if there is none.
+ */
+bool getWaveformSample(PressureSample &sample);
+
+
+/* Start or stop pushing samples for waveform capture. Off until turned on,
+ * so that with nobody reading them the samples do not pile up and overflow.
+ */
+void setWaveformSampling(const bool enable);
+
+
+/* Number of samples dropped because the main loop fell behind, and number of
+ * failed sensor reads.
+ */
+uint16_t getPressureSamplesDropped();
+
+uint16_t getPressureReadFailures();
+
+
+/* ms since the newest sample was read, or since sampling started if there
+ * has been none. Grows without bound if the sensor stops answering.
  */
-float readPressureSensor();
+unsigned long getPressureSampleAge();
 
 #endif // pressure_h
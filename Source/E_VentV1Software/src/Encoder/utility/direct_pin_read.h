@@ -59,6 +59,13 @@
 #define PIN_TO_BITMASK(pin)             (digitalPinToBitMask(pin))
 #define DIRECT_PIN_READ(base, mask)     (((*((base)+8)) & (mask)) ? 1 : 0)
 
+#elif defined(HOST_BUILD)
+
+#define IO_REG_TYPE                     uint8_t
+#define PIN_TO_BASEREG(pin)             (0)
+#define PIN_TO_BITMASK(pin)             (pin)
+#define DIRECT_PIN_READ(base, pin)      digitalRead(pin)
+
 #elif defined(RBL_NRF51822)
 
 #define IO_REG_TYPE                     uint32_t
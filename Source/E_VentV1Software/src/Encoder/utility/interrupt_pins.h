@@ -38,7 +38,7 @@
   #define CORE_INT1_PIN		3
 
 // Arduino Mega
-#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__) || defined(HOST_BUILD)
   #define CORE_NUM_INTERRUPT	6
   #define CORE_INT0_PIN		2
   #define CORE_INT1_PIN		3
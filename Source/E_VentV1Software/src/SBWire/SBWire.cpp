@@ -66,14 +66,14 @@ uint16_t TwoWire::getRecoveryCount()
 	return twi_getRecoveryCount();
 }
 
-void TwoWire::setTwiMaxLoops(uint16_t maxloops)
+void TwoWire::setTwiTimeoutMicros(uint32_t timeout)
 {
-	twi_setMaxLoops(maxloops);
+	twi_setTimeoutMicros(timeout);
 }
 
-uint16_t TwoWire::getTwiMaxLoops()
+uint32_t TwoWire::getTwiTimeoutMicros()
 {
-	return twi_getMaxLoops();
+	return twi_getTimeoutMicros();
 }
 
 
@@ -144,6 +144,27 @@ uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint32_t iaddres
   return read;
 }
 
+//	Starts a read and returns straight away. The callback is called from
+//	the TWI interrupt with the received bytes, or with a count of 0 if the
+//	read failed. A read that never finishes is given up on by the next
+//	requestBusy or startRequestFrom past the timeout, which then calls the
+//	callback with 0. Unlike requestFrom, the bytes do not go through
+//	rxBuffer, so read() and available() are not used with this call.
+//
+uint8_t TwoWire::startRequestFrom(uint8_t address, uint8_t quantity, void (*callback)(uint8_t*, uint8_t))
+{
+  // clamp to buffer length
+  if(quantity > BUFFER_LENGTH){
+    quantity = BUFFER_LENGTH;
+  }
+  return twi_startReadFrom(address, quantity, true, callback);
+}
+
+bool TwoWire::requestBusy()
+{
+  return twi_readBusy();
+}
+
 uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop) {
 	return requestFrom((uint8_t)address, (uint8_t)quantity, (uint32_t)0, (uint8_t)0, (uint8_t)sendStop);
 }
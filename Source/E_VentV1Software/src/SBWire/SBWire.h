@@ -77,8 +77,12 @@ class TwoWire : public Stream
 	//08/22/18 gfp: added for lockup parameter access
 	void clearRecoveryCount();
 	uint16_t getRecoveryCount();
-	void setTwiMaxLoops(uint16_t maxloops);
-	uint16_t getTwiMaxLoops();
+	void setTwiTimeoutMicros(uint32_t timeout);
+	uint32_t getTwiTimeoutMicros();
+
+	// Non-blocking master read, see twi_startReadFrom
+	uint8_t startRequestFrom(uint8_t, uint8_t, void (*)(uint8_t*, uint8_t));
+	bool requestBusy();
 
     inline size_t write(unsigned long n) { return write((uint8_t)n); }
     inline size_t write(long n) { return write((uint8_t)n); }
@@ -65,42 +65,49 @@ static volatile uint8_t twi_error;
 static uint16_t twi_lockup_recovery_count = 0;
 
 /**
- * This defines the maximum number of loops various while (...) continue;
+ * Timeout for the various while (...) continue; loops, in microseconds.
  *
- * Note that the amount of time this takes is somewhat dependent on F_CPU and
- * the expression inside the while conditional. It is set by SBWire using
- * fuzzy guessing based on F_CPU.
- *
- * This is chosen over doing millis() or micros() based timeouts to reduce
- * overhead.
- * make twi_maxloops something reasonable. Default I2C
- * freq is 100KHz, so 10 us, so lets wait around 100 us
- *
- * The maths: F_CPU>>20 is dividing by approximately 1e6, so from 16 MHz
- * we get 15. Multiplied by 100 we get 1500. 1500 cycles at 16 MHz is 93.75 us
+ * This used to be an iteration count (twi_maxloops), which made the actual
+ * time spent waiting depend on F_CPU and on the expression inside the while
+ * conditional. A deadline on micros() is independent of both. Default I2C
+ * freq is 100KHz, so a 2 byte read with its address byte takes around 300 us;
+ * allow a generous margin on top of that.
  */
-static volatile uint16_t twi_maxloops = 100 * (F_CPU>>20);
+static volatile uint32_t twi_timeout_us = TWI_TIMEOUT_US;
+
 /**
  * Added to allow for the SB_WAIT and SB_DOWHILE macros
  */
-static volatile uint16_t twi_loopcnt;
+#define SB_TIMED_OUT(START) ((micros() - (START)) >= twi_timeout_us)
+
+#define SB_RECOVER(TO_RET) \
+  do { twi_stop(); twi_init(); twi_lockup_recovery_count++; \
+    return TO_RET; \
+  } while(0)
+
 #define SB_WAIT(COND, TO_RET) \
-  do { twi_loopcnt = 0; \
-    while(COND && twi_loopcnt < twi_maxloops) { twi_loopcnt++;} \
-    if (twi_loopcnt >= twi_maxloops) {twi_stop(); twi_init(); twi_lockup_recovery_count++; \
-		return TO_RET;} \
+  do { unsigned long twi_waitStart = micros(); \
+    while(COND) { if (SB_TIMED_OUT(twi_waitStart)) SB_RECOVER(TO_RET); } \
   } while(0)
 
 #define SB_DOWHILE(COND, TO_RET, LOOP_STATEMENT) \
-  do { \
-    twi_loopcnt = 0; \
+  do { unsigned long twi_waitStart = micros(); \
     do { \
-      LOOP_STATEMENT; twi_loopcnt++; \
-    } while (COND && twi_loopcnt < twi_maxloops); \
-    if (twi_loopcnt >= twi_maxloops) {twi_stop(); twi_init(); twi_lockup_recovery_count++; \
-		return TO_RET;} \
+      LOOP_STATEMENT; \
+      if (SB_TIMED_OUT(twi_waitStart)) SB_RECOVER(TO_RET); \
+    } while (COND); \
   } while(0)
 
+/**
+ * State for asynchronous (completion driven) master reads. The read is
+ * started by twi_startReadFrom and finished by the TWI interrupt, which calls
+ * twi_onMasterReadComplete with the received bytes.
+ */
+static void (*twi_onMasterReadComplete)(uint8_t*, uint8_t);
+static volatile uint8_t twi_asyncRead;          // an asynchronous read is in flight
+static volatile unsigned long twi_asyncStart;   // micros() when it was started
+
+static void twi_recoverAsyncRead(void);
 
 /*
  * Function twi_init
@@ -117,6 +124,7 @@ void twi_init(void)
   twi_state = TWI_READY;
   twi_sendStop = true;    // default value
   twi_inRepStart = false;
+  twi_asyncRead = false;
 
   // activate internal pullups for twi.
   digitalWrite(SDA, 1);
@@ -250,6 +258,127 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
   return length;
 }
 
+/*
+ * Function twi_startReadFrom
+ * Desc     attempts to become twi bus master and start reading a series of
+ *          bytes from a device on the bus, without waiting for the transfer.
+ *          The TWI interrupt calls the callback once the read has finished.
+ *          The callback runs in interrupt context and is handed the twi
+ *          master buffer, so it must copy the data out before returning.
+ * Input    address: 7bit i2c device address
+ *          length: number of bytes to read
+ *          sendStop: Boolean indicating whether to send a stop at the end
+ *          callback: called with the received bytes and their count, or a
+ *                    count of 0 if the read failed
+ * Output   0 .. read started
+ *          1 .. length too long for buffer
+ *          2 .. bus busy with another transfer
+ *          5 .. timed out
+ */
+uint8_t twi_startReadFrom(uint8_t address, uint8_t length, uint8_t sendStop, void (*callback)(uint8_t*, uint8_t))
+{
+  // ensure data will fit into buffer
+  if(TWI_BUFFER_LENGTH < length || 0 == length){
+    return 1;
+  }
+
+  if(TWI_READY != twi_state){
+    // a previous asynchronous read that never finished hung the bus
+    if(twi_asyncRead && SB_TIMED_OUT(twi_asyncStart)){
+      twi_recoverAsyncRead();
+    }
+    else{
+      return 2;
+    }
+  }
+
+  twi_state = TWI_MRX;
+  twi_sendStop = sendStop;
+  // reset error state (0xFF.. no error occured)
+  twi_error = 0xFF;
+
+  // initialize buffer iteration vars, see twi_readFrom
+  twi_masterBufferIndex = 0;
+  twi_masterBufferLength = length-1;
+
+  twi_onMasterReadComplete = callback;
+  twi_asyncStart = micros();
+  twi_asyncRead = true;
+
+  // build sla+w, slave device address + w bit
+  twi_slarw = TW_READ;
+  twi_slarw |= address << 1;
+
+  if (true == twi_inRepStart) {
+    // see twi_readFrom
+    twi_inRepStart = false;
+    SB_DOWHILE(TWCR & _BV(TWWC), 5, TWDR = twi_slarw);
+    TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE);  // enable INTs, but not START
+  }
+  else
+    // send start condition
+    TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);
+
+  return 0;
+}
+
+/*
+ * Function twi_readBusy
+ * Desc     polls for completion of a read started with twi_startReadFrom.
+ *          A read still in flight past the timeout is given up on, as for
+ *          a slave holding the clock low, so that polling alone is enough
+ *          to get the bus back.
+ * Input    none
+ * Output   1 while the read is in flight, 0 once it has completed or failed
+ */
+uint8_t twi_readBusy(void)
+{
+  if(twi_asyncRead && SB_TIMED_OUT(twi_asyncStart)){
+    twi_recoverAsyncRead();
+  }
+  return twi_asyncRead;
+}
+
+/*
+ * Function twi_finishAsyncRead
+ * Desc     hands the result of an asynchronous read to its callback. Called
+ *          from the TWI interrupt once the read has finished or failed.
+ * Input    length: number of bytes received, 0 on failure
+ * Output   none
+ */
+static void twi_finishAsyncRead(uint8_t length)
+{
+  if(twi_asyncRead){
+    twi_asyncRead = false;
+    if(twi_onMasterReadComplete){
+      twi_onMasterReadComplete(twi_masterBuffer, length);
+    }
+  }
+}
+
+/*
+ * Function twi_recoverAsyncRead
+ * Desc     gives up on an asynchronous read that has run past the timeout:
+ *          resets the bus, counts the lockup, and hands the callback a
+ *          failed read. No stop is sent: it cannot get onto a bus a slave
+ *          is holding, and waiting for it would spin out the whole timeout
+ *          in the sampling interrupt. twi_init turns the TWI off first,
+ *          which lets go of the lines.
+ * Input    none
+ * Output   none
+ */
+static void twi_recoverAsyncRead(void)
+{
+  void (*callback)(uint8_t*, uint8_t) = twi_onMasterReadComplete;
+
+  twi_init();
+  twi_lockup_recovery_count++;
+
+  if(callback){
+    callback(twi_masterBuffer, 0);
+  }
+}
+
 /*
  * Function twi_writeTo
  * Desc     attempts to become twi bus master and write a
@@ -414,9 +543,9 @@ void twi_stop(void)
   //
   // XXX we can't use SB_WAIT here as SB_WAIT attempts to reset TWI, calling
   // twi_stop in the process, resulting in a recursive call.
-  twi_loopcnt = 0;
-  while (TWCR & _BV(TWSTO) && twi_loopcnt < twi_maxloops) {
-    twi_loopcnt += 1;
+  unsigned long twi_waitStart = micros();
+  while (TWCR & _BV(TWSTO) && !SB_TIMED_OUT(twi_waitStart)) {
+    continue;
   }
 
   // update twi state
@@ -481,6 +610,7 @@ ISR(TWI_vect)
     case TW_MT_ARB_LOST: // lost bus arbitration
       twi_error = TW_MT_ARB_LOST;
       twi_releaseBus();
+      twi_finishAsyncRead(0);
       break;
 
     // Master Receiver
@@ -508,9 +638,11 @@ ISR(TWI_vect)
     TWCR = _BV(TWINT) | _BV(TWSTA)| _BV(TWEN) ;
     twi_state = TWI_READY;
   }
+      twi_finishAsyncRead(twi_masterBufferIndex);
   break;
     case TW_MR_SLA_NACK: // address sent, nack received
       twi_stop();
+      twi_finishAsyncRead(0);
       break;
     // TW_MR_ARB_LOST handled by TW_MT_ARB_LOST case
 
@@ -597,17 +729,18 @@ ISR(TWI_vect)
     case TW_BUS_ERROR: // bus error, illegal stop/start
       twi_error = TW_BUS_ERROR;
       twi_stop();
+      twi_finishAsyncRead(0);
       break;
   }
 }
 
 
-void twi_setMaxLoops(uint16_t maxloops) {
-  twi_maxloops = maxloops;
+void twi_setTimeoutMicros(uint32_t timeout) {
+  twi_timeout_us = timeout;
 }
 
-uint16_t twi_getMaxLoops() {
-  return twi_maxloops;
+uint32_t twi_getTimeoutMicros() {
+  return twi_timeout_us;
 }
 
 void twi_clearRecoveryCount() {
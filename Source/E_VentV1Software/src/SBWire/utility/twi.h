@@ -36,6 +36,10 @@
   #define TWI_BUFFER_LENGTH 32
   #endif
 
+  #ifndef TWI_TIMEOUT_US
+  #define TWI_TIMEOUT_US 1000UL
+  #endif
+
   #define TWI_READY 0
   #define TWI_MRX   1
   #define TWI_MTX   2
@@ -47,6 +51,8 @@
   void twi_setAddress(uint8_t);
   void twi_setFrequency(uint32_t);
   uint8_t twi_readFrom(uint8_t, uint8_t*, uint8_t, uint8_t);
+  uint8_t twi_startReadFrom(uint8_t, uint8_t, uint8_t, void (*)(uint8_t*, uint8_t));
+  uint8_t twi_readBusy(void);
   uint8_t twi_writeTo(uint8_t, uint8_t*, uint8_t, uint8_t, uint8_t);
   uint8_t twi_transmit(const uint8_t*, uint8_t);
   void twi_attachSlaveRxEvent( void (*)(uint8_t*, int) );
@@ -55,8 +61,8 @@
   void twi_stop(void);
   void twi_releaseBus(void);
 
-  void twi_setMaxLoops(uint16_t maxloops);
-  uint16_t twi_getMaxLoops();
+  void twi_setTimeoutMicros(uint32_t timeout);
+  uint32_t twi_getTimeoutMicros();
   uint16_t twi_getRecoveryCount(); //08/22/18 gfp for monitoring purposes
   void twi_clearRecoveryCount(); //08/22/18 gfp for monitoring purposes
 #endif
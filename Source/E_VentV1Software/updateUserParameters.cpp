@@ -1,4 +1,5 @@
 #include "updateUserParameters.h"
+#include "conversions.h"
 
 void setUpParameterSelectButtons(UserParameter *userParameters, const uint8_t NUM_USER_PARAMETERS,
                                 const uint8_t parameterEncoderPushButtonPin)
@@ -14,14 +15,14 @@ void setUpParameterSelectButtons(UserParameter *userParameters, const uint8_t NU
 
 }
 
-VentilatorState updateStateUserParameters(VentilatorState &state, SelectedParameter &currentlySelectedParameter, volatile boolean &parameterSet,
+boolean updateStateUserParameters(SelectedParameter &currentlySelectedParameter, volatile boolean &parameterSet,
             Encoder &parameterSelectEncoder, UserParameter *userParameters, const uint8_t NUM_USER_PARAMETERS)
 {
-	setParameters(currentlySelectedParameter, parameterSet, userParameters);
+	boolean set = setParameters(currentlySelectedParameter, parameterSet, userParameters);
 	updateParameterTempValue(currentlySelectedParameter, parameterSelectEncoder,userParameters);
 	updateSelectedParameter(currentlySelectedParameter, parameterSelectEncoder,
 							userParameters, NUM_USER_PARAMETERS);
-	return setStateParameters(state, userParameters);
+	return set;
 }
 
 void updateSelectedParameter(SelectedParameter &currentlySelectedParameter, 
@@ -89,22 +90,27 @@ void updateParameterTempValue(SelectedParameter &currentlySelectedParameter,
 	}
 }	
 
-void setParameters(SelectedParameter &currentlySelectedParameter,
+boolean setParameters(SelectedParameter &currentlySelectedParameter,
 				volatile boolean &parameterSet, UserParameter *userParameters)
 {
+	boolean set = false;
+
 	cli();
 	if(parameterSet){
     if(e_None != currentlySelectedParameter){
       userParameters[(int)currentlySelectedParameter].updateValue();
+      set = true;
     }
 		parameterSet = false;
     currentlySelectedParameter = e_None;
 	}
 	sei();
+
+	return set;
 }
 
-void displayUserParameters(SelectedParameter &currentlySelectedParameter, LiquidCrystal &displayName, machineStates machineState, vcModeStates vcState, acModeStates acState, 
-                          float measuredPIP, float measuredPlateau, const int LCD_MAX_STRING, UserParameter *userParameters)
+void displayUserParameters(SelectedParameter &currentlySelectedParameter, LCDBuffer &displayName, machineStates machineState, vcModeStates vcState, acModeStates acState, 
+                          const BreathMetrics &measured, const int LCD_MAX_STRING, UserParameter *userParameters)
 { 
   SelectedParameter currentParameter = e_BPM;
   float bpm = userParameters[(int)e_BPM].value;
@@ -114,17 +120,18 @@ void displayUserParameters(SelectedParameter &currentlySelectedParameter, Liquid
   float thresholdPressure = userParameters[(int)e_ThresholdPressure].value;
   float tempThresholdPressure = userParameters[(int)e_ThresholdPressure].tmpValue;
   
+  //Times go to the display in ms, so it formats them without float math
   currentParameter = e_InspirationTime;
-  float inspirationTime = userParameters[(int)e_InspirationTime].value;
-  float tempInspirationTime = userParameters[(int)e_InspirationTime].tmpValue;
+  uint16_t inspirationTime = seconds_to_ms(userParameters[(int)e_InspirationTime].value);
+  uint16_t tempInspirationTime = seconds_to_ms(userParameters[(int)e_InspirationTime].tmpValue);
   
   currentParameter = e_TidalVolume;
   float tidalVolume = userParameters[(int)e_TidalVolume].value;
   float tempTidalVolume = userParameters[(int)e_TidalVolume].tmpValue;
   
   currentParameter = e_PlateauPauseTime;
-  float plateauPauseTime = userParameters[(int)e_PlateauPauseTime].value;
-  float tempPlateauPauseTime = userParameters[(int)e_PlateauPauseTime].tmpValue;
+  uint16_t plateauPauseTime = seconds_to_ms(userParameters[(int)e_PlateauPauseTime].value);
+  uint16_t tempPlateauPauseTime = seconds_to_ms(userParameters[(int)e_PlateauPauseTime].tmpValue);
 
   switch(currentlySelectedParameter){
     case e_ThresholdPressure:
@@ -150,11 +157,11 @@ void displayUserParameters(SelectedParameter &currentlySelectedParameter, Liquid
     default:
       displayVentilationParameters(displayName, machineState, vcState , acState, 
                                   bpm, thresholdPressure, tidalVolume, inspirationTime, plateauPauseTime, 
-                                  measuredPIP, measuredPlateau, LCD_MAX_STRING);
+                                  measured, LCD_MAX_STRING);
   }
 }
 
-void displayAlarmParameters(SelectedParameter &currentlySelectedParameter, LiquidCrystal &displayName,UserParameter *userParameters)
+void displayAlarmParameters(SelectedParameter &currentlySelectedParameter, LCDBuffer &displayName,UserParameter *userParameters)
 {
   SelectedParameter currentParameter = e_HighPIPAlarm;
   float maxPIP = userParameters[(int)currentParameter].value;
@@ -203,23 +210,27 @@ void displayAlarmParameters(SelectedParameter &currentlySelectedParameter, Liqui
   }
 }
 
-VentilatorState setStateParameters(VentilatorState &state, UserParameter *userParameters){
-	
+void setStateParameters(StagedSettings &staged, UserParameter *userParameters){
+	//The UI works in floats, the state in fixed point and ms
+	VentilatorSettings settings;
+
 	SelectedParameter selectedParameter = e_ThresholdPressure; //TODO: Find a better way to access the array
-	state.ac_threshold_pressure = userParameters[(int)selectedParameter].value;
+	settings.ac_threshold_pressure = Pressure::from_float(userParameters[(int)selectedParameter].value);
 	selectedParameter = e_BPM;
-	state.breaths_per_minute = userParameters[(int)selectedParameter].value;
+	settings.breaths_per_minute = BreathRate::from_float(userParameters[(int)selectedParameter].value);
 	selectedParameter = e_PlateauPauseTime;
-	state.plateau_pause_time = userParameters[(int)selectedParameter].value;
+	settings.plateau_pause_time = seconds_to_ms(userParameters[(int)selectedParameter].value);
 	selectedParameter = e_TidalVolume;
-	state.tidal_volume = userParameters[(int)selectedParameter].value;
+	settings.tidal_volume = Percentage::from_float(userParameters[(int)selectedParameter].value);
   selectedParameter = e_InspirationTime;
-  state.inspiration_time = userParameters[(int)selectedParameter].value;
+  settings.inspiration_time = seconds_to_ms(userParameters[(int)selectedParameter].value);
+	settings.ac_threshold_time = 0; //Not a user parameter yet
 
-  
-	return state;
+	//Only takes effect at the start of the next breath
+	stage_settings(staged, settings);
 }
 
+
 /*
 void parameterSelectISR(){
   
@@ -29,18 +29,21 @@ void updateSelectedParameter(SelectedParameter &currentlySelectedParameter,
 void updateParameterTempValue(SelectedParameter &currentlySelectedParameter, 
 						Encoder &parameterSelectEncoder, UserParameter *userParameter);
 
-void setParameters(SelectedParameter &currentlySelectedParameter,
+//Returns true if a parameter was set
+boolean setParameters(SelectedParameter &currentlySelectedParameter,
 				volatile boolean &parameterSet, UserParameter *userParamter);
 
-VentilatorState updateStateUserParameters(VentilatorState &state, SelectedParameter &currentlySelectedParameter,volatile boolean &parameterSet,
+//Returns true if a parameter was set, and the settings need staging with setStateParameters
+boolean updateStateUserParameters(SelectedParameter &currentlySelectedParameter,volatile boolean &parameterSet,
             Encoder &parameterSelectEncoder, UserParameter *userParameters, const uint8_t NUM_USER_PARAMETERS);
 
-void displayUserParameters(SelectedParameter &currentlySelectedParameter, LiquidCrystal &displayName, machineStates machineState, vcModeStates vcState, acModeStates acState, 
-                          float measuredPIP, float measuredPlateau, const int LCD_MAX_STRING, UserParameter *userParameters);
+void displayUserParameters(SelectedParameter &currentlySelectedParameter, LCDBuffer &displayName, machineStates machineState, vcModeStates vcState, acModeStates acState, 
+                          const BreathMetrics &measured, const int LCD_MAX_STRING, UserParameter *userParameters);
 
-void displayAlarmParameters(SelectedParameter &currentlySelectedParameter, LiquidCrystal &displayName,UserParameter *userParamters);
+void displayAlarmParameters(SelectedParameter &currentlySelectedParameter, LCDBuffer &displayName,UserParameter *userParamters);
 
-VentilatorState setStateParameters(VentilatorState &state, UserParameter *userParameters);
+//Stage the user parameters as settings for the next breath
+void setStateParameters(StagedSettings &staged, UserParameter *userParameters);
 
 void parameterSetISR();
 
@@ -0,0 +1,83 @@
+/* The parts of the Arduino core the ventilator firmware uses, on top of the
+   host runtime in Host.h. Pins are numbered as on the Arduino Mega.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#include "Host.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW  0
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define F_CPU 16000000UL
+
+#define F(string) (string)
+
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+#ifndef __cplusplus
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+// External interrupts 0-5 of the Mega.
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : ((p) >= 18 && (p) <= 21 ? 23 - (p) : NOT_AN_INTERRUPT)))
+
+// Every pin is on a port of its own, so port writes are plain pin writes.
+extern volatile uint8_t host_pin_output[HOST_NUM_PINS];
+#define digitalPinToPort(p) (p)
+#define digitalPinToBitMask(p) ((uint8_t)1)
+#define portOutputRegister(port) (&host_pin_output[(port)])
+
+// Inline, see host_advance().
+inline unsigned long millis(void) {
+    host_advance(HOST_CLOCK_READ_COST);
+    return host_now() / 1000;
+}
+
+inline unsigned long micros(void) {
+    host_advance(HOST_CLOCK_READ_COST);
+    return host_now();
+}
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+int analogRead(uint8_t pin);
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+#endif
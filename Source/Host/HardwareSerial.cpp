@@ -0,0 +1,178 @@
+#include "Arduino.h"
+
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+
+
+HardwareSerial::HardwareSerial()
+    : baud(0), byte_time(0), peer(NULL), output(NULL), tx_head(0), tx_count(0), shifting(false), shift(0),
+      shift_done(HOST_NEVER), rx_head(0), rx_count(0), pending_head(0), pending_count(0) {
+}
+
+
+void HardwareSerial::begin(unsigned long baud, uint8_t config) {
+    this->baud = baud;
+    // Start, 8 data and stop bit, rounded up.
+    byte_time = (10 * 1000000UL + baud - 1) / baud;
+}
+
+
+void HardwareSerial::end() {
+    flush();
+    baud = 0;
+    byte_time = 0;
+}
+
+
+int HardwareSerial::available() {
+    return rx_count;
+}
+
+
+int HardwareSerial::availableForWrite() {
+    // The Arduino core keeps one slot of the ring free.
+    return SERIAL_TX_BUFFER_SIZE - 1 - tx_count;
+}
+
+
+int HardwareSerial::read() {
+    if (0 == rx_count) {
+        return -1;
+    }
+
+    uint8_t data = rx[rx_head];
+    rx_head = (rx_head + 1) % SERIAL_RX_BUFFER_SIZE;
+    rx_count--;
+
+    return data;
+}
+
+
+int HardwareSerial::peek() {
+    return rx_count ? rx[rx_head] : -1;
+}
+
+
+void HardwareSerial::flush() {
+    while (byte_time && shifting) {
+        host_advance(shift_done - host_now());
+    }
+}
+
+
+size_t HardwareSerial::write(uint8_t data) {
+    if (0 == byte_time) {
+        return 0;
+    }
+
+    if (!shifting) {
+        startShift(data, host_now());
+        return 1;
+    }
+
+    // Full, wait for the byte being sent to make room.
+    while (tx_count >= SERIAL_TX_BUFFER_SIZE - 1) {
+        host_advance(shift_done - host_now());
+    }
+
+    tx[(tx_head + tx_count) % SERIAL_TX_BUFFER_SIZE] = data;
+    tx_count++;
+
+    return 1;
+}
+
+
+void HardwareSerial::hostAttach(HostSerialPeer *peer) {
+    this->peer = peer;
+}
+
+
+void HardwareSerial::hostOutput(FILE *file) {
+    output = file;
+}
+
+
+unsigned long HardwareSerial::hostBaud() const {
+    return baud;
+}
+
+
+void HardwareSerial::hostSend(const uint8_t *data, uint8_t length, unsigned long delay) {
+    unsigned long arrival = host_now() + delay;
+
+    // Queue behind anything already on the wire.
+    if (pending_count) {
+        unsigned long last = pending[(pending_head + pending_count - 1) % PENDING_SIZE].arrival;
+        if (arrival <= last) {
+            arrival = last;
+        }
+    }
+
+    for (uint8_t i = 0; i < length && pending_count < PENDING_SIZE; i++) {
+        arrival += byte_time;
+        Pending &byte = pending[(pending_head + pending_count) % PENDING_SIZE];
+        byte.arrival = arrival;
+        byte.data = data[i];
+        pending_count++;
+    }
+
+    reschedule();
+}
+
+
+void HardwareSerial::startShift(uint8_t data, unsigned long now) {
+    shift = data;
+    shift_done = now + byte_time;
+    shifting = true;
+
+    reschedule();
+}
+
+
+unsigned long HardwareSerial::nextEvent() {
+    unsigned long next = shifting ? shift_done : HOST_NEVER;
+
+    if (pending_count && pending[pending_head].arrival < next) {
+        next = pending[pending_head].arrival;
+    }
+
+    return next;
+}
+
+
+void HardwareSerial::run(unsigned long now) {
+    while (pending_count && pending[pending_head].arrival <= now) {
+        // A full receive buffer drops the new byte, as on the Arduino.
+        if (rx_count < SERIAL_RX_BUFFER_SIZE - 1) {
+            rx[(rx_head + rx_count) % SERIAL_RX_BUFFER_SIZE] = pending[pending_head].data;
+            rx_count++;
+        }
+        pending_head = (pending_head + 1) % PENDING_SIZE;
+        pending_count--;
+    }
+
+    while (shifting && shift_done <= now) {
+        uint8_t sent = shift;
+        unsigned long done = shift_done;
+
+        shifting = false;
+        if (tx_count) {
+            startShift(tx[tx_head], done);
+            tx_head = (tx_head + 1) % SERIAL_TX_BUFFER_SIZE;
+            tx_count--;
+        }
+        else {
+            shift_done = HOST_NEVER;
+        }
+
+        if (peer) {
+            peer->receive(*this, sent);
+        }
+        if (output) {
+            fputc(sent, output);
+        }
+    }
+}
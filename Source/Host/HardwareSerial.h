@@ -0,0 +1,102 @@
+/* UART with the Arduino core's 64 byte buffers, moving one byte per
+   10 bit times of the baud rate on the virtual clock.
+
+   write() only waits, as on the Arduino, when the transmit buffer is full.
+   What the firmware sends goes to an attached HostSerialPeer or a file,
+   and the peer answers through hostSend().
+ */
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <stdio.h>
+
+#include "Stream.h"
+#include "Host.h"
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+
+#define SERIAL_8N1 0x06
+
+class HardwareSerial;
+
+/* The device at the other end of a serial port.
+ */
+class HostSerialPeer {
+public:
+    virtual ~HostSerialPeer() {}
+
+    // Called as each byte the firmware sent finishes arriving.
+    virtual void receive(HardwareSerial &port, uint8_t data) = 0;
+};
+
+class HardwareSerial : public Stream, public HostDevice {
+public:
+    HardwareSerial();
+
+    void begin(unsigned long baud, uint8_t config = SERIAL_8N1);
+    void end();
+
+    virtual int available();
+    virtual int availableForWrite();
+    virtual int read();
+    virtual int peek();
+    virtual void flush();
+    virtual size_t write(uint8_t data);
+    using Print::write;
+
+    operator bool() { return true; }
+
+    // Host side.
+    void hostAttach(HostSerialPeer *peer);
+    void hostOutput(FILE *file);
+
+    // Baud rate the firmware opened the port at, 0 while closed.
+    unsigned long hostBaud() const;
+
+    /* Bytes sent by the other end. The first starts delay us from now, and
+       the rest follow back to back at the baud rate.
+     */
+    void hostSend(const uint8_t *data, uint8_t length, unsigned long delay);
+
+    virtual unsigned long nextEvent();
+    virtual void run(unsigned long now);
+
+private:
+    static const uint16_t PENDING_SIZE = 256;
+
+    unsigned long baud;
+    unsigned long byte_time; // us, 0 while the port is closed
+    HostSerialPeer *peer;
+    FILE *output;
+
+    uint8_t tx[SERIAL_TX_BUFFER_SIZE];
+    uint8_t tx_head;
+    uint8_t tx_count;
+    bool shifting;             // A byte is in the shift register.
+    uint8_t shift;
+    unsigned long shift_done;  // us
+
+    uint8_t rx[SERIAL_RX_BUFFER_SIZE];
+    uint8_t rx_head;
+    uint8_t rx_count;
+
+    // Bytes on the wire towards the firmware.
+    struct Pending {
+        unsigned long arrival; // us
+        uint8_t data;
+    };
+    Pending pending[PENDING_SIZE];
+    uint16_t pending_head;
+    uint16_t pending_count;
+
+    void startShift(uint8_t data, unsigned long now);
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif
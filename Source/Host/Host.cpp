@@ -0,0 +1,363 @@
+#include "Arduino.h"
+
+
+unsigned long host_clock = 0;
+unsigned long host_next_event = 0;
+
+static bool interrupts_enabled = true;
+
+static const uint8_t MAX_DEVICES = 16; // 4 serial ports, 4 timers and the TWI
+
+/* Every device, with its next event as of the last time it was asked, so
+   that finding the earliest is a pass over the table. In list order: the
+   last constructed first, ties go to it.
+ */
+static HostDevice *devices[MAX_DEVICES];
+static unsigned long events[MAX_DEVICES];
+static uint8_t num_devices = 0;
+static uint16_t stale = 0;     // Slots to ask again
+static int8_t next_slot = -1;  // Whose event host_next_event is, -1 to look again
+static unsigned long register_writes = 0;
+
+
+HostDevice::HostDevice(bool interrupt) : slot(0), interrupt(interrupt) {
+    if (num_devices >= MAX_DEVICES) {
+        abort();
+    }
+
+    for (uint8_t i = num_devices; i > 0; i--) {
+        devices[i] = devices[i - 1];
+        devices[i]->slot = i;
+    }
+    devices[0] = this;
+    num_devices++;
+
+    stale = (1U << num_devices) - 1;
+    next_slot = -1;
+}
+
+
+void HostDevice::reschedule() {
+    unsigned long event = nextEvent();
+    events[slot] = event;
+    stale &= ~(1U << slot);
+
+    if (event < host_next_event) {
+        // Every other device was asked since the last look, so this one is next.
+        host_next_event = event;
+        if (next_slot >= 0) {
+            next_slot = slot;
+        }
+    }
+    else if (event == host_next_event || slot == next_slot) {
+        // Level with the next event and maybe first in the list, or later.
+        next_slot = -1;
+    }
+}
+
+
+// Ask every device marked stale for its next event.
+static void ask_stale() {
+    while (stale) {
+        uint8_t i = __builtin_ctz(stale);
+        events[i] = devices[i]->nextEvent();
+        stale &= ~(1U << i);
+    }
+}
+
+
+// Slot of the device due first at or before target, -1 for none.
+static int8_t find_due(const unsigned long target) {
+    unsigned long earliest = HOST_NEVER;
+    int8_t first = -1;
+
+    ask_stale();
+
+    // Earliest event wins, ties go to the first device in the list.
+    for (uint8_t i = 0; i < num_devices; i++) {
+        if (events[i] < earliest) {
+            earliest = events[i];
+            first = i;
+        }
+    }
+
+    host_next_event = earliest;
+    next_slot = first;
+
+    if (earliest > target) {
+        return -1;
+    }
+    if (interrupts_enabled || !devices[first]->isInterrupt()) {
+        return first;
+    }
+
+    // The first is held off, look for the first that is not.
+    int8_t due = -1;
+    unsigned long due_time = target;
+    for (uint8_t i = 0; i < num_devices; i++) {
+        if (!devices[i]->isInterrupt() && events[i] <= due_time && (due < 0 || events[i] < due_time)) {
+            due = i;
+            due_time = events[i];
+        }
+    }
+    return due;
+}
+
+
+void host_run_events(unsigned long target) {
+    unsigned long &now = host_clock;
+
+    for (;;) {
+        int8_t slot;
+
+        // The last look found the next event, and nothing has moved since.
+        if (next_slot >= 0 && !(stale & (1U << next_slot)) && events[next_slot] <= target &&
+            (interrupts_enabled || !devices[next_slot]->isInterrupt())) {
+            slot = next_slot;
+        }
+        else {
+            slot = find_due(target);
+        }
+
+        if (slot < 0) {
+            break;
+        }
+
+        HostDevice *due = devices[slot];
+        if (events[slot] > now) {
+            now = events[slot];
+        }
+
+        // Asked again once it has run, and in the meantime if it reads the
+        // clock and events run from there.
+        stale |= 1U << slot;
+        next_slot = -1;
+
+        if (due->isInterrupt()) {
+            // The AVR clears the global interrupt flag while a handler runs.
+            interrupts_enabled = false;
+            due->run(now);
+            interrupts_enabled = true;
+        }
+        else {
+            due->run(now);
+        }
+        events[slot] = due->nextEvent();
+        stale &= ~(1U << slot);
+        next_slot = -1;
+    }
+
+    if (target > now) {
+        now = target;
+    }
+}
+
+
+void host_reschedule() {
+    register_writes++;
+    stale = (1U << num_devices) - 1;
+    next_slot = -1;
+    host_next_event = 0;
+}
+
+
+bool host_interrupts_enabled() {
+    return interrupts_enabled;
+}
+
+
+extern "C" void cli(void) {
+    interrupts_enabled = false;
+}
+
+
+extern "C" void sei(void) {
+    interrupts_enabled = true;
+
+    // Anything that fell due while disabled runs now. An interrupt held off
+    // still counts towards host_next_event, so nothing is missed without a rescan.
+    host_advance(0);
+}
+
+
+void delay(unsigned long ms) {
+    host_advance(ms * 1000);
+}
+
+
+void delayMicroseconds(unsigned int us) {
+    host_advance(us);
+}
+
+
+//Pins-------------------------------------------------------------------------------------------------------------------
+
+volatile uint8_t host_pin_output[HOST_NUM_PINS];
+static uint8_t pin_input[HOST_NUM_PINS];
+static uint8_t pin_mode[HOST_NUM_PINS];
+
+static const uint8_t NUM_INTERRUPTS = 6;
+static void (*interrupt_handlers[NUM_INTERRUPTS])(void);
+static int interrupt_modes[NUM_INTERRUPTS];
+
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= HOST_NUM_PINS) {
+        return;
+    }
+
+    pin_mode[pin] = mode;
+    if (INPUT_PULLUP == mode) {
+        pin_input[pin] = HIGH;
+    }
+}
+
+
+int digitalRead(uint8_t pin) {
+    if (pin >= HOST_NUM_PINS) {
+        return LOW;
+    }
+
+    return (OUTPUT == pin_mode[pin]) ? host_pin_output[pin] : pin_input[pin];
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin >= HOST_NUM_PINS) {
+        return;
+    }
+
+    host_pin_output[pin] = value ? HIGH : LOW;
+
+    // Writing an input turns its pull-up on or off.
+    if (OUTPUT != pin_mode[pin]) {
+        pin_input[pin] = value ? HIGH : LOW;
+    }
+}
+
+
+int analogRead(uint8_t pin) {
+    return 0;
+}
+
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode) {
+    if (interrupt < NUM_INTERRUPTS) {
+        interrupt_handlers[interrupt] = handler;
+        interrupt_modes[interrupt] = mode;
+    }
+}
+
+
+void detachInterrupt(uint8_t interrupt) {
+    if (interrupt < NUM_INTERRUPTS) {
+        interrupt_handlers[interrupt] = NULL;
+    }
+}
+
+
+void host_set_pin(uint8_t pin, uint8_t level) {
+    if (pin >= HOST_NUM_PINS) {
+        return;
+    }
+
+    uint8_t previous = pin_input[pin];
+    pin_input[pin] = level ? HIGH : LOW;
+
+    int interrupt = digitalPinToInterrupt(pin);
+    if (NOT_AN_INTERRUPT == interrupt || !interrupt_handlers[interrupt] || previous == pin_input[pin]) {
+        return;
+    }
+
+    int mode = interrupt_modes[interrupt];
+    if (CHANGE == mode || (RISING == mode && HIGH == level) || (FALLING == mode && LOW == level)) {
+        bool enabled = interrupts_enabled;
+        interrupts_enabled = false;
+        interrupt_handlers[interrupt]();
+        interrupts_enabled = enabled;
+    }
+}
+
+
+uint8_t host_get_pin(uint8_t pin) {
+    return (pin < HOST_NUM_PINS) ? host_pin_output[pin] : LOW;
+}
+
+
+//Timers-----------------------------------------------------------------------------------------------------------------
+
+HostTimerRegisters host_timers[6];
+
+
+/* 16 bit timer in CTC mode on OCRnA, raising the compare A interrupt.
+ */
+class HostTimer : public HostDevice {
+public:
+    HostTimer(HostTimerRegisters &registers, void (*vector)(void))
+        : HostDevice(true), registers(registers), vector(vector), next_match(HOST_NEVER),
+          cached_period(0), period_writes(0) {}
+
+    virtual unsigned long nextEvent() {
+        unsigned long period = this->period();
+
+        if (!period || !vector) {
+            next_match = HOST_NEVER;
+        }
+        else if (HOST_NEVER == next_match) {
+            next_match = host_now() + period;
+        }
+
+        return next_match;
+    }
+
+    virtual void run(unsigned long now) {
+        unsigned long period = this->period();
+
+        // Stopped since nextEvent().
+        if (!period) {
+            next_match = HOST_NEVER;
+            return;
+        }
+
+        // Matches missed while interrupts were off only raise the flag once.
+        while (next_match <= now) {
+            next_match += period;
+        }
+
+        vector();
+    }
+
+private:
+    // us between compare matches, 0 when stopped or not interrupting.
+    // Worked out again only after a register write.
+    unsigned long period() {
+        static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+        if (period_writes == register_writes) {
+            return cached_period;
+        }
+        period_writes = register_writes;
+
+        uint16_t prescaler = prescalers[registers.tccrb & 0x07];
+        if (!prescaler || !(registers.timsk & _BV(OCIE1A)) || !(registers.tccrb & _BV(WGM12))) {
+            cached_period = 0;
+        }
+        else {
+            cached_period = (unsigned long)(registers.ocra + 1) * prescaler / (F_CPU / 1000000UL);
+        }
+
+        return cached_period;
+    }
+
+    HostTimerRegisters &registers;
+    void (*vector)(void);
+    unsigned long next_match;
+    unsigned long cached_period;
+    unsigned long period_writes; // register_writes when cached_period was worked out
+};
+
+
+static HostTimer timer1(host_timers[1], TIMER1_COMPA_vect);
+static HostTimer timer3(host_timers[3], TIMER3_COMPA_vect);
+static HostTimer timer4(host_timers[4], TIMER4_COMPA_vect);
+static HostTimer timer5(host_timers[5], TIMER5_COMPA_vect);
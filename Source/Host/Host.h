@@ -0,0 +1,126 @@
+/* Host runtime for building the ventilator firmware on a PC.
+
+   The firmware is compiled unchanged against the headers in this directory
+   instead of the Arduino core, and runs on a virtual clock:
+
+   - Time only moves when the firmware asks for it. Every call to micros()
+     or millis() costs HOST_CLOCK_READ_COST us, so busy waits end, and
+     delay() jumps straight to the end of the wait. Nothing waits in real
+     time, so hours of ventilation run in seconds.
+   - Peripherals are HostDevices. Each one says when its next event is due
+     (a timer compare match, a byte finishing on a UART, the end of an I2C
+     read) and the clock stops there to run it, so events happen at the
+     same virtual time on every run.
+   - Interrupt handlers (timers, TWI) are held off between cli() and sei(),
+     and run with interrupts disabled, as on the ATmega2560.
+   - The time of the next event is cached, so reading the clock costs a
+     compare until then. Each device's own next event is cached as well,
+     and only asked for again after it runs, so finding the next event is
+     a pass over a table rather than a call into every device. A device whose next event moved for any
+     other reason calls reschedule(); a timer register write, which may
+     move any timer, calls host_reschedule().
+
+   unsigned long is 64 bits on the host, so micros() does not wrap after
+   71 minutes as it does on the Arduino.
+ */
+
+#ifndef Host_h
+#define Host_h
+
+#include <stdint.h>
+#include <limits.h>
+
+const unsigned long HOST_NEVER = ULONG_MAX;
+const unsigned long HOST_CLOCK_READ_COST = 4; // us, about what micros() takes on a 16 MHz AVR
+const uint8_t HOST_NUM_PINS = 70;             // Arduino Mega
+
+
+/* A simulated peripheral, run by the virtual clock.
+ */
+class HostDevice {
+public:
+    // Interrupt sources are held off while interrupts are disabled.
+    explicit HostDevice(bool interrupt = false);
+    virtual ~HostDevice() {}
+
+    // When the next event is due (us), or HOST_NEVER.
+    virtual unsigned long nextEvent() = 0;
+
+    // Handle every event due at or before now.
+    virtual void run(unsigned long now) = 0;
+
+    bool isInterrupt() const { return interrupt; }
+
+protected:
+    // The next event moved outside run(), ask for it again.
+    void reschedule();
+
+private:
+    uint8_t slot; // In the table of devices, see Host.cpp
+    bool interrupt;
+};
+
+
+/* An I2C slave on the simulated TWI bus, see twi.cpp.
+ */
+class HostI2CDevice {
+public:
+    virtual ~HostI2CDevice() {}
+
+    // Addressed for a read. Fill in up to length bytes and return how many
+    // there are, 0 for a NACK; the master clocks out as many as it wants.
+    virtual uint8_t read(uint8_t *data, uint8_t length) = 0;
+
+    // The bytes the master wrote, once it stops.
+    virtual void write(const uint8_t *data, uint8_t length) {}
+
+    // us the slave holds the clock low before the first byte it sends.
+    // HOST_NEVER holds it until the master resets its TWI.
+    virtual unsigned long stretch() { return 0; }
+};
+
+
+// Only for the inline functions below.
+extern unsigned long host_clock;
+extern unsigned long host_next_event; // No device has anything due before this.
+
+void host_run_events(unsigned long target);
+
+// Virtual clock, us since start.
+inline unsigned long host_now() {
+    return host_clock;
+}
+
+/* Move the clock forward by us, stopping to run every device event that
+   falls due on the way. Inline, as the firmware reads the clock several
+   times on every pass through loop() and almost always nothing is due.
+ */
+inline void host_advance(unsigned long us) {
+    unsigned long target = host_clock + us;
+
+    if (target < host_next_event) {
+        host_clock = target;
+    }
+    else {
+        host_run_events(target);
+    }
+}
+
+/* Something changed the time of any device's next event, ask every device
+   again on the next clock read.
+ */
+void host_reschedule();
+
+bool host_interrupts_enabled();
+
+/* Drive an input pin from outside, as a button or switch would. Runs the
+   handler attached to the pin if the change matches its mode.
+ */
+void host_set_pin(uint8_t pin, uint8_t level);
+
+// Level the firmware last wrote to an output pin.
+uint8_t host_get_pin(uint8_t pin);
+
+void host_i2c_attach(uint8_t address, HostI2CDevice *device);
+
+#endif
@@ -0,0 +1,27 @@
+/* HD44780 display. The firmware only initialises the displays through
+   LiquidCrystal, after that LCDBus writes to them through the port
+   registers, so nothing here needs to do anything.
+ */
+
+#ifndef LiquidCrystal_h
+#define LiquidCrystal_h
+
+#include "Arduino.h"
+
+class LiquidCrystal : public Print {
+public:
+    LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7) {}
+
+    void begin(uint8_t cols, uint8_t rows) {}
+    void clear() {}
+    void home() {}
+    void setCursor(uint8_t col, uint8_t row) {}
+    void noDisplay() {}
+    void display() {}
+    void command(uint8_t value) {}
+
+    virtual size_t write(uint8_t) { return 1; }
+    using Print::write;
+};
+
+#endif
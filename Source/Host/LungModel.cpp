@@ -0,0 +1,173 @@
+#include "LungModel.h"
+
+#include "Motor.h"
+#include "pressure.h"
+
+
+const LungSettings DEFAULT_LUNG = {
+    50.0,  // compliance
+    10.0,  // resistance
+    5.0,   // valveResistance
+    5.0,   // peep
+    800.0, // fullStrokeVolume
+    0.0,   // bagEdge
+    0.0,   // effortPressure
+    12.0,  // effortRate
+    1.0,   // effortTime
+    0.0,   // sensorNoise
+    0.0    // spikeChance
+};
+
+
+LungModel::LungModel(RoboClawModel &motor, const LungSettings &settings)
+    : motor(motor), settings(settings), time(0), last_displaced(0), lung_volume(0),
+      pressure(settings.peep), inhaling(false), breath_count(0), breath_peak(0), breath_volume(0),
+      last_peak(0), last_volume(0), max_pressure(settings.peep), noise_state(2463534242UL) {
+    motor.attach(this);
+}
+
+
+double LungModel::effort() const {
+    if (settings.effortPressure <= 0 || settings.effortRate <= 0) {
+        return 0;
+    }
+
+    double period = 60.0 / settings.effortRate;
+    double phase = fmod(time, period);
+
+    if (phase >= settings.effortTime) {
+        return 0;
+    }
+
+    return settings.effortPressure * sin(M_PI * phase / settings.effortTime);
+}
+
+
+// Added to a read: gaussian noise, approximated by the sum of twelve
+// uniform draws, and now and then a spike.
+double LungModel::noise() {
+    if (settings.sensorNoise <= 0 && settings.spikeChance <= 0) {
+        return 0;
+    }
+
+    double uniform[13];
+    for (uint8_t i = 0; i < 13; i++) {
+        noise_state ^= noise_state << 13;
+        noise_state ^= noise_state >> 17;
+        noise_state ^= noise_state << 5;
+        uniform[i] = noise_state / 4294967296.0;
+    }
+
+    double sum = -6;
+    for (uint8_t i = 0; i < 12; i++) {
+        sum += uniform[i];
+    }
+
+    return sum * settings.sensorNoise + ((uniform[12] < settings.spikeChance) ? SPIKE_PRESSURE : 0);
+}
+
+
+void LungModel::step(double travel, double dt) {
+    double stroke = (travel - settings.bagEdge) / QP_AT_FULL_STROKE;
+    double displaced = (stroke > 0) ? stroke * settings.fullStrokeVolume : 0;
+    double pushed = displaced - last_displaced;
+
+    time += dt;
+    last_displaced = displaced;
+
+    double alveolar = settings.peep + lung_volume / settings.compliance - effort();
+
+    if (pushed > 0) {
+        // Bag to patient, flow set by the paddle.
+        double flow = pushed / dt; // mL/s
+        lung_volume += pushed;
+        pressure = settings.peep + lung_volume / settings.compliance - effort() + settings.resistance * flow / 1000;
+    }
+    else if (0 == pushed && displaced > 0) {
+        // Paddle holding, valve shut.
+        pressure = alveolar;
+    }
+    else {
+        // Out, or in, through the exhalation port.
+        double flow = (alveolar - settings.peep) / (settings.resistance + settings.valveResistance) * 1000; // mL/s
+        double tau = settings.compliance * (settings.resistance + settings.valveResistance) / 1000;   // s
+
+        // Never step past the volume the lung is heading for.
+        if (dt >= tau) {
+            lung_volume -= (alveolar - settings.peep) * settings.compliance;
+        }
+        else {
+            lung_volume -= flow * dt;
+        }
+        pressure = settings.peep + settings.valveResistance * flow / 1000;
+    }
+
+    // A breath runs from the paddle starting to push to it letting go.
+    if (pushed > 0 && !inhaling) {
+        inhaling = true;
+        breath_peak = pressure;
+        breath_volume = 0;
+    }
+    if (inhaling) {
+        breath_peak = (pressure > breath_peak) ? pressure : breath_peak;
+        breath_volume += (pushed > 0) ? pushed : 0;
+
+        if (pushed < 0) {
+            inhaling = false;
+            breath_count++;
+            last_peak = breath_peak;
+            last_volume = breath_volume;
+        }
+    }
+    max_pressure = (pressure > max_pressure) ? pressure : max_pressure;
+}
+
+
+uint8_t LungModel::read(uint8_t *data, uint8_t length) {
+    if (length < 2) {
+        return 0;
+    }
+
+    motor.update();
+
+    // Inverse of pressureCountsToCmH2O, clipped to the sensor's output range.
+    double psi = (pressure + noise()) / PSI_TO_CMH2O;
+    double counts = (psi - MIN_SENSOR_PRESSURE) * (MAX_DIGITAL_OUTPUT - MIN_DIGITAL_OUTPUT)
+                    / (MAX_SENSOR_PRESSURE - MIN_SENSOR_PRESSURE) + MIN_DIGITAL_OUTPUT;
+    counts = constrain(counts, 0, PRESSURE_COUNTS_MASK);
+    uint16_t raw = lround(counts);
+
+    data[0] = raw >> 8;
+    data[1] = raw;
+    return 2;
+}
+
+
+double LungModel::airwayPressure() const {
+    return pressure;
+}
+
+
+double LungModel::volume() const {
+    return lung_volume;
+}
+
+
+unsigned long LungModel::breaths() const {
+    return breath_count;
+}
+
+
+double LungModel::lastPeakPressure() const {
+    return last_peak;
+}
+
+
+double LungModel::lastTidalVolume() const {
+    return last_volume;
+}
+
+
+double LungModel::maxPressure() const {
+    return max_pressure;
+}
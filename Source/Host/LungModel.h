@@ -0,0 +1,99 @@
+/* Patient circuit for the host build: the bag the paddle squeezes, the
+   breathing valve, a single compartment lung and optional breathing
+   effort, read through the Honeywell pressure sensor on the I2C bus.
+
+   - Bag: the paddle meets the bag at bagEdge (encoder QP) and pushes out
+     fullStrokeVolume over QP_AT_FULL_STROKE beyond it, linearly. The bag is
+     much stiffer than the lung, so while the paddle advances everything it
+     pushes out goes to the patient.
+   - Valve: while the paddle advances the patient side is fed from the bag.
+     While it holds still past the bag edge the valve stays shut and the
+     lung holds its volume (the plateau). Otherwise the patient breathes
+     out, or in, through the exhalation port, against valveResistance, down
+     to peep.
+   - Lung: volume V above the volume at PEEP, with compliance and airway
+     resistance. Alveolar pressure is peep + V / compliance - effort.
+   - Effort: every 60 / effortRate s the patient pulls with a half sine of
+     effortPressure over effortTime s. Pulling below PEEP is what the AC
+     mode trigger looks for.
+
+   The sensor sits at the patient connection. It reads airway pressure:
+   alveolar pressure plus the drop across the airway while flowing in, and
+   PEEP plus the drop across the port while flowing out. Each read can add
+   noise of sensorNoise cmH2O rms, and one read in 1 / spikeChance reads
+   SPIKE_PRESSURE high, like a glitch on the bus. The noise repeats from
+   run to run.
+
+   The model is stepped by the RoboClawModel it is attached to, 1 ms at a
+   time on the virtual clock, and brought up to date on every sensor read.
+ */
+
+#ifndef LungModel_h
+#define LungModel_h
+
+#include "Arduino.h"
+#include "RoboClawModel.h"
+
+struct LungSettings {
+    double compliance;        // mL/cmH2O
+    double resistance;        // cmH2O/(L/s), airway
+    double valveResistance;   // cmH2O/(L/s), exhalation port
+    double peep;              // cmH2O
+    double fullStrokeVolume;  // mL pushed out at QP_AT_FULL_STROKE past bagEdge
+    double bagEdge;           // QP of shaft travel where the paddle meets the bag
+    double effortPressure;    // cmH2O, 0 for a passive patient
+    double effortRate;        // breaths/min
+    double effortTime;        // s, length of each pull
+    double sensorNoise;       // cmH2O rms on each read, 0 for none
+    double spikeChance;       // Of each read being a spike, 0 for none
+};
+
+const double SPIKE_PRESSURE = 40.0; // cmH2O added to a spike
+
+// Adult with normal lungs, passive.
+extern const LungSettings DEFAULT_LUNG;
+
+
+class LungModel : public HostI2CDevice, public MotorLoad {
+public:
+    LungModel(RoboClawModel &motor, const LungSettings &settings);
+
+    // Sensor reading, 14 bit counts with the status bits clear.
+    virtual uint8_t read(uint8_t *data, uint8_t length);
+
+    virtual void step(double travel, double dt);
+
+    double airwayPressure() const;  // cmH2O
+    double volume() const;          // mL above the volume at PEEP
+
+    // Since the start: breaths delivered, and the peak airway pressure and
+    // volume of the last one.
+    unsigned long breaths() const;
+    double lastPeakPressure() const;
+    double lastTidalVolume() const;
+    double maxPressure() const;
+
+private:
+    double effort() const;
+    double noise();
+
+    RoboClawModel &motor;
+    LungSettings settings;
+
+    double time;            // s since the start
+    double last_displaced;  // mL pushed out of the bag at the last step
+    double lung_volume;     // mL
+    double pressure;        // cmH2O at the sensor
+
+    bool inhaling;
+    unsigned long breath_count;
+    double breath_peak;
+    double breath_volume;
+    double last_peak;
+    double last_volume;
+    double max_pressure;
+
+    uint32_t noise_state;   // xorshift32
+};
+
+#endif
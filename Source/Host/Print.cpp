@@ -0,0 +1,50 @@
+#include <stdio.h>
+
+#include "Print.h"
+
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+
+    while (size--) {
+        n += write(*buffer++);
+    }
+
+    return n;
+}
+
+
+size_t Print::print(long n, int base) {
+    if (DEC != base) {
+        return print((unsigned long)n, base);
+    }
+
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", n);
+    return write(text);
+}
+
+
+size_t Print::print(unsigned long n, int base) {
+    char text[66];
+    char *digit = &text[sizeof(text) - 1];
+
+    if (base < 2) {
+        base = DEC;
+    }
+
+    *digit = '\0';
+    do {
+        *--digit = "0123456789ABCDEF"[n % base];
+        n /= base;
+    } while (n);
+
+    return write(digit);
+}
+
+
+size_t Print::print(double n, int digits) {
+    char text[48];
+    snprintf(text, sizeof(text), "%.*f", digits, n);
+    return write(text);
+}
@@ -0,0 +1,277 @@
+#include "RoboClawModel.h"
+
+#include "RoboClaw.h"
+#include "RoboClawCodec.h"
+
+
+static const long BAUD_RATES[] = {2400, 9600, 19200, 38400, 57600, 115200, 230400, 460800};
+static const uint8_t NUM_BAUD_RATES = sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]);
+
+
+RoboClawModel::RoboClawModel(HardwareSerial &port, uint8_t address, long baud)
+    : address(address), config(RoboClawCodec::baudConfig(baud)), config_baud(baud), received(0), last_byte(0),
+      dropout_start(0), dropout_length(0), mode(MOTION_SPEED), motor_position(0), encoder_offset(0), motor_speed(0), target_speed(0), target_position(0),
+      accel(0), deccel(0), updated(0), load(NULL), packets(0), crc_errors(0) {
+    port.hostAttach(this);
+}
+
+
+void RoboClawModel::attach(MotorLoad *load) {
+    this->load = load;
+}
+
+
+void RoboClawModel::dropout(unsigned long start, unsigned long length) {
+    dropout_start = start;
+    dropout_length = length;
+}
+
+
+long RoboClawModel::baud() const {
+    for (uint8_t i = 0; i < NUM_BAUD_RATES; i++) {
+        if (RoboClawCodec::baudConfig(BAUD_RATES[i]) == (config & ROBOCLAW_CONFIG_BAUD_MASK)) {
+            return BAUD_RATES[i];
+        }
+    }
+
+    return 0;
+}
+
+
+long RoboClawModel::position() {
+    update();
+    return lround(motor_position);
+}
+
+
+long RoboClawModel::speed() {
+    update();
+    return lround(motor_speed);
+}
+
+
+uint16_t RoboClawModel::packetsReceived() const {
+    return packets;
+}
+
+
+uint16_t RoboClawModel::crcErrors() const {
+    return crc_errors;
+}
+
+
+int RoboClawModel::writeLength(uint8_t cmd) {
+    switch (cmd) {
+        case RoboClaw::SETM1ENCCOUNT:         return 4;
+        case RoboClaw::M1SPEED:               return 4;
+        case RoboClaw::M1SPEEDDIST:           return 9;
+        case RoboClaw::M1SPEEDACCELDECCELPOS: return 17;
+        case RoboClaw::SETCONFIG:             return 2;
+        default:                              return -1;
+    }
+}
+
+
+void RoboClawModel::receive(HardwareSerial &port, uint8_t data) {
+    unsigned long now = host_now();
+
+    // Garbled at the wrong baud rate, or lost.
+    if (port.hostBaud() != (unsigned long)config_baud || now - dropout_start < dropout_length) {
+        received = 0;
+        return;
+    }
+
+    // A gap between bytes starts a new packet.
+    if (received && now - last_byte > 10 * (10 * 1000000UL / port.hostBaud())) {
+        received = 0;
+    }
+    last_byte = now;
+
+    if (received >= MAX_PACKET) {
+        received = 0;
+    }
+    packet[received++] = data;
+
+    if (received < 2) {
+        return;
+    }
+
+    if (packet[0] != address) {
+        received = 0;
+        return;
+    }
+
+    int length = writeLength(packet[1]);
+    if (length < 0) {
+        packets++;
+        received = 0;
+        handleRead(port, packet[1]);
+        return;
+    }
+
+    if (received < length + 4) {
+        return;
+    }
+
+    packets++;
+    received = 0;
+
+    uint16_t crc = RoboClawCodec::get16(&packet[length + 2]);
+    if (crc != RoboClawCodec::crc(packet, length + 2)) {
+        crc_errors++;
+        return;
+    }
+
+    handleWrite(port, packet[1], &packet[2]);
+}
+
+
+void RoboClawModel::reply(HardwareSerial &port, const uint8_t *data, uint8_t length) {
+    uint8_t frame[MAX_PACKET];
+    uint16_t crc = RoboClawCodec::crc(packet, 2);
+
+    memcpy(frame, data, length);
+    crc = RoboClawCodec::crc(data, length, crc);
+    RoboClawCodec::put16(&frame[length], crc);
+
+    port.hostSend(frame, length + 2, TURNAROUND);
+}
+
+
+void RoboClawModel::handleRead(HardwareSerial &port, uint8_t cmd) {
+    uint8_t data[MAX_PACKET];
+    uint8_t *end = data;
+
+    update();
+
+    switch (cmd) {
+        case RoboClaw::GETM1ENC:
+            end = RoboClawCodec::put32(end, lround(motor_position));
+            *end++ = (motor_speed < 0) ? 0x02 : 0x00;
+            break;
+        case RoboClaw::GETM1SPEED:
+            end = RoboClawCodec::put32(end, labs(lround(motor_speed)));
+            *end++ = (motor_speed < 0) ? 1 : 0;
+            break;
+        case RoboClaw::GETENCODERS:
+            end = RoboClawCodec::put32(end, lround(motor_position));
+            end = RoboClawCodec::put32(end, 0);
+            break;
+        case RoboClaw::GETISPEEDS:
+            end = RoboClawCodec::put32(end, lround(motor_speed));
+            end = RoboClawCodec::put32(end, 0);
+            break;
+        case RoboClaw::GETCURRENTS:
+            // 10 mA units, a loaded motor draws more while accelerating.
+            end = RoboClawCodec::put16(end, (motor_speed != target_speed) ? 250 : 100);
+            end = RoboClawCodec::put16(end, 0);
+            break;
+        case RoboClaw::GETTEMP:
+            end = RoboClawCodec::put16(end, 300); // 0.1 C
+            break;
+        case RoboClaw::GETERROR:
+            end = RoboClawCodec::put32(end, 0);
+            break;
+        case RoboClaw::GETCONFIG:
+            end = RoboClawCodec::put16(end, config);
+            break;
+        default:
+            return;
+    }
+
+    reply(port, data, end - data);
+}
+
+
+void RoboClawModel::handleWrite(HardwareSerial &port, uint8_t cmd, const uint8_t *payload) {
+    static const uint8_t ack = 0xFF;
+
+    update();
+
+    switch (cmd) {
+        case RoboClaw::SETM1ENCCOUNT: {
+            double count = (int32_t)RoboClawCodec::get32(payload);
+            encoder_offset += count - motor_position;
+            motor_position = count;
+            target_position = count;
+            break;
+        }
+        case RoboClaw::M1SPEED:
+            mode = MOTION_SPEED;
+            target_speed = (int32_t)RoboClawCodec::get32(payload);
+            accel = deccel = 0;
+            break;
+        case RoboClaw::M1SPEEDDIST: {
+            double speed = (int32_t)RoboClawCodec::get32(payload);
+            double distance = RoboClawCodec::get32(payload + 4);
+            mode = MOTION_POSITION;
+            target_speed = fabs(speed);
+            target_position = motor_position + ((speed < 0) ? -distance : distance);
+            accel = deccel = 0;
+            break;
+        }
+        case RoboClaw::M1SPEEDACCELDECCELPOS:
+            mode = MOTION_POSITION;
+            accel = RoboClawCodec::get32(payload);
+            target_speed = RoboClawCodec::get32(payload + 4);
+            deccel = RoboClawCodec::get32(payload + 8);
+            target_position = (int32_t)RoboClawCodec::get32(payload + 12);
+            break;
+        case RoboClaw::SETCONFIG:
+            // The acknowledgement still goes out at the old rate.
+            config = RoboClawCodec::get16(payload);
+            config_baud = baud();
+            break;
+    }
+
+    port.hostSend(&ack, 1, TURNAROUND);
+}
+
+
+static double approach(double value, double target, double step) {
+    if (step <= 0 || fabs(target - value) <= step) {
+        return target;
+    }
+    return (target > value) ? value + step : value - step;
+}
+
+
+void RoboClawModel::update() {
+    unsigned long now = host_now();
+
+    while (updated < now) {
+        unsigned long step = (now - updated < STEP) ? now - updated : STEP;
+        double dt = step / 1000000.0;
+        updated += step;
+
+        if (MOTION_SPEED == mode) {
+            motor_speed = approach(motor_speed, target_speed, accel * dt);
+            motor_position += motor_speed * dt;
+        }
+        else {
+            double remaining = target_position - motor_position;
+            double direction = (remaining < 0) ? -1 : 1;
+            double stopping = deccel ? motor_speed * motor_speed / (2 * deccel) : 0;
+
+            if (fabs(remaining) <= stopping) {
+                motor_speed = approach(motor_speed, 0, deccel * dt);
+            }
+            else {
+                motor_speed = approach(motor_speed, direction * target_speed, accel * dt);
+            }
+
+            // Land on the target rather than overshoot it.
+            if (fabs(motor_speed * dt) >= fabs(remaining)) {
+                motor_position = target_position;
+                motor_speed = 0;
+            }
+            else {
+                motor_position += motor_speed * dt;
+            }
+        }
+
+        if (load) {
+            load->step(motor_position - encoder_offset, dt);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+/* RoboClaw motor controller on the far end of a HardwareSerial, speaking
+   packet serial to MotorLink.
+
+   Write commands are checked against their CRC and acknowledged, reads are
+   answered with a CRC. Bytes sent at any baud rate other than the one in
+   the controller's configuration are lost, so the firmware has to find the
+   right rate as it would with the real controller.
+
+   Motor 1 follows the speed, distance and position commands the firmware
+   uses, with the acceleration limits of each, and reports its encoder count
+   and speed back. Commands the model does not know go unanswered.
+ */
+
+#ifndef RoboClawModel_h
+#define RoboClawModel_h
+
+#include "Arduino.h"
+
+/* Whatever motor 1 drives, stepped along with the motor.
+ */
+class MotorLoad {
+public:
+    virtual ~MotorLoad() {}
+
+    /* Called for every integration step of at most 1 ms.
+
+       Input:
+       - travel: QP the shaft has turned since the model started, which
+         unlike the encoder count is not changed by SetEncM1
+       - dt: seconds since the last step
+     */
+    virtual void step(double travel, double dt) = 0;
+};
+
+class RoboClawModel : public HostSerialPeer {
+public:
+    RoboClawModel(HardwareSerial &port, uint8_t address, long baud);
+
+    virtual void receive(HardwareSerial &port, uint8_t data);
+
+    void attach(MotorLoad *load);
+
+    /* Ignore everything sent from start (us) for length (us), as if the
+       cable were pulled. The motor carries on with its last command.
+     */
+    void dropout(unsigned long start, unsigned long length);
+
+    // Motor 1 at the current virtual time.
+    long position();
+    long speed();
+
+    // Bring the motor and its load up to the current virtual time.
+    void update();
+
+    long baud() const;
+
+    uint16_t packetsReceived() const;
+    uint16_t crcErrors() const;
+
+private:
+    static const uint8_t MAX_PACKET = 32;
+    static const unsigned long TURNAROUND = 100; // us, from the last byte in to the first byte out
+    static const unsigned long STEP = 1000;      // us, motion integration step
+
+    enum MotionMode {
+        MOTION_SPEED,    // Run at target_speed.
+        MOTION_POSITION  // Move to target_position, accelerating and decelerating.
+    };
+
+    // Payload length of a write command, or -1 for a command that is a read.
+    static int writeLength(uint8_t cmd);
+
+    void handleRead(HardwareSerial &port, uint8_t cmd);
+    void handleWrite(HardwareSerial &port, uint8_t cmd, const uint8_t *payload);
+    void reply(HardwareSerial &port, const uint8_t *data, uint8_t length);
+
+    uint8_t address;
+    uint16_t config;
+    long config_baud;
+
+    uint8_t packet[MAX_PACKET];
+    uint8_t received;
+    unsigned long last_byte;
+    unsigned long dropout_start;  // us
+    unsigned long dropout_length; // us, 0 for none
+
+    // Motor 1
+    MotionMode mode;
+    double motor_position;  // QP, encoder count
+    double encoder_offset;  // QP, encoder count less travel
+    double motor_speed;     // QPPS
+    double target_speed;    // QPPS, signed
+    double target_position; // QP
+    double accel;           // QPPS/s, 0 for instant
+    double deccel;          // QPPS/s, 0 for instant
+    unsigned long updated;  // us
+    MotorLoad *load;
+
+    uint16_t packets;
+    uint16_t crc_errors;
+};
+
+#endif
@@ -0,0 +1,21 @@
+/* Interrupt control and the vectors the host runtime can raise.
+ */
+
+#ifndef host_interrupt_h
+#define host_interrupt_h
+
+#define ISR(vector) extern "C" void vector(void)
+
+extern "C" {
+void cli(void);
+void sei(void);
+
+// Defined by the firmware with ISR(), weak so that sketches without them link.
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void TIMER3_COMPA_vect(void) __attribute__((weak));
+void TIMER4_COMPA_vect(void) __attribute__((weak));
+void TIMER5_COMPA_vect(void) __attribute__((weak));
+void TWI_vect(void) __attribute__((weak));
+}
+
+#endif
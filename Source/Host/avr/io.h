@@ -0,0 +1,143 @@
+/* The 16 bit timers of the ATmega2560, as far as the host runtime runs them:
+   CTC mode on OCRnA with the compare A interrupt. Other modes and registers
+   are accepted and ignored. And the TWI, as a bus master, see twi.cpp.
+ */
+
+#ifndef host_io_h
+#define host_io_h
+
+#include <stdint.h>
+
+#include "Host.h"
+
+#define _BV(bit) (1 << (bit))
+#define _SFR_BYTE(sfr) (sfr)
+
+/* I/O register that tells the virtual clock when it is written, so that a
+   timer starts or stops at the right time.
+ */
+template <typename T>
+class HostRegister {
+public:
+    HostRegister() : value(0) {}
+
+    operator T() const { return value; }
+
+    HostRegister &operator=(T value) {
+        this->value = value;
+        host_reschedule();
+        return *this;
+    }
+
+    HostRegister &operator|=(T bits) { return *this = value | bits; }
+    HostRegister &operator&=(T bits) { return *this = value & bits; }
+
+private:
+    volatile T value;
+};
+
+struct HostTimerRegisters {
+    HostRegister<uint8_t> tccra;
+    HostRegister<uint8_t> tccrb;
+    HostRegister<uint16_t> tcnt;
+    HostRegister<uint16_t> ocra;
+    HostRegister<uint8_t> timsk;
+};
+
+// Indexed by timer number, 0 and 2 (8 bit timers) are unused.
+extern HostTimerRegisters host_timers[6];
+
+#define TCCR1A host_timers[1].tccra
+#define TCCR1B host_timers[1].tccrb
+#define TCNT1  host_timers[1].tcnt
+#define OCR1A  host_timers[1].ocra
+#define TIMSK1 host_timers[1].timsk
+
+#define TCCR3A host_timers[3].tccra
+#define TCCR3B host_timers[3].tccrb
+#define TCNT3  host_timers[3].tcnt
+#define OCR3A  host_timers[3].ocra
+#define TIMSK3 host_timers[3].timsk
+
+#define TCCR4A host_timers[4].tccra
+#define TCCR4B host_timers[4].tccrb
+#define TCNT4  host_timers[4].tcnt
+#define OCR4A  host_timers[4].ocra
+#define TIMSK4 host_timers[4].timsk
+
+#define TCCR5A host_timers[5].tccra
+#define TCCR5B host_timers[5].tccrb
+#define TCNT5  host_timers[5].tcnt
+#define OCR5A  host_timers[5].ocra
+#define TIMSK5 host_timers[5].timsk
+
+// Same bit positions for every 16 bit timer.
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define OCIE1A 1
+
+#define CS30 CS10
+#define CS31 CS11
+#define CS32 CS12
+#define WGM32 WGM12
+#define WGM33 WGM13
+#define OCIE3A OCIE1A
+
+#define CS40 CS10
+#define CS41 CS11
+#define CS42 CS12
+#define WGM42 WGM12
+#define WGM43 WGM13
+#define OCIE4A OCIE1A
+
+#define CS50 CS10
+#define CS51 CS11
+#define CS52 CS12
+#define WGM52 WGM12
+#define WGM53 WGM13
+#define OCIE5A OCIE1A
+
+/* TWCR. Writing it hands the write to the bus in twi.cpp, which sets TWINT
+   and clears TWSTO in value as the bus gets through what was asked.
+ */
+class HostTwiControl {
+public:
+    HostTwiControl() : value(0) {}
+
+    operator uint8_t() const;
+
+    HostTwiControl &operator=(uint8_t value);
+
+    HostTwiControl &operator|=(uint8_t bits) { return *this = value | bits; }
+    HostTwiControl &operator&=(uint8_t bits) { return *this = value & bits; }
+
+    volatile uint8_t value;
+};
+
+extern HostTwiControl host_twcr;
+extern volatile uint8_t host_twdr;
+extern volatile uint8_t host_twsr;
+extern volatile uint8_t host_twbr;
+extern volatile uint8_t host_twar;
+
+#define TWCR host_twcr
+#define TWDR host_twdr
+#define TWSR host_twsr
+#define TWBR host_twbr
+#define TWAR host_twar
+
+#define TWIE  0
+#define TWEN  2
+#define TWWC  3
+#define TWSTO 4
+#define TWSTA 5
+#define TWEA  6
+#define TWINT 7
+
+#define TWPS0 0
+#define TWPS1 1
+
+#endif
@@ -0,0 +1,21 @@
+/* Program memory is ordinary memory on the host.
+ */
+
+#ifndef host_pgmspace_h
+#define host_pgmspace_h
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+#define pgm_read_word(address)  (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif
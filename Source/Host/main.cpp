@@ -0,0 +1,148 @@
+/* Runs the ventilator firmware on the host.
+
+   setup() and loop() from E_VentV1Software.ino run on the virtual clock in
+   Host.h, with a RoboClaw model on Serial2 driving the bag of a simulated
+   patient, whose airway pressure the sensor on the I2C bus reads. Whatever
+   the firmware writes to Serial (binary log records, or the waveform
+   stream) can be saved with --serial.
+
+   Usage:
+       host_ventilator [--seconds N] [--loop-cost US] [--serial FILE] [--commands STRING]
+                       [--compliance ML_PER_CMH2O] [--resistance CMH2O_PER_L_S] [--peep CMH2O]
+                       [--effort CMH2O] [--effort-rate BPM] [--noise CMH2O] [--spikes CHANCE]
+                       [--dropout SECONDS] [--dropout-length SECONDS]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "RoboClawModel.h"
+#include "LungModel.h"
+
+#include "Motor.h"
+#include "pressure.h"
+
+void setup();
+void loop();
+
+
+const unsigned long DEFAULT_SECONDS = 60;
+const unsigned long DEFAULT_LOOP_COST = 20; // us per pass through loop(), on top of clock reads
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--seconds N] [--loop-cost US] [--serial FILE] [--commands STRING]\n"
+                    "          [--compliance ML_PER_CMH2O] [--resistance CMH2O_PER_L_S] [--peep CMH2O]\n"
+                    "          [--effort CMH2O] [--effort-rate BPM] [--noise CMH2O] [--spikes CHANCE]\n"
+                    "          [--dropout SECONDS] [--dropout-length SECONDS]\n", name);
+}
+
+
+int main(int argc, char **argv) {
+    unsigned long seconds = DEFAULT_SECONDS;
+    unsigned long loop_cost = DEFAULT_LOOP_COST;
+    const char *serial_file = NULL;
+    const char *commands = NULL;
+    LungSettings lung = DEFAULT_LUNG;
+    double dropout = -1;       // s, none if negative
+    double dropout_length = 1; // s
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--loop-cost") && i + 1 < argc) {
+            loop_cost = strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--serial") && i + 1 < argc) {
+            serial_file = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--commands") && i + 1 < argc) {
+            commands = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--compliance") && i + 1 < argc) {
+            lung.compliance = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--resistance") && i + 1 < argc) {
+            lung.resistance = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--peep") && i + 1 < argc) {
+            lung.peep = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--effort") && i + 1 < argc) {
+            lung.effortPressure = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--effort-rate") && i + 1 < argc) {
+            lung.effortRate = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--noise") && i + 1 < argc) {
+            lung.sensorNoise = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--spikes") && i + 1 < argc) {
+            lung.spikeChance = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--dropout") && i + 1 < argc) {
+            dropout = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--dropout-length") && i + 1 < argc) {
+            dropout_length = atof(argv[++i]);
+        }
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    FILE *serial_output = NULL;
+    if (serial_file) {
+        serial_output = fopen(serial_file, "wb");
+        if (!serial_output) {
+            perror(serial_file);
+            return 1;
+        }
+        Serial.hostOutput(serial_output);
+    }
+
+    RoboClawModel roboclaw(Serial2, MOTOR_ADDRESS, MOTOR_CONTROLLER_BAUD);
+    if (dropout >= 0) {
+        roboclaw.dropout(dropout * 1000000UL, dropout_length * 1000000UL);
+    }
+    LungModel patient(roboclaw, lung);
+    host_i2c_attach(PRESSURE_SENSOR_ADDRESS, &patient);
+
+    clock_t start = clock();
+
+    setup();
+
+    if (commands) {
+        Serial.hostSend((const uint8_t *)commands, strlen(commands), 0);
+    }
+
+    unsigned long end = host_now() + seconds * 1000000UL;
+    unsigned long passes = 0;
+    while (host_now() < end) {
+        loop();
+        host_advance(loop_cost);
+        passes++;
+    }
+
+    Serial.flush();
+
+    double wall = (double)(clock() - start) / CLOCKS_PER_SEC;
+    double simulated = host_now() / 1000000.0;
+
+    fprintf(stderr, "simulated %.1f s in %.2f s (%.0fx), %lu loop passes\n",
+            simulated, wall, wall > 0 ? simulated / wall : 0.0, passes);
+    fprintf(stderr, "roboclaw %ld baud, %u packets, %u CRC errors, position %ld\n",
+            roboclaw.baud(), roboclaw.packetsReceived(), roboclaw.crcErrors(), roboclaw.position());
+    fprintf(stderr, "patient %lu breaths, last %.0f mL at %.1f cmH2O peak, highest %.1f cmH2O\n",
+            patient.breaths(), patient.lastTidalVolume(), patient.lastPeakPressure(), patient.maxPressure());
+
+    if (serial_output) {
+        fclose(serial_output);
+    }
+
+    return 0;
+}
@@ -0,0 +1,10 @@
+/* The pins of the Arduino Mega that the libraries ask for by name.
+ */
+
+#ifndef host_pins_arduino_h
+#define host_pins_arduino_h
+
+#define SDA 20
+#define SCL 21
+
+#endif
@@ -0,0 +1,266 @@
+/* The TWI of the ATmega2560 as the master on a simulated I2C bus, driven by
+   SBWire's own twi.c, interrupt handler and all.
+
+   Writing TWCR with TWINT set starts what its other bits ask for: a start,
+   a byte out or in, or a stop. The bus takes as long over it as the wire
+   would at the bit rate TWBR sets, then puts the status in TWSR and raises
+   TWINT, and runs TWI_vect if TWIE is set. TWINT is raised as the
+   interrupt runs, so not while interrupts are off; twi.c never polls it.
+   A stop raises nothing, TWSTO reads clear once it is on the wire, so
+   twi_stop gets through it from the handler. Clearing TWEN drops whatever
+   is on the wire.
+
+   Devices are attached with host_i2c_attach, and an address with nothing
+   attached NACKs. A device is read whole when it is addressed, and the
+   master clocks out of that as many bytes as it wants. A device that
+   stretches the clock for HOST_NEVER holds the bus until the TWI is turned
+   off: nothing after it finishes, the stop included.
+ */
+
+#include <inttypes.h>
+
+#include "Arduino.h"
+
+// twi.c as it is built for the Mega, with C linkage as SBWire expects. The
+// headers it includes are already in, so only its own code is in the block.
+extern "C" {
+#include "utility/twi.c"
+}
+
+
+HostTwiControl host_twcr;
+volatile uint8_t host_twdr;
+volatile uint8_t host_twsr;
+volatile uint8_t host_twbr;
+volatile uint8_t host_twar;
+
+static const uint8_t MAX_DEVICES = 4;
+
+static struct {
+    uint8_t address;
+    HostI2CDevice *device;
+} devices[MAX_DEVICES];
+
+
+static HostI2CDevice *find(uint8_t address) {
+    for (uint8_t i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].device && devices[i].address == address) {
+            return devices[i].device;
+        }
+    }
+
+    return NULL;
+}
+
+
+void host_i2c_attach(uint8_t address, HostI2CDevice *device) {
+    for (uint8_t i = 0; i < MAX_DEVICES; i++) {
+        if (!devices[i].device || devices[i].address == address) {
+            devices[i].address = address;
+            devices[i].device = device;
+            return;
+        }
+    }
+}
+
+
+/* The wire, and the slave on the other end of it. An interrupt source, so
+   TWINT is raised, and TWI_vect run, once interrupts are on.
+ */
+class HostTwiBus : public HostDevice {
+public:
+    HostTwiBus()
+        : HostDevice(true), done(HOST_NEVER), stop_done(0), operation(NONE), last(NONE), owner(false),
+          reading(false), ack(false), holding(false), device(NULL), length(0), index(0) {}
+
+    void control(uint8_t value) {
+        // TWINT is cleared by writing a one to it.
+        uint8_t flag = (value & _BV(TWINT)) ? 0 : (host_twcr.value & _BV(TWINT));
+        host_twcr.value = (value & ~_BV(TWINT)) | flag;
+
+        if (!(value & _BV(TWEN))) {
+            reset();
+        }
+        else if (value & _BV(TWINT)) {
+            start(value);
+        }
+
+        reschedule();
+    }
+
+    // A stop has no interrupt, TWSTO clears once it is on the wire.
+    uint8_t read() {
+        if ((host_twcr.value & _BV(TWSTO)) && host_now() >= stop_done) {
+            host_twcr.value &= ~_BV(TWSTO);
+            host_twsr = TW_NO_INFO | (host_twsr & ~TW_STATUS_MASK);
+        }
+        return host_twcr.value;
+    }
+
+    virtual unsigned long nextEvent() {
+        // A handler that leaves TWINT set runs again.
+        const uint8_t enabled = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+        if (NONE == operation && (host_twcr.value & enabled) == enabled) {
+            return host_now();
+        }
+        return done;
+    }
+
+    virtual void run(unsigned long now) {
+        Operation finished = operation;
+        uint8_t status = TW_NO_INFO;
+
+        operation = NONE;
+        done = HOST_NEVER;
+
+        switch (finished) {
+        case START:
+            status = owner ? TW_REP_START : TW_START;
+            owner = true;
+            break;
+
+        case ADDRESS:
+            reading = host_twdr & TW_READ;
+            device = find(host_twdr >> 1);
+            length = 0;
+            index = 0;
+            if (reading) {
+                length = device ? device->read(data, TWI_BUFFER_LENGTH) : 0;
+                status = length ? TW_MR_SLA_ACK : TW_MR_SLA_NACK;
+            }
+            else {
+                status = device ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+            }
+            break;
+
+        case RECEIVE:
+            // The line floats high past the end of what the slave has.
+            host_twdr = (index < length) ? data[index] : 0xFF;
+            index++;
+            status = ack ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+            break;
+
+        case TRANSMIT:
+            if (length < TWI_BUFFER_LENGTH) {
+                data[length++] = host_twdr;
+            }
+            status = TW_MT_DATA_ACK;
+            break;
+
+        case NONE:
+            break;
+        }
+
+        if (NONE != finished) {
+            last = finished;
+            host_twsr = status | (host_twsr & ~TW_STATUS_MASK);
+            host_twcr.value |= _BV(TWINT);
+        }
+
+        if (host_twcr.value & _BV(TWIE)) {
+            TWI_vect();
+        }
+    }
+
+private:
+    enum Operation : uint8_t { NONE, START, ADDRESS, RECEIVE, TRANSMIT };
+
+    // What the TWINT just cleared asks for, going by the control bits and
+    // by what the bus did last.
+    void start(uint8_t value) {
+        if (value & _BV(TWSTO)) {
+            deliver();
+            if (!owner) {
+                host_twcr.value &= ~_BV(TWSTO);
+                return;
+            }
+            owner = false;
+            stop_done = holding ? HOST_NEVER : host_now() + busTime(1);
+        }
+        else if (value & _BV(TWSTA)) {
+            deliver();
+            begin(START, 1, 0);
+        }
+        else if (!owner) {
+            // Slave mode, which the ventilator never uses.
+        }
+        else if (START == last) {
+            begin(ADDRESS, 9, 0);
+        }
+        else if (reading) {
+            ack = value & _BV(TWEA);
+            // The slave holds the clock before its first byte.
+            begin(RECEIVE, 9, (0 == index && device) ? device->stretch() : 0);
+        }
+        else {
+            begin(TRANSMIT, 9, 0);
+        }
+    }
+
+    void begin(Operation next, uint8_t bits, unsigned long stretch) {
+        operation = next;
+
+        if (HOST_NEVER == stretch) {
+            holding = true;
+        }
+
+        if (holding) {
+            done = HOST_NEVER;
+        }
+        else {
+            // After any stop still on the wire.
+            unsigned long from = (stop_done > host_now()) ? stop_done : host_now();
+            done = from + busTime(bits) + stretch;
+        }
+    }
+
+    // us for bits at the bit rate and prescaler, 16 + 2 TWBR 4^TWPS CPU cycles each.
+    unsigned long busTime(uint8_t bits) const {
+        unsigned long cycles = 16 + 2UL * host_twbr * (1UL << (2 * (host_twsr & 0x03)));
+        return bits * cycles / (F_CPU / 1000000UL);
+    }
+
+    // Hands a write over to the slave, at the stop or repeated start that ends it.
+    void deliver() {
+        if (owner && !reading && device) {
+            device->write(data, length);
+        }
+        device = NULL;
+    }
+
+    void reset() {
+        operation = NONE;
+        last = NONE;
+        done = HOST_NEVER;
+        stop_done = 0;
+        owner = false;
+        holding = false;
+        device = NULL;
+    }
+
+    unsigned long done;      // When the operation in progress is through
+    unsigned long stop_done; // When the last stop is, or is to be, through
+    Operation operation;
+    Operation last;
+    bool owner;   // Sent a start, and no stop since
+    bool reading;
+    bool ack;     // TWEA as the byte being received started
+    bool holding; // The slave has the clock until the TWI is turned off
+    HostI2CDevice *device;
+    uint8_t data[TWI_BUFFER_LENGTH];
+    uint8_t length;
+    uint8_t index;
+};
+
+static HostTwiBus bus;
+
+
+HostTwiControl::operator uint8_t() const {
+    return bus.read();
+}
+
+
+HostTwiControl &HostTwiControl::operator=(uint8_t value) {
+    bus.control(value);
+    return *this;
+}
@@ -0,0 +1,43 @@
+/* Checks for the host tests in this directory.
+
+   Each test is a program built against the firmware objects of the host
+   build, see the test target in ../E_VentV1Software/Makefile. A check
+   prints what it measured next to its limit, and the program returns
+   non-zero if any check failed.
+ */
+
+#ifndef HostTest_h
+#define HostTest_h
+
+#include <stdio.h>
+
+static int host_test_failures = 0;
+
+
+/* Check that a worst case, or any measured value, is no more than limit.
+ */
+static inline void expect_at_most(const char *name, const double value, const double limit) {
+    bool ok = value <= limit;
+    printf("%s %-48s %12.4f (limit %.4f)\n", ok ? "ok  " : "FAIL", name, value, limit);
+    if (!ok) {
+        host_test_failures++;
+    }
+}
+
+
+/* Check that value is at least limit.
+ */
+static inline void expect_at_least(const char *name, const double value, const double limit) {
+    bool ok = value >= limit;
+    printf("%s %-48s %12.4f (limit %.4f)\n", ok ? "ok  " : "FAIL", name, value, limit);
+    if (!ok) {
+        host_test_failures++;
+    }
+}
+
+
+static inline int host_test_result() {
+    return host_test_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Regression checks that run the firmware on the host simulator.
+
+Each check runs host_ventilator (see ../Host/main.cpp) over a scenario and
+looks at its summary and at the decoded log. Exits non-zero if any check
+fails.
+
+Usage:
+    host_checks.py build-host/host_ventilator
+"""
+
+import argparse
+import io
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Tools"))
+import decode_log  # noqa: E402
+
+SUMMARY_POSITION = re.compile(r"position (-?\d+)")
+SUMMARY_BREATHS = re.compile(r"patient (\d+) breaths")
+SUMMARY_SPEED = re.compile(r"\((\d+)x\)")
+BREATH_TIMING = re.compile(r"Breath timing error inhale=(-?\d+) plateau=-?\d+ exhale=(-?\d+) us")
+
+MIN_SPEED = 1000  # times real time, for soak tests of days of breathing
+SPEED_RUNS = 3
+EXHALE_CUT_SHORT_US = 100000  # us; by a trigger, rather than by a step
+INHALE_TOLERANCE_US = 10000    # us; two state steps
+
+
+def run(program, args):
+    """Run the simulator, return its summary and the decoded log."""
+    with tempfile.NamedTemporaryFile(suffix=".bin") as capture:
+        result = subprocess.run([program, "--serial", capture.name] + args,
+                                stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                universal_newlines=True, check=True)
+        log = io.StringIO()
+        with open(capture.name, "rb") as stream:
+            decode_log.decode(stream, decode_log.load_events(decode_log.HEADER), log)
+
+    return result.stderr, log.getvalue()
+
+
+def check_safety_stop(program):
+    """A stiff lung trips the high pressure stop on every breath. Whatever
+    the loop costs, the bag has to be let go again, and the ventilator has
+    to carry on breathing rather than end up in failure mode."""
+    failures = []
+
+    for loop_cost in (5, 13, None, 97, 401, 777, 1500):
+        args = ["--seconds", "30", "--compliance", "8"]
+        if loop_cost is not None:
+            args += ["--loop-cost", str(loop_cost)]
+        summary, log = run(program, args)
+
+        name = "loop cost %s" % (loop_cost if loop_cost is not None else "default")
+        position = int(SUMMARY_POSITION.search(summary).group(1))
+        breaths = int(SUMMARY_BREATHS.search(summary).group(1))
+        stops = log.count("Safety stop")
+
+        if not stops:
+            failures.append("%s: no safety stop" % name)
+        if "Failure Mode" in log:
+            failures.append("%s: failure mode" % name)
+        if position != 0:
+            failures.append("%s: motor left at %d" % (name, position))
+        if breaths < 5:
+            failures.append("%s: only %d breaths" % (name, breaths))
+
+    return failures
+
+
+def check_failure_stop(program):
+    """The controller stops answering for long enough that the telemetry
+    alarm puts the ventilator in failure mode, and the stop copy fails on
+    every retry. The stop has to be sent again until it is acknowledged,
+    once the controller is back, and failure mode logged only once."""
+    failures = []
+
+    summary, log = run(program, ["--seconds", "20", "--dropout", "10", "--dropout-length", "2"])
+
+    entries = log.count("Failure Mode")
+    if entries != 1:
+        failures.append("failure mode logged %d times" % entries)
+    if log.count("Safety stop") < 2:
+        failures.append("stop not sent again")
+    if "stop acknowledged" not in log:
+        failures.append("stop never acknowledged")
+
+    return failures
+
+
+def check_trigger_in_exhale(program):
+    """A patient who breathes faster than the set rate triggers breaths
+    in the exhale, which cuts it short with the motor still on its way
+    back. The pressure stop is only armed once the inhale move is queued,
+    so none of that may stop the motor, and the triggered breaths have to
+    be delivered whole."""
+    failures = []
+
+    _, log = run(program, ["--seconds", "40", "--effort", "8", "--effort-rate", "22"])
+
+    timings = [tuple(int(error) for error in match)
+               for match in BREATH_TIMING.findall(log)]
+    cut_short = [inhale for inhale, exhale in timings if exhale < -EXHALE_CUT_SHORT_US]
+
+    if len(cut_short) < 5:
+        failures.append("only %d exhales cut short" % len(cut_short))
+    if "Safety stop" in log:
+        failures.append("safety stop")
+    if "Failure Mode" in log or "ACInhaleAbort" in log:
+        failures.append("inhale aborted or failure mode")
+    late = [inhale for inhale in cut_short if abs(inhale) > INHALE_TOLERANCE_US]
+    if late:
+        failures.append("inhale off by %d us after a cut short exhale" % max(late, key=abs))
+
+    return failures
+
+
+def check_throughput(program):
+    """At the default loop cost the simulator has to run at least
+    MIN_SPEED times real time on one core, so that a day of breathing takes
+    minutes. The best of a few runs counts, in case the machine is busy."""
+    speeds = []
+
+    for _ in range(SPEED_RUNS):
+        summary, _ = run(program, ["--seconds", "600"])
+        speeds.append(int(SUMMARY_SPEED.search(summary).group(1)))
+
+    if max(speeds) < MIN_SPEED:
+        return ["%dx real time at best, of %s" % (max(speeds), ", ".join("%dx" % speed for speed in speeds))]
+    return []
+
+
+CHECKS = [check_safety_stop, check_failure_stop, check_trigger_in_exhale, check_throughput]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("program", help="path to host_ventilator")
+    args = parser.parse_args()
+
+    failed = False
+    for check in CHECKS:
+        failures = check(args.program)
+        print("%s %s" % ("FAIL" if failures else "ok  ", check.__name__))
+        for failure in failures:
+            print("    " + failure)
+        failed = failed or bool(failures)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,33 @@
+/* A device failure takes the ventilator to FailureMode in its turn.
+
+   The alarms are shown and reset highest priority first, and a device
+   failure is the lowest. A failure raised alongside a higher alarm waits
+   for that alarm to be reset before it stops the motor.
+ */
+
+#include "HostTest.h"
+
+#include "MachineStates.h"
+#include "alarms.h"
+
+
+int main() {
+    VentilatorState state = get_init_state();
+    volatile boolean alarmReset = false;
+    const machineStates running = state.machine_state;
+
+    // Behind a high pressure alarm.
+    state.errors = HIGH_PRESSURE_ALARM | DEVICE_FAILURE_ALARM;
+    handle_alarms(alarmReset, state);
+    expect_at_most("failure mode, behind high pressure", state.machine_state == FailureMode, 0);
+    expect_at_most("machine state changed, behind high pressure", state.machine_state != running, 0);
+
+    // Which is reset, leaving the device failure on top.
+    alarmReset = true;
+    handle_alarms(alarmReset, state);
+    expect_at_most("errors left after reset", state.errors, DEVICE_FAILURE_ALARM);
+    handle_alarms(alarmReset, state);
+    expect_at_least("failure mode, on its own", state.machine_state == FailureMode, 1);
+
+    return host_test_result();
+}
@@ -0,0 +1,139 @@
+/* The fixed point pressure, timing and motor math against the float
+   formulas it replaced.
+
+   - pressureCountsToCmH2O over every 14 bit reading.
+   - Pressure::to_int, as the LCD shows pressures, over every Pressure.
+   - breath_period and update_motor_settings over every setting the UI
+     allows: BPM, inspiration time, tidal volume and plateau pause in their
+     increments. The UI also raises the lowest BPM to fit the inspiration
+     time and pause, which need not be a whole number, so that BPM is
+     checked as well.
+ */
+
+#include <math.h>
+
+#include "HostTest.h"
+
+#include "LCD.h"
+#include "MachineStates.h"
+#include "Motor.h"
+#include "UserParameter.h"
+#include "breathing.h"
+#include "conversions.h"
+#include "pressure.h"
+
+// About one Q8 step, 0.0039 cmH2O, plus the rounding of the Q14 scale.
+const double PRESSURE_TOLERANCE = 0.005;      // cmH2O
+// Rounded to the ms, from a BPM rounded to Q8.
+const double PERIOD_TOLERANCE = 1.5;          // ms
+const double TIME_TOLERANCE = 2;              // ms; expiration and return, from the period
+const double INHALE_SPEED_TOLERANCE = 1;      // QPPS
+const double RETURN_SPEED_TOLERANCE = 5;      // QPPS
+const double SHORTEST_CHECKED_RETURN = 0.1;   // s; return speed is only checked from here
+
+
+static double worst_pressure = 0;
+static double worst_display = 0;
+static double worst_period = 0;
+static double worst_pulses = 0;
+static double worst_inhale_speed = 0;
+static double worst_expiration = 0;
+static double worst_return_time = 0;
+static double worst_return_speed = 0;
+static unsigned long combinations = 0;
+
+
+static void worst(double &worst_error, const double error) {
+    if (fabs(error) > worst_error) {
+        worst_error = fabs(error);
+    }
+}
+
+
+static void check_pressure() {
+    for (uint16_t raw = 0; raw <= PRESSURE_COUNTS_MASK; raw++) {
+        double expected = (((double)raw - MIN_DIGITAL_OUTPUT)*(MAX_SENSOR_PRESSURE - MIN_SENSOR_PRESSURE)
+                           /(MAX_DIGITAL_OUTPUT - MIN_DIGITAL_OUTPUT) + MIN_SENSOR_PRESSURE)*PSI_TO_CMH2O;
+        worst(worst_pressure, pressureCountsToCmH2O(raw).to_float() - expected);
+    }
+}
+
+
+static void check_display_pressure() {
+    for (long raw = Pressure::min_raw(); raw <= Pressure::max_raw(); raw++) {
+        Pressure pressure = Pressure::from_raw(raw);
+        worst(worst_display, pressure.to_int() - roundAndCast(pressure.to_float()));
+    }
+}
+
+
+static void check_settings(const float bpm, const float inspiration, const float tidal_volume, const float pause) {
+    VentilatorSettings settings;
+    VentilatorDerived derived;
+
+    settings.breaths_per_minute = BreathRate::from_float(bpm);
+    settings.inspiration_time = seconds_to_ms(inspiration);
+    settings.tidal_volume = Percentage::from_float(tidal_volume);
+    settings.plateau_pause_time = seconds_to_ms(pause);
+    settings.ac_threshold_pressure = Pressure::from_float(DEFAULT_THRESHOLD_PRESSURE);
+    settings.ac_threshold_time = 0;
+
+    update_motor_settings(settings, derived);
+
+    double period = 60.0/bpm;
+    double pulses = (long)(0.01*tidal_volume*QP_AT_FULL_STROKE);
+    double expiration = fmax(period - inspiration - pause, 0);
+    double return_time = expiration*MOTOR_RETURN_FACTOR;
+
+    worst(worst_period, breath_period(settings) - period*1000);
+    worst(worst_pulses, derived.motor_inhale_pulses - pulses);
+    worst(worst_inhale_speed, derived.motor_inhale_speed - pulses/inspiration);
+    worst(worst_expiration, derived.expiration_time - expiration*1000);
+    worst(worst_return_time, derived.motor_return_time - return_time*1000);
+    if (return_time >= SHORTEST_CHECKED_RETURN) {
+        worst(worst_return_speed, derived.motor_return_speed - pulses/return_time);
+    }
+    combinations++;
+}
+
+
+static void check_motor_settings() {
+    for (float inspiration = MIN_INSPIRATION_TIME; inspiration <= MAX_INSPIRATION_TIME + 0.001f;
+         inspiration += INSPIRATION_TIME_INCREMENT) {
+        for (float pause = MIN_PLATEAU_PAUSE_TIME; pause <= MAX_PLATEAU_PAUSE_TIME + 0.001f;
+             pause += PLATEAU_PAUSE_TIME_INCREMENT) {
+            // As UserParameter::updateTmpValue limits them.
+            float lowest_bpm = 60.0/((2.0*inspiration) + pause);
+            float highest_inspiration = (60.0/(2.0*lowest_bpm)) - pause/2;
+
+            for (float tidal_volume = MIN_TIDAL_VOLUME; tidal_volume <= MAX_TIDAL_VOLUME;
+                 tidal_volume += TIDAL_VOLUME_INCREMENT) {
+                for (float bpm = MIN_BPM; bpm <= MAX_BPM; bpm += BPM_INCREMENT) {
+                    check_settings(bpm, inspiration, tidal_volume, pause);
+                }
+                if (lowest_bpm > MIN_BPM && lowest_bpm <= MAX_BPM && inspiration <= highest_inspiration) {
+                    check_settings(lowest_bpm, inspiration, tidal_volume, pause);
+                }
+            }
+        }
+    }
+}
+
+
+int main() {
+    check_pressure();
+    check_display_pressure();
+    check_motor_settings();
+
+    printf("%lu setting combinations\n", combinations);
+    expect_at_most("pressureCountsToCmH2O error, cmH2O", worst_pressure, PRESSURE_TOLERANCE);
+    expect_at_most("Pressure::to_int error, cmH2O", worst_display, 0);
+    expect_at_most("breath_period error, ms", worst_period, PERIOD_TOLERANCE);
+    expect_at_most("motor_inhale_pulses error, QP", worst_pulses, 0);
+    expect_at_most("motor_inhale_speed error, QPPS", worst_inhale_speed, INHALE_SPEED_TOLERANCE);
+    expect_at_most("expiration_time error, ms", worst_expiration, TIME_TOLERANCE);
+    expect_at_most("motor_return_time error, ms", worst_return_time, TIME_TOLERANCE);
+    expect_at_most("motor_return_speed error, QPPS", worst_return_speed, RETURN_SPEED_TOLERANCE);
+
+    return host_test_result();
+}
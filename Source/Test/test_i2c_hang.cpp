@@ -0,0 +1,114 @@
+/* A pressure sensor that hangs the bus mid read does not stop sampling.
+
+   The sensor here holds the clock low, and so the bus, until the master
+   turns its TWI off. The sampling interrupt finds the read still busy past
+   the TWI timeout, resets the TWI, counts the read as failed and starts
+   the next one. A sensor that hangs once costs a read or two; one that
+   hangs every read leaves the samples to go stale, which raises the
+   pressure sensor alarm.
+ */
+
+#include "HostTest.h"
+
+#include "alarms.h"
+#include "pressure.h"
+
+const unsigned long SETTLE_TIME = 100000;  // us
+const unsigned long HANG_TIME = 200000;    // us the sensor hangs every read
+const uint16_t SENSOR_COUNTS = 9000;       // About 0.6 PSI
+
+
+class HangingSensor : public HostI2CDevice {
+public:
+    HangingSensor() : hangs(0), hang_always(false) {}
+
+    virtual uint8_t read(uint8_t *data, uint8_t length) {
+        if (length < 2) {
+            return 0;
+        }
+        data[0] = SENSOR_COUNTS >> 8;
+        data[1] = SENSOR_COUNTS & 0xFF;
+        return 2;
+    }
+
+    virtual unsigned long stretch() {
+        if (hang_always || hangs) {
+            if (hangs) {
+                hangs--;
+            }
+            return HOST_NEVER;
+        }
+        return 0;
+    }
+
+    uint8_t hangs;     // Reads still to hang
+    bool hang_always;
+};
+
+
+static unsigned long count_samples(const unsigned long time) {
+    PressureSample sample;
+    unsigned long samples = 0;
+    unsigned long end = micros() + time;
+
+    while (micros() < end) {
+        while (getWaveformSample(sample)) {
+            samples++;
+        }
+        host_advance(1000);
+    }
+
+    return samples;
+}
+
+
+int main() {
+    HangingSensor sensor;
+    host_i2c_attach(PRESSURE_SENSOR_ADDRESS, &sensor);
+
+    setUpPressureSensor(PRESSURE_SENSOR_BAUD_RATE);
+    startPressureSampling();
+
+    // Nothing is kept for waveform capture until it is asked for.
+    expect_at_most("waveform samples, not sampling", count_samples(SETTLE_TIME), 0);
+    setWaveformSampling(true);
+    count_samples(SETTLE_TIME);
+
+    // One read hangs.
+    uint16_t recoveries = Wire.getRecoveryCount();
+    uint16_t failures = getPressureReadFailures();
+    sensor.hangs = 1;
+    unsigned long samples = count_samples(SETTLE_TIME);
+
+    printf("one hang: %u recoveries, %u failures, %lu samples\n",
+           Wire.getRecoveryCount() - recoveries, getPressureReadFailures() - failures, samples);
+    expect_at_least("recoveries, one hang", Wire.getRecoveryCount() - recoveries, 1);
+    expect_at_least("read failures, one hang", getPressureReadFailures() - failures, 1);
+    expect_at_least("samples per second, one hang", samples*1000000.0/SETTLE_TIME, PRESSURE_SAMPLE_RATE - 2);
+    expect_at_most("pressure sensor alarm, one hang", check_pressure_sample_age(getPressureSampleAge()), 0);
+
+    // Every read hangs.
+    recoveries = Wire.getRecoveryCount();
+    sensor.hang_always = true;
+    samples = count_samples(HANG_TIME);
+
+    printf("hung: %u recoveries, %lu samples, newest %lu ms old\n",
+           Wire.getRecoveryCount() - recoveries, samples, getPressureSampleAge());
+    expect_at_most("samples, hung", samples, 1);
+    // Each read times out by the next sampling interrupt, which starts another.
+    expect_at_least("recoveries per second, hung", (Wire.getRecoveryCount() - recoveries)*1000000.0/HANG_TIME,
+                    PRESSURE_READ_RATE - 5);
+    expect_at_least("pressure sensor alarm, hung",
+                    check_pressure_sample_age(getPressureSampleAge()) == PRESSURE_SENSOR_ALARM, 1);
+
+    // And lets go.
+    sensor.hang_always = false;
+    count_samples(SETTLE_TIME);
+    samples = count_samples(SETTLE_TIME);
+
+    printf("released: %lu samples, newest %lu ms old\n", samples, getPressureSampleAge());
+    expect_at_least("samples per second, released", samples*1000000.0/SETTLE_TIME, PRESSURE_SAMPLE_RATE - 1);
+    expect_at_most("pressure sensor alarm, released", check_pressure_sample_age(getPressureSampleAge()), 0);
+
+    return host_test_result();
+}
@@ -0,0 +1,148 @@
+/* Time on the I2C bus does not count toward the time of the state step.
+
+   The pressure sensor is read from the Timer3 interrupt, and the TWI
+   interrupt hands the sample over once the read is done. A sensor that
+   stretches the clock makes every read take longer on the bus, but
+   update_state only ever takes samples that have already arrived, so its
+   time stays the same however slow the sensor is.
+
+   The sensor here answers after a stretch of up to most of the read
+   period. One read of it is timed on its own too, to show the bus time is
+   really there. On the virtual clock update_state only takes time for
+   its clock reads, unless it waits on something.
+ */
+
+#include "HostTest.h"
+
+#include "MachineStates.h"
+#include "pressure.h"
+
+// us; a read has to finish within the 1250 us read period, 290 us of it on the wire.
+const unsigned long STRETCHES[] = {0, 300, 600, 900};
+const uint8_t NUM_STRETCHES = sizeof(STRETCHES) / sizeof(STRETCHES[0]);
+
+const unsigned long RUN_TIME = 2000000;   // us per stretch
+const unsigned long STATE_PERIOD = 5000;  // us, the state task at 200 Hz
+const uint16_t SENSOR_COUNTS = 9000;      // About 0.6 PSI
+
+// What the interrupts can add to a step wherever they land: the sampling
+// interrupt reads the clock, and the TWI interrupt that ends a read waits
+// out the stop on the wire, a bit time, reading the clock as it goes.
+const unsigned long INTERRUPT_COST = HOST_CLOCK_READ_COST + 3*HOST_CLOCK_READ_COST;
+
+
+class SlowSensor : public HostI2CDevice {
+public:
+    SlowSensor() : delay(0) {}
+
+    virtual uint8_t read(uint8_t *data, uint8_t length) {
+        if (length < 2) {
+            return 0;
+        }
+        data[0] = SENSOR_COUNTS >> 8;
+        data[1] = SENSOR_COUNTS & 0xFF;
+        return 2;
+    }
+
+    virtual unsigned long stretch() {
+        return delay;
+    }
+
+    unsigned long delay;
+};
+
+
+struct StepTimes {
+    unsigned long read;          // us, start to callback
+    unsigned long worst_step;    // us
+    unsigned long samples;
+    uint16_t failures;           // Reads that failed or overran
+};
+
+
+static volatile unsigned long read_end = 0;
+
+static void readComplete(uint8_t *data, uint8_t length) {
+    read_end = micros();
+}
+
+
+static StepTimes run(SlowSensor &sensor, VentilatorState &state, const unsigned long stretch) {
+    StepTimes times = {0, 0, 0, 0};
+    PressureSample waveform;
+
+    sensor.delay = stretch;
+
+    // Hold off the sampling, and let the read in flight finish, for the one on its own.
+    TIMSK3 &= ~_BV(OCIE3A);
+    host_advance(STATE_PERIOD);
+    read_end = 0;
+    unsigned long start = micros();
+    Wire.startRequestFrom(PRESSURE_SENSOR_ADDRESS, 2, readComplete);
+    while (!read_end) {
+        host_advance(1);
+    }
+    times.read = read_end - start;
+    TIMSK3 |= _BV(OCIE3A);
+
+    host_advance(2*STATE_PERIOD);
+    while (getWaveformSample(waveform)) {
+    }
+
+    uint16_t failures = getPressureReadFailures();
+    unsigned long end = micros() + RUN_TIME;
+    while (micros() < end) {
+        // The same samples as update_state takes, from their own buffer.
+        while (getWaveformSample(waveform)) {
+            times.samples++;
+        }
+
+        start = micros();
+        update_state(state);
+        unsigned long step = micros() - start;
+        if (step > times.worst_step) {
+            times.worst_step = step;
+        }
+
+        host_advance(STATE_PERIOD);
+    }
+
+    times.failures = getPressureReadFailures() - failures;
+    return times;
+}
+
+
+int main() {
+    SlowSensor sensor;
+    host_i2c_attach(PRESSURE_SENSOR_ADDRESS, &sensor);
+
+    setUpPressureSensor(PRESSURE_SENSOR_BAUD_RATE);
+    setWaveformSampling(true);
+    startPressureSampling();
+
+    VentilatorState state = get_init_state();
+    StepTimes fast = run(sensor, state, STRETCHES[0]);
+
+    for (uint8_t i = 0; i < NUM_STRETCHES; i++) {
+        StepTimes times = run(sensor, state, STRETCHES[i]);
+        char name[64];
+
+        printf("stretch %4lu us: read %4lu us, worst update_state %lu us, %lu samples\n",
+               STRETCHES[i], times.read, times.worst_step, times.samples);
+
+        snprintf(name, sizeof(name), "read, stretch %lu us", STRETCHES[i]);
+        expect_at_least(name, times.read, fast.read + STRETCHES[i]);
+
+        snprintf(name, sizeof(name), "worst update_state, stretch %lu us", STRETCHES[i]);
+        expect_at_most(name, times.worst_step, fast.worst_step + INTERRUPT_COST);
+
+        // Every read still finishes before the next one starts.
+        snprintf(name, sizeof(name), "samples per second, stretch %lu us", STRETCHES[i]);
+        expect_at_least(name, times.samples*1000000.0/RUN_TIME, PRESSURE_SAMPLE_RATE - 1);
+
+        snprintf(name, sizeof(name), "read failures, stretch %lu us", STRETCHES[i]);
+        expect_at_most(name, times.failures, 0);
+    }
+
+    return host_test_result();
+}
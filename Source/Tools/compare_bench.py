@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Compare two simavr bench results, before and after.
+
+Reads the bench.json files written by make bench or make bench-rev, see
+../Bench/bench_avr.cpp, and prints the mean and worst cycles of every timed
+function and the main loop percentiles side by side, with the change and
+the ratio. A function missing from either build (renamed, or inlined) is
+listed as such rather than compared.
+
+Usage:
+    make bench-rev BENCH_REV=487cf23~1
+    make bench-rev BENCH_REV=487cf23
+    python3 compare_bench.py build-bench/bench-16ec15f.json build-bench/bench-487cf23.json
+"""
+
+import argparse
+import json
+import sys
+
+LOOP_FIELDS = ["min", "mean", "p50", "p90", "p99", "p99_9", "max"]
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def row(out, name, before, after):
+    change = after - before
+    ratio = "%.2fx" % (before / after) if after else "-"
+    out.write("%-28s %12.1f %12.1f %+12.1f %8s\n" % (name, before, after, change, ratio))
+
+
+def compare(before, after, out):
+    out.write("before %s, after %s, %s at %d Hz\n\n" % (before["commit"], after["commit"],
+                                                        after["mcu"], after["f_cpu"]))
+
+    out.write("%-28s %12s %12s %12s %8s\n" % ("mean cycles", "before", "after", "change", "speedup"))
+    names = list(before["functions"])
+    names += [name for name in after["functions"] if name not in before["functions"]]
+    worst = []
+    for name in names:
+        old = before["functions"].get(name)
+        new = after["functions"].get(name)
+        if not (old and new and old["found"] and new["found"] and old["calls"] and new["calls"]):
+            out.write("%-28s %12s %12s\n" % (name, "found" if old and old["found"] else "-",
+                                             "found" if new and new["found"] else "-"))
+            continue
+        row(out, name, old["mean"], new["mean"])
+        worst.append((name, old["max"], new["max"]))
+
+    out.write("\n%-28s %12s %12s %12s %8s\n" % ("worst cycles", "before", "after", "change", "speedup"))
+    for name, old, new in worst:
+        row(out, name, old, new)
+
+    old = before.get("loop")
+    new = after.get("loop")
+    if old and new and old["found"] and new["found"]:
+        out.write("\n%-28s %12s %12s %12s %8s\n" % ("loop cycles", "before", "after", "change", "speedup"))
+        for field in LOOP_FIELDS:
+            row(out, field, old[field], new[field])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before", help="bench results before the change")
+    parser.add_argument("after", help="bench results after the change")
+    args = parser.parse_args()
+
+    compare(load(args.before), load(args.after), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
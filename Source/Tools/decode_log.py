@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Turn the ventilator's binary log back into text.
+
+Records are LOG_SYNC, the event ID, the argument count and 4 byte little
+endian arguments, see Log.h. Event IDs and formats are read from LOG_EVENTS
+in Log.h, so this always matches the firmware it is run next to. Anything
+outside a record (the output of the serial commands) is passed through.
+
+Usage:
+    stty -F /dev/ttyACM0 115200 raw
+    decode_log.py /dev/ttyACM0
+    decode_log.py capture.bin
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+LOG_SYNC = 0xA5
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                      "..", "E_VentV1Software", "Log.h")
+
+EVENT = re.compile(r'X\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+ARG = re.compile(r"%(lu|ld|f)")
+
+
+def load_events(header):
+    with open(header) as f:
+        text = f.read()
+
+    start = text.index("#define LOG_EVENTS(X)")
+    end = text.index("enum LogEvent", start)
+    return EVENT.findall(text[start:end])
+
+
+def format_record(events, event, args):
+    if event >= len(events):
+        return "unknown event %d %s" % (event, args)
+
+    name, fmt = events[event]
+    values = iter(args)
+
+    def expand(match):
+        raw = next(values, None)
+        if raw is None:
+            return "?"
+        if match.group(1) == "lu":
+            return str(struct.unpack("<I", raw)[0])
+        if match.group(1) == "ld":
+            return str(struct.unpack("<i", raw)[0])
+        return "%g" % struct.unpack("<f", raw)[0]
+
+    return ARG.sub(expand, fmt)
+
+
+def decode(stream, events, out):
+    text = bytearray()
+
+    while True:
+        byte = stream.read(1)
+        if not byte:
+            break
+
+        if byte[0] != LOG_SYNC:
+            text += byte
+            if byte == b"\n":
+                out.write(text.decode("ascii", "replace"))
+                text.clear()
+            continue
+
+        header = stream.read(2)
+        if len(header) < 2:
+            break
+        event, num_args = header
+        payload = stream.read(4 * num_args)
+        if len(payload) < 4 * num_args:
+            break
+
+        args = [payload[i:i + 4] for i in range(0, len(payload), 4)]
+        out.write(format_record(events, event, args) + "\n")
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="serial device or captured log file")
+    parser.add_argument("--header", default=HEADER, help="path to Log.h")
+    args = parser.parse_args()
+
+    events = load_events(args.header)
+    with open(args.input, "rb", buffering=0) as stream:
+        decode(stream, events, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
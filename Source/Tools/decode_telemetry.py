@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Turn the ventilator's binary waveform stream into CSV.
+
+Frames are COBS encoded and end with a 0 byte, see Telemetry.h. Each frame is
+checked against its CRC, and one CSV row is written per pressure sample, with
+the state, motor and alarm fields of the frame it came in. Gaps in the frame
+sequence number (frames dropped on a saturated link) and bad frames are
+reported on stderr.
+
+Usage:
+    stty -F /dev/ttyACM0 115200 raw
+    printf w > /dev/ttyACM0
+    decode_telemetry.py /dev/ttyACM0 > breath.csv
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+FRAME_WAVEFORM = 1
+HEADER = struct.Struct("<BHIBBBHiiB")
+SAMPLE = struct.Struct("<IH")
+
+# Used to turn raw counts into cmH2O, see pressure.h.
+COUNTS_MASK = 0x3FFF
+MIN_COUNTS = 1638.0
+MAX_COUNTS = 14745.0
+MIN_PSI = -1.0
+MAX_PSI = 1.0
+PSI_TO_CMH2O = 70.307
+
+COLUMNS = ["sequence", "frame_ms", "sample_us", "raw", "pressure_cmh2o",
+           "machine_state", "ac_state", "vc_state", "errors",
+           "motor_position", "motor_speed"]
+
+
+def crc16(data):
+    """CRC16-XMODEM, as RoboClawCodec::crc."""
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def counts_to_cmh2o(raw):
+    counts = raw & COUNTS_MASK
+    psi = (counts - MIN_COUNTS) * (MAX_PSI - MIN_PSI) / (MAX_COUNTS - MIN_COUNTS) + MIN_PSI
+    return psi * PSI_TO_CMH2O
+
+
+def frames(stream):
+    encoded = bytearray()
+    while True:
+        byte = stream.read(1)
+        if not byte:
+            return
+        if byte[0]:
+            encoded += byte
+            continue
+        if encoded:
+            yield cobs_decode(bytes(encoded))
+        encoded.clear()
+
+
+def decode(stream, out, err):
+    writer = csv.writer(out)
+    writer.writerow(COLUMNS)
+    expected = None
+
+    for frame in frames(stream):
+        if frame is None or len(frame) < HEADER.size + 2 or \
+                crc16(frame[:-2]) != struct.unpack("<H", frame[-2:])[0]:
+            err.write("bad frame\n")
+            continue
+
+        (kind, sequence, frame_ms, machine_state, ac_state, vc_state,
+         errors, position, speed, num_samples) = HEADER.unpack_from(frame)
+        if kind != FRAME_WAVEFORM or len(frame) != HEADER.size + num_samples * SAMPLE.size + 2:
+            err.write("unknown frame %d\n" % kind)
+            continue
+
+        if expected is not None and sequence != expected:
+            err.write("dropped %d frames\n" % ((sequence - expected) & 0xFFFF))
+        expected = (sequence + 1) & 0xFFFF
+
+        for i in range(num_samples):
+            sample_us, raw = SAMPLE.unpack_from(frame, HEADER.size + i * SAMPLE.size)
+            writer.writerow([sequence, frame_ms, sample_us, raw, "%.2f" % counts_to_cmh2o(raw),
+                             machine_state, ac_state, vc_state, errors, position, speed])
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="serial device or captured stream")
+    args = parser.parse_args()
+
+    with open(args.input, "rb", buffering=0) as stream:
+        decode(stream, sys.stdout, sys.stderr)
+
+
+if __name__ == "__main__":
+    main()